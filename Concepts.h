@@ -4,6 +4,7 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <concepts>
 #include <experimental/type_traits>
 
 // FIXME use C++20 concepts when available
@@ -29,4 +30,11 @@ constexpr inline bool IsMap = IsInstance<T, std::map>;
 template <typename T>
 constexpr inline bool IsSharedPointer = IsInstance<T, std::shared_ptr>;
 
+// Satisfied by raw and smart pointers to a (non-const) T
+template <typename Pointer, typename T>
+concept PointerTo = std::movable<Pointer> && requires (const Pointer& pointer) {
+    { *pointer } -> std::same_as<T&>;
+    { std::to_address(pointer) } -> std::same_as<T*>;
+};
+
 #endif // CONCEPTS_H
@@ -0,0 +1,156 @@
+#ifndef CONTAINERSTATS_H
+#define CONTAINERSTATS_H
+
+#include <vector>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+
+namespace util {
+
+/**
+ * @brief Totals for the queries made of a spatial container since its query
+ * stats were last reset. A region is a SpatialMap region or a QuadTree quad.
+ * Items are only counted as tested where a query filters them, e.g.
+ * SpatialMap::ItemsCollidingWith, or QuadTree::ForEachItem's itemFilter.
+ *
+ * Only gathered when UTILITY_CONTAINER_STATS is defined, otherwise every total
+ * is always zero.
+ */
+struct QueryStats {
+    size_t queries = 0;
+    size_t regionsVisited = 0;
+    size_t itemsTested = 0;
+    size_t itemsMatched = 0;
+};
+
+/**
+ * @brief A snapshot of the shape of a spatial container, computed on demand by
+ * walking the container, so costs nothing unless requested.
+ */
+struct ContainerStats {
+    size_t items = 0;
+    // SpatialMap regions, or QuadTree quads including those with children
+    size_t regions = 0;
+    // Regions kept alive while holding no items, for a QuadTree the empty leaves
+    size_t emptyRegions = 0;
+    // The number of levels of regions, always 1 for a SpatialMap
+    size_t depth = 0;
+    // Approximate, the memory held by the container, excluding the items themselves
+    size_t bytesAllocated = 0;
+    // occupancy[OccupancyBucket(n)] is the number of regions, or QuadTree leaves, holding n items
+    std::vector<size_t> occupancy;
+    QueryStats queries;
+
+    /**
+     * Buckets are powers of two, i.e. 0: empty, 1: 1 item, 2: 2-3 items,
+     * 3: 4-7 items, and so on.
+     */
+    static size_t OccupancyBucket(size_t itemCount)
+    {
+        return static_cast<size_t>(std::bit_width(itemCount));
+    }
+
+    void AddRegion(size_t itemCount)
+    {
+        ++regions;
+        items += itemCount;
+        if (itemCount == 0) {
+            ++emptyRegions;
+        }
+        size_t bucket = OccupancyBucket(itemCount);
+        if (occupancy.size() <= bucket) {
+            occupancy.resize(bucket + 1, 0);
+        }
+        ++occupancy[bucket];
+    }
+};
+
+/**
+ * @brief Accumulates the QueryStats of a container. Const queries may run
+ * concurrently, so totals are relaxed atomics, updated through const
+ * functions.
+ *
+ * Unless UTILITY_CONTAINER_STATS is defined this is an empty class whose
+ * functions do nothing, so held as a [[no_unique_address]] member it takes no
+ * space, and its calls compile away entirely.
+ */
+#ifdef UTILITY_CONTAINER_STATS
+class QueryCounters {
+public:
+    QueryCounters() = default;
+    QueryCounters(const QueryCounters& other)
+    {
+        *this = other;
+    }
+
+    QueryCounters& operator=(const QueryCounters& other)
+    {
+        QueryStats stats = other.Get();
+        queries_.store(stats.queries, std::memory_order_relaxed);
+        regionsVisited_.store(stats.regionsVisited, std::memory_order_relaxed);
+        itemsTested_.store(stats.itemsTested, std::memory_order_relaxed);
+        itemsMatched_.store(stats.itemsMatched, std::memory_order_relaxed);
+        return *this;
+    }
+
+    void AddQuery() const
+    {
+        queries_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void AddRegionsVisited(size_t count = 1) const
+    {
+        regionsVisited_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void AddItemTested(bool matched) const
+    {
+        itemsTested_.fetch_add(1, std::memory_order_relaxed);
+        if (matched) {
+            itemsMatched_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void AddItemsTested(size_t tested, size_t matched) const
+    {
+        itemsTested_.fetch_add(tested, std::memory_order_relaxed);
+        itemsMatched_.fetch_add(matched, std::memory_order_relaxed);
+    }
+
+    QueryStats Get() const
+    {
+        return {
+            queries_.load(std::memory_order_relaxed),
+            regionsVisited_.load(std::memory_order_relaxed),
+            itemsTested_.load(std::memory_order_relaxed),
+            itemsMatched_.load(std::memory_order_relaxed),
+        };
+    }
+
+    void Reset()
+    {
+        *this = QueryCounters{};
+    }
+
+private:
+    mutable std::atomic<size_t> queries_ = 0;
+    mutable std::atomic<size_t> regionsVisited_ = 0;
+    mutable std::atomic<size_t> itemsTested_ = 0;
+    mutable std::atomic<size_t> itemsMatched_ = 0;
+};
+#else
+class QueryCounters {
+public:
+    void AddQuery() const {}
+    void AddRegionsVisited(size_t = 1) const {}
+    void AddItemTested(bool) const {}
+    void AddItemsTested(size_t, size_t) const {}
+    QueryStats Get() const { return {}; }
+    void Reset() {}
+};
+#endif
+
+} // namespace util
+
+#endif // CONTAINERSTATS_H
@@ -0,0 +1,273 @@
+#ifndef HIERARCHICALSPATIALMAP_H
+#define HIERARCHICALSPATIALMAP_H
+
+#include "SpatialMap.h"
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <ranges>
+#include <utility>
+#include <cmath>
+#include <concepts>
+#include <stdexcept>
+#include <limits>
+#include <assert.h>
+
+namespace util {
+
+/**
+ * @brief The HierarchicalSpatialMap class holds items of widely varying sizes.
+ *
+ * A single SpatialMap inflates every query by the radius of its largest item,
+ * so a few large items make every query visit more regions. Instead, each item
+ * is placed in one of several levels by the radius of its collide, and each
+ * level is a SpatialMap whose region size and query margin suit the items it
+ * holds. Queries visit every level, each with its own margin.
+ *
+ * Level 0 holds items with a radius up to smallestRadius, in regions of
+ * smallestRegionSize. Both are multiplied by levelRatio for each following
+ * level. Inserting an item larger than the last level's radius adds as many
+ * levels as it needs. An item's radius must not change while it is in the map.
+ *
+ * Each level is an ordinary SpatialMap, available via Level(), for queries
+ * not provided here.
+ */
+template <typename T, template <typename> typename RegionTable = GridRegionTable, RegionLayout Layout = RegionLayout::Pointers, typename ItemPointer = std::shared_ptr<T>>
+    requires SpatialMapCompatible<T> && PointerTo<ItemPointer, T>
+class HierarchicalSpatialMap {
+public:
+    using LevelType = SpatialMap<T, RegionTable, Layout, ItemPointer>;
+
+    HierarchicalSpatialMap(double smallestRadius, double smallestRegionSize, size_t levelCount, double levelRatio = 4.0)
+        : smallestRadius_(smallestRadius)
+        , smallestRegionSize_(smallestRegionSize)
+        , levelRatio_(levelRatio)
+    {
+        assert(levelCount > 0);
+        assert(levelRatio > 1.0);
+        levels_.reserve(levelCount);
+        while (levels_.size() < levelCount) {
+            AddLevel();
+        }
+    }
+
+    size_t LevelCount() const
+    {
+        return levels_.size();
+    }
+
+    LevelType& Level(size_t level)
+    {
+        return *levels_.at(level);
+    }
+
+    const LevelType& Level(size_t level) const
+    {
+        return *levels_.at(level);
+    }
+
+    /**
+     * @return The index of the level that holds items of the given radius, or
+     * LevelCount() if the radius is larger than every level supports.
+     */
+    size_t LevelFor(double radius) const
+    {
+        auto iter = std::lower_bound(std::cbegin(levelRadii_), std::cend(levelRadii_), radius);
+        return static_cast<size_t>(iter - std::cbegin(levelRadii_));
+    }
+
+    /**
+     * @return The distance from the item's location to the furthest edge of the
+     * bounding rect of its collide, or infinity if the location or any edge is
+     * not finite (std::max would otherwise skip a NaN).
+     */
+    static double Radius(const T& item)
+    {
+        const Point& location = item.GetLocation();
+        Rect bounds = BoundingRect(item.GetCollide());
+        for (double value : { location.x, location.y, bounds.left, bounds.top, bounds.right, bounds.bottom }) {
+            if (!std::isfinite(value)) {
+                return std::numeric_limits<double>::infinity();
+            }
+        }
+        return std::max({ location.x - bounds.left, bounds.right - location.x, location.y - bounds.top, bounds.bottom - location.y, 0.0 });
+    }
+
+    /**
+     * @throws std::invalid_argument if the item's radius is not finite (see
+     * Radius), as no level could ever hold it.
+     */
+    void Insert(const ItemPointer& item)
+    {
+        LevelOrAdd(Radius(*item)).Insert(item);
+    }
+
+    void Insert(ItemPointer&& item)
+    {
+        LevelType& level = LevelOrAdd(Radius(*item));
+        level.Insert(std::move(item));
+    }
+
+    void Erase(const ItemPointer& item)
+    {
+        size_t level = LevelFor(Radius(*item));
+        if (level < levels_.size()) {
+            levels_[level]->Erase(item);
+        }
+    }
+
+    void Clear()
+    {
+        for (auto& level : levels_) {
+            level->Clear();
+        }
+    }
+
+    void RemoveIf(const std::function<bool(const T& item)>& predicate)
+    {
+        for (auto& level : levels_) {
+            level->RemoveIf(predicate);
+        }
+    }
+
+    void MoveAndRemove()
+    {
+        for (auto& level : levels_) {
+            level->MoveAndRemove();
+        }
+    }
+
+    void MoveAndRemove(ThreadPool& threads)
+    {
+        for (auto& level : levels_) {
+            level->MoveAndRemove(threads);
+        }
+    }
+
+    size_t Size() const
+    {
+        size_t size = 0;
+        for (const auto& level : levels_) {
+            size += level->Size();
+        }
+        return size;
+    }
+
+    /**
+     * Calls action(item) for each item that collides with collider, level by
+     * level, smallest items first.
+     */
+    template <typename ColliderType, typename Action>
+        requires Collidable<ColliderType> && std::invocable<Action&, ItemPointer&>
+    void ForEachItemCollidingWith(const ColliderType& collider, Action&& action)
+    {
+        for (auto& level : levels_) {
+            for (auto& item : level->ItemsCollidingWith(collider)) {
+                action(item);
+            }
+        }
+    }
+
+    template <typename ColliderType, typename Action>
+        requires Collidable<ColliderType> && std::invocable<Action&, const T&>
+    void ForEachItemCollidingWith(const ColliderType& collider, Action&& action) const
+    {
+        for (const auto& level : levels_) {
+            for (const T& item : level->CItemsCollidingWith(collider)) {
+                action(item);
+            }
+        }
+    }
+
+    /**
+     * As SpatialMap::QueryBatch, applied to each level in turn.
+     */
+    template <std::ranges::random_access_range Queries, typename Action>
+        requires Collidable<std::ranges::range_value_t<Queries>>
+              && std::invocable<Action&, size_t, ItemPointer&>
+    void QueryBatch(const Queries& queries, Action&& action)
+    {
+        for (auto& level : levels_) {
+            level->QueryBatch(queries, action);
+        }
+    }
+
+    template <std::ranges::random_access_range Queries, typename Action>
+        requires Collidable<std::ranges::range_value_t<Queries>>
+              && std::invocable<Action&, size_t, const T&>
+    void QueryBatch(const Queries& queries, Action&& action) const
+    {
+        for (const auto& level : levels_) {
+            std::as_const(*level).QueryBatch(queries, action);
+        }
+    }
+
+    /**
+     * Calls action(a, b) once for each pair of distinct items whose collides
+     * collide. Pairs within a level use that level's ForEachCollidingPair, and
+     * each item is queried against the levels of larger items, so that no large
+     * item ever inflates the queries of smaller items.
+     */
+    template <typename Action>
+        requires std::invocable<Action&, ItemPointer&, ItemPointer&>
+    void ForEachCollidingPair(Action&& action)
+    {
+        for (size_t i = 0; i < levels_.size(); ++i) {
+            levels_[i]->ForEachCollidingPair(action);
+            for (auto& a : levels_[i]->Items()) {
+                for (size_t j = i + 1; j < levels_.size(); ++j) {
+                    for (auto& b : levels_[j]->ItemsCollidingWith(a->GetCollide())) {
+                        action(a, b);
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename Action>
+        requires std::invocable<Action&, const T&, const T&>
+    void ForEachCollidingPair(Action&& action) const
+    {
+        for (size_t i = 0; i < levels_.size(); ++i) {
+            std::as_const(*levels_[i]).ForEachCollidingPair(action);
+            for (const T& a : levels_[i]->CItems()) {
+                for (size_t j = i + 1; j < levels_.size(); ++j) {
+                    for (const T& b : levels_[j]->CItemsCollidingWith(a.GetCollide())) {
+                        action(a, b);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    double smallestRadius_;
+    double smallestRegionSize_;
+    double levelRatio_;
+    std::vector<std::unique_ptr<LevelType>> levels_;
+    std::vector<double> levelRadii_;
+
+    void AddLevel()
+    {
+        double scale = std::pow(levelRatio_, static_cast<double>(levels_.size()));
+        levelRadii_.push_back(smallestRadius_ * scale);
+        levels_.push_back(std::make_unique<LevelType>(smallestRadius_ * scale, smallestRegionSize_ * scale));
+    }
+
+    LevelType& LevelOrAdd(double radius)
+    {
+        if (!std::isfinite(radius)) {
+            throw std::invalid_argument("HierarchicalSpatialMap item radius must be finite");
+        }
+        while (levelRadii_.back() < radius) {
+            AddLevel();
+        }
+        return *levels_[LevelFor(radius)];
+    }
+};
+
+} // namespace util
+
+#endif // HIERARCHICALSPATIALMAP_H
@@ -0,0 +1,561 @@
+#ifndef LINEARQUADTREE_H
+#define LINEARQUADTREE_H
+
+#include "QuadTree.h"
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <concepts>
+#include <ranges>
+#include <assert.h>
+
+namespace util {
+
+/**
+ * @brief The LinearQuadTree class is a QuadTree whose quads are held by value
+ * in a single pool and refer to each other by 32-bit index rather than by
+ * pointer. The four children of a quad are always adjacent in the pool, so a
+ * quad only needs the index of its first child, and the blocks of four freed
+ * when quads are merged are reused by later splits.
+ *
+ * Quads do not store their area, it is computed from the root's area while
+ * descending. Traversal uses an explicit stack, and actions and filters are
+ * template parameters rather than std::function, so they can be inlined.
+ *
+ * Splitting, merging and growing follow the same rules as in QuadTree, and for
+ * a square start area the two build the same quads. Quads are split at half
+ * their height, whereas QuadTree splits at half their width in both axes, so
+ * for a start area that is not square the quads differ.
+ */
+template <typename T, typename ItemPointer = std::shared_ptr<T>>
+requires QuadTreeCompatible<T> && PointerTo<ItemPointer, T>
+class LinearQuadTree {
+public:
+    LinearQuadTree(const Rect& startArea, size_t itemCountTarget, size_t itemCountLeeway, double minQuadDiameter)
+        : nodes_(1)
+        , rootRect_(startArea)
+        , rootExpandedCount_(0)
+        , itemCountTarget_(std::max(itemCountTarget, size_t{1}))
+        , itemCountLeeway_(std::min(itemCountTarget, itemCountLeeway))
+        , minQuadDiameter_(minQuadDiameter)
+        , currentlyIterating_(false)
+    {
+    }
+
+    void Insert(ItemPointer item)
+    {
+        if (currentlyIterating_) {
+            entering_.push_back(std::move(item));
+        } else {
+            AddItem(std::move(item));
+            Rebalance();
+        }
+    }
+    /**
+     * Inserts every item before rebalancing once, rather than after each item.
+     */
+    template <std::ranges::input_range Items>
+        requires std::constructible_from<ItemPointer, std::ranges::range_reference_t<Items>>
+    void BulkInsert(Items&& items)
+    {
+        for (auto&& item : items) {
+            if (currentlyIterating_) {
+                entering_.emplace_back(std::forward<decltype(item)>(item));
+            } else {
+                AddItem(ItemPointer(std::forward<decltype(item)>(item)));
+            }
+        }
+        if (!currentlyIterating_) {
+            Rebalance();
+        }
+    }
+    void Clear()
+    {
+        assert(!currentlyIterating_);
+        nodes_.assign(1, Node{});
+        freeBlocks_.clear();
+        entering_.clear();
+    }
+    template <typename Predicate>
+        requires std::predicate<Predicate&, const T&>
+    void RemoveIf(Predicate&& predicate)
+    {
+        assert(!currentlyIterating_);
+        VisitNodes(*this, [&](Node& node, uint32_t index, const Rect&)
+        {
+            if (std::erase_if(node.items_, [&](const ItemPointer& item) { return predicate(*item); }) > 0) {
+                MarkDirty(index);
+            }
+        }, AcceptAll{});
+
+        Rebalance();
+    }
+
+    /**
+     * Calls action(area) for each quad, parents before children, skipping any
+     * quad for which quadFilter(area) returns false, along with its children.
+     */
+    template <typename Action, typename QuadFilter = AcceptAll>
+        requires std::invocable<Action&, const Rect&> && std::predicate<QuadFilter&, const Rect&>
+    void ForEachQuad(Action&& action, QuadFilter&& quadFilter = {}) const
+    {
+        VisitNodes(*this, [&](const Node&, uint32_t, const Rect& rect)
+        {
+            action(rect);
+        }, quadFilter);
+    }
+
+    /**
+     * @brief Calls action(item) for each item that passes itemFilter, within
+     * the quads that pass quadFilter, in an unspecified order. Equivalent to
+     * QuadTree::ForEachItem(const ConstQuadTreeIterator&).
+     */
+    template <typename Action, typename QuadFilter = AcceptAll, typename ItemFilter = AcceptAll>
+        requires std::invocable<Action&, const T&>
+              && std::predicate<QuadFilter&, const Rect&>
+              && std::predicate<ItemFilter&, const T&>
+    void ForEachItem(Action&& action, QuadFilter&& quadFilter = {}, ItemFilter&& itemFilter = {}) const
+    {
+        VisitNodes(*this, [&](const Node& node, uint32_t, const Rect&)
+        {
+            for (const auto& item : node.items_) {
+                const T& value = *item;
+                if (itemFilter(value)) {
+                    action(value);
+                }
+            }
+        }, quadFilter);
+    }
+
+    /**
+     * @brief Calls action(item) for each item that passes itemFilter, within
+     * the quads that pass quadFilter, after which items that have moved are
+     * rehomed, items for which removeItemPredicate(item) returns true are
+     * removed, and the tree is rebalanced. Equivalent to
+     * QuadTree::ForEachItem(const QuadTreeIterator&), including the deferral
+     * of items inserted or rehomed mid iteration until the outermost call ends.
+     */
+    template <typename Action, typename QuadFilter = AcceptAll, typename ItemFilter = AcceptAll, typename RemovePredicate = RejectAll>
+        requires std::invocable<Action&, const ItemPointer&>
+              && std::predicate<QuadFilter&, const Rect&>
+              && std::predicate<ItemFilter&, const T&>
+              && std::predicate<RemovePredicate&, const T&>
+    void ForEachItem(Action&& action, QuadFilter&& quadFilter = {}, ItemFilter&& itemFilter = {}, RemovePredicate&& removeItemPredicate = {})
+    {
+        bool wasIteratingAlready = currentlyIterating_;
+        currentlyIterating_ = true;
+
+        VisitNodes(*this, [&](Node& node, uint32_t, const Rect&)
+        {
+            for (const auto& item : node.items_) {
+                if (itemFilter(*item)) {
+                    action(item);
+                }
+            }
+        }, quadFilter);
+
+        // Let the very first non-const iteration deal with all of the re-balancing
+        if (!wasIteratingAlready) {
+            currentlyIterating_ = false;
+
+            std::vector<ItemPointer> rehome = std::move(entering_);
+            entering_.clear();
+
+            VisitNodes(*this, [&](Node& node, uint32_t index, const Rect& rect)
+            {
+                size_t count = node.items_.size();
+                auto kept = std::begin(node.items_);
+                for (auto& item : node.items_) {
+                    if (removeItemPredicate(*item)) {
+                        continue;
+                    }
+                    if (!Contains(rect, item->GetLocation())) {
+                        rehome.push_back(std::move(item));
+                        continue;
+                    }
+                    if (&*kept != &item) {
+                        *kept = std::move(item);
+                    }
+                    ++kept;
+                }
+                node.items_.erase(kept, std::end(node.items_));
+                if (node.items_.size() != count) {
+                    MarkDirty(index);
+                }
+            }, AcceptAll{});
+
+            for (auto& item : rehome) {
+                AddItem(std::move(item));
+            }
+            Rebalance();
+        }
+    }
+
+    void SetItemCountTarget(unsigned target)
+    {
+        itemCountTarget_ = target;
+    }
+    void SetItemCountLeeway(unsigned leeway)
+    {
+        itemCountLeeway_ = leeway;
+    }
+
+    unsigned GetItemCountTarget() const
+    {
+        return itemCountTarget_;
+    }
+    unsigned GetItemCountLeeway() const
+    {
+        return itemCountLeeway_;
+    }
+    size_t Size() const
+    {
+        size_t size = 0;
+        for (const Node& node : nodes_) {
+            size += node.items_.size();
+        }
+        return size;
+    }
+    /**
+     * @return The number of quads in the tree, including the root.
+     */
+    size_t QuadCount() const
+    {
+        return nodes_.size() - (freeBlocks_.size() * 4);
+    }
+
+    /**
+     * @brief Validate Used primarily for testing this container.
+     */
+    bool Validate() const
+    {
+        bool valid = true;
+
+        // For easy breakpoint setting for debugging!
+        auto Require = [&](bool val)
+        {
+            if (!val) {
+                valid = false;
+            }
+        };
+
+        Require(!currentlyIterating_);
+        Require(entering_.empty());
+        Require(nodes_.front().parent_ == NO_QUAD);
+
+        size_t reachable = 0;
+        VisitNodes(*this, [&](const Node& node, uint32_t index, const Rect& rect)
+        {
+            ++reachable;
+
+            // Rect isn't too small
+            double minDiameter = std::min(rect.right - rect.left, rect.bottom - rect.top);
+            Require(minDiameter >= minQuadDiameter_);
+
+            if (!node.IsLeaf()) {
+                // No items in quad containing chldren
+                Require(node.items_.empty());
+
+                // Having children implies at least one item stored within
+                size_t count = 0;
+                VisitNodes(*this, [&](const Node& descendant, uint32_t, const Rect&)
+                {
+                    count += descendant.items_.size();
+                }, AcceptAll{}, index, rect);
+                Require(count > 0);
+
+                // Children are within the pool and point at their parent
+                Require(node.firstChild_ + 4 <= nodes_.size());
+                for (uint32_t child = 0; child < 4 && node.firstChild_ + child < nodes_.size(); ++child) {
+                    Require(nodes_[node.firstChild_ + child].parent_ == index);
+                }
+            } else {
+                // All items should be within the bounds of the quad
+                for (const auto& item : node.items_) {
+                    Require(Contains(rect, item->GetLocation()));
+                }
+            }
+        }, AcceptAll{});
+
+        // Every quad is either in the tree or in a free block
+        Require(reachable + (freeBlocks_.size() * 4) == nodes_.size());
+        for (uint32_t first : freeBlocks_) {
+            for (uint32_t child = 0; child < 4; ++child) {
+                Require(nodes_[first + child].IsLeaf() && nodes_[first + child].items_.empty());
+            }
+        }
+
+        return valid;
+    }
+
+private:
+    static constexpr uint32_t NO_QUAD = std::numeric_limits<uint32_t>::max();
+
+    struct Node {
+        std::vector<ItemPointer> items_;
+        // The four children are always adjacent, starting at firstChild_
+        uint32_t firstChild_ = NO_QUAD;
+        uint32_t parent_ = NO_QUAD;
+        // Set if this quad, or any of its descendants, has gained or lost items since the last Rebalance
+        bool dirty_ = false;
+
+        bool IsLeaf() const
+        {
+            return firstChild_ == NO_QUAD;
+        }
+    };
+
+    // The root is always nodes_[0]
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> freeBlocks_;
+    std::vector<ItemPointer> entering_;
+    Rect rootRect_;
+    unsigned rootExpandedCount_;
+    size_t itemCountTarget_;
+    size_t itemCountLeeway_;
+    double minQuadDiameter_;
+    bool currentlyIterating_;
+
+    /**
+     * Calls visitor(node, index, area) for each quad from start downwards,
+     * parents before children, in the same order as QuadTree. Static so that
+     * the constness of the nodes follows that of self.
+     */
+    template <typename Self, typename Visitor, typename QuadFilter>
+    static void VisitNodes(Self& self, Visitor&& visitor, QuadFilter&& quadFilter, uint32_t start = 0, std::optional<Rect> startRect = std::nullopt)
+    {
+        struct Pending {
+            uint32_t index;
+            Rect rect;
+        };
+        std::vector<Pending> stack;
+        stack.reserve(32);
+        stack.push_back({ start, startRect.value_or(self.rootRect_) });
+
+        while (!stack.empty()) {
+            Pending pending = stack.back();
+            stack.pop_back();
+            if (!quadFilter(std::as_const(pending.rect))) {
+                continue;
+            }
+
+            auto& node = self.nodes_[pending.index];
+            visitor(node, pending.index, std::as_const(pending.rect));
+            if (!node.IsLeaf()) {
+                // Pushed in reverse so that the first child is visited first
+                for (uint32_t child = 4; child-- > 0;) {
+                    stack.push_back({ node.firstChild_ + child, ChildRect(pending.rect, child) });
+                }
+            }
+        }
+    }
+
+    void AddItem(ItemPointer&& item)
+    {
+        const Point& location = item->GetLocation();
+        while (!Contains(rootRect_, location)) {
+            ExpandRoot();
+        }
+
+        uint32_t index = 0;
+        Rect rect = rootRect_;
+        while (!nodes_[index].IsLeaf()) {
+            size_t child = SubQuadIndex(rect, location);
+            index = nodes_[index].firstChild_ + static_cast<uint32_t>(child);
+            rect = ChildRect(rect, child);
+        }
+        nodes_[index].items_.push_back(std::move(item));
+        MarkDirty(index);
+    }
+    void MarkDirty(uint32_t index)
+    {
+        // Ancestors of a dirty quad are always dirty, so stop at the first one found
+        while (index != NO_QUAD && !nodes_[index].dirty_) {
+            nodes_[index].dirty_ = true;
+            index = nodes_[index].parent_;
+        }
+    }
+
+    /**
+     * Only visits dirty quads, i.e. those whose item counts have changed since
+     * the last call, and their ancestors.
+     */
+    void Rebalance()
+    {
+        assert(!currentlyIterating_);
+
+        if (nodes_.front().dirty_) {
+            RecursiveRebalance(0, rootRect_);
+        }
+
+        ContractRoot();
+    }
+    void RecursiveRebalance(uint32_t index, const Rect& rect)
+    {
+        // Splitting may reallocate nodes_, so nodes are always accessed by index here
+        nodes_[index].dirty_ = false;
+        if (!nodes_[index].IsLeaf()) {
+            uint32_t first = nodes_[index].firstChild_;
+            bool contract = true;
+            size_t count = 0;
+            for (uint32_t child = 0; child < 4; ++child) {
+                if (nodes_[first + child].dirty_) {
+                    RecursiveRebalance(first + child, ChildRect(rect, child));
+                }
+                contract = contract && nodes_[first + child].IsLeaf();
+                count += nodes_[first + child].items_.size();
+            }
+            if (contract && (count == 0 || count < itemCountTarget_ - itemCountLeeway_)) {
+                // Become a leaf quad if children contain too few entities
+                Merge(index);
+            }
+        } else if (rect.right - rect.left >= minQuadDiameter_ * 2.0 && nodes_[index].items_.size() > itemCountTarget_ + itemCountLeeway_) {
+            // Lose leaf quad status if contains too many children UNLESS the new quads would be below the minimum size!
+            Split(index, rect);
+            uint32_t first = nodes_[index].firstChild_;
+            for (uint32_t child = 0; child < 4; ++child) {
+                RecursiveRebalance(first + child, ChildRect(rect, child));
+            }
+        }
+    }
+    void Split(uint32_t index, const Rect& rect)
+    {
+        uint32_t first = AllocateBlock();
+        std::vector<ItemPointer> itemsToRehome;
+        itemsToRehome.swap(nodes_[index].items_);
+        nodes_[index].firstChild_ = first;
+        for (uint32_t child = 0; child < 4; ++child) {
+            nodes_[first + child].parent_ = index;
+        }
+        for (auto& item : itemsToRehome) {
+            nodes_[first + SubQuadIndex(rect, item->GetLocation())].items_.push_back(std::move(item));
+        }
+    }
+    void Merge(uint32_t index)
+    {
+        uint32_t first = nodes_[index].firstChild_;
+        std::vector<ItemPointer>& items = nodes_[index].items_;
+        for (uint32_t child = 0; child < 4; ++child) {
+            std::vector<ItemPointer>& childItems = nodes_[first + child].items_;
+            std::move(std::begin(childItems), std::end(childItems), std::back_inserter(items));
+        }
+        nodes_[index].firstChild_ = NO_QUAD;
+        FreeBlock(first);
+    }
+    uint32_t AllocateBlock()
+    {
+        if (!freeBlocks_.empty()) {
+            uint32_t first = freeBlocks_.back();
+            freeBlocks_.pop_back();
+            return first;
+        }
+        assert(nodes_.size() <= NO_QUAD - 4);
+        uint32_t first = static_cast<uint32_t>(nodes_.size());
+        nodes_.resize(nodes_.size() + 4);
+        return first;
+    }
+    void FreeBlock(uint32_t first)
+    {
+        for (uint32_t child = 0; child < 4; ++child) {
+            Node& node = nodes_[first + child];
+            // Cleared rather than replaced so that the item storage is reused
+            node.items_.clear();
+            node.firstChild_ = NO_QUAD;
+            node.parent_ = NO_QUAD;
+            node.dirty_ = false;
+        }
+        freeBlocks_.push_back(first);
+    }
+    void AdoptChildren(uint32_t index)
+    {
+        if (!nodes_[index].IsLeaf()) {
+            for (uint32_t child = 0; child < 4; ++child) {
+                nodes_[nodes_[index].firstChild_ + child].parent_ = index;
+            }
+        }
+    }
+
+    void ExpandRoot()
+    {
+        bool expandOutwards = rootExpandedCount_++ % 2 == 0;
+        double width = rootRect_.right - rootRect_.left;
+        double height = rootRect_.bottom - rootRect_.top;
+        rootRect_ = {
+            rootRect_.left - (expandOutwards ? 0.0 : width),
+            rootRect_.top - (expandOutwards ? 0.0 : height),
+            rootRect_.right + (expandOutwards ? width : 0.0),
+            rootRect_.bottom + (expandOutwards ? height : 0.0)
+        };
+
+        // The root must stay at index 0, so the old root moves into the new block
+        uint32_t first = AllocateBlock();
+        uint32_t oldRoot = first + (expandOutwards ? 0 : 3);
+        nodes_[oldRoot] = std::move(nodes_.front());
+        AdoptChildren(oldRoot);
+        nodes_.front() = Node{};
+        nodes_.front().firstChild_ = first;
+        AdoptChildren(0);
+        // The old root may itself be an expansion with no items, to be contracted in the next Rebalance
+        nodes_[oldRoot].dirty_ = true;
+        nodes_.front().dirty_ = true;
+    }
+    void ContractRoot()
+    {
+        if (!nodes_.front().IsLeaf()) {
+            uint32_t first = nodes_.front().firstChild_;
+            unsigned count = 0;
+            uint32_t quadWithItems = 0;
+            for (uint32_t child = 0; child < 4; ++child) {
+                const Node& node = nodes_[first + child];
+                if (!node.items_.empty() || !node.IsLeaf()) {
+                    ++count;
+                    quadWithItems = child;
+                }
+            }
+            if (count == 1) {
+                rootRect_ = ChildRect(rootRect_, quadWithItems);
+                nodes_.front() = std::move(nodes_[first + quadWithItems]);
+                nodes_.front().parent_ = NO_QUAD;
+                AdoptChildren(0);
+                FreeBlock(first);
+                --rootExpandedCount_;
+            }
+        }
+    }
+
+    static Rect ChildRect(const Rect& rect, size_t child)
+    {
+        double midX = rect.left + ((rect.right - rect.left) / 2.0);
+        double midY = rect.top + ((rect.bottom - rect.top) / 2.0);
+        switch (child) {
+        case 0:
+            return { rect.left, rect.top, midX      , midY        };
+        case 1:
+            return { midX     , rect.top, rect.right, midY        };
+        case 2:
+            return { rect.left, midY    , midX      , rect.bottom };
+        default:
+            return { midX     , midY    , rect.right, rect.bottom };
+        }
+    }
+
+    static size_t SubQuadIndex(const Rect& rect, const Point& p)
+    {
+        //  ___
+        // |0|1| Sub-Quad indices
+        // |2|3|
+        //  ---
+        size_t lr = static_cast<size_t>(((p.x - rect.left) / (rect.right - rect.left)) + 0.5);
+        size_t tb = static_cast<size_t>(((p.y - rect.top) / (rect.bottom - rect.top)) + 0.5) * 2;
+        return lr + tb;
+    }
+};
+
+} // namespace util
+
+#endif // LINEARQUADTREE_H
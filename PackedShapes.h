@@ -0,0 +1,140 @@
+#ifndef PACKEDSHAPES_H
+#define PACKEDSHAPES_H
+
+#include "Shape.h"
+
+#include <array>
+#include <vector>
+#include <span>
+#include <bit>
+#include <type_traits>
+#include <assert.h>
+
+namespace util {
+
+template <typename Shape>
+concept Packable = Collidable<Shape>
+                && std::is_trivially_copyable_v<Shape>
+                && sizeof(Shape) % sizeof(typename ShapeTraits<Shape>::ScalarType) == 0
+                && alignof(Shape) == alignof(typename ShapeTraits<Shape>::ScalarType);
+
+/**
+ * @brief The PackedShapes class stores shapes as a structure of arrays, with one
+ * contiguous array of scalars per member of the shape, in declaration order.
+ * e.g. for a Circle, component 0 contains every x, 1 every y and 2 every radius.
+ *
+ * This allows tests against many shapes to touch only packed scalars, rather
+ * than following a pointer per shape. Shapes of a narrower scalar type, e.g.
+ * BasicCircle<float>, fit twice as many to a cache line as their double
+ * equivalents.
+ */
+template <typename Shape>
+    requires Packable<Shape>
+class PackedShapes {
+public:
+    using Scalar = typename ShapeTraits<Shape>::ScalarType;
+    static constexpr size_t COMPONENT_COUNT = sizeof(Shape) / sizeof(Scalar);
+    using Components = std::array<Scalar, COMPONENT_COUNT>;
+
+    void PushBack(const Shape& shape)
+    {
+        Components values = std::bit_cast<Components>(shape);
+        for (size_t i = 0; i < COMPONENT_COUNT; ++i) {
+            components_[i].push_back(values[i]);
+        }
+    }
+
+    void Set(size_t index, const Shape& shape)
+    {
+        assert(index < Size());
+        Components values = std::bit_cast<Components>(shape);
+        for (size_t i = 0; i < COMPONENT_COUNT; ++i) {
+            components_[i][index] = values[i];
+        }
+    }
+
+    Shape Get(size_t index) const
+    {
+        assert(index < Size());
+        Components values;
+        for (size_t i = 0; i < COMPONENT_COUNT; ++i) {
+            values[i] = components_[i][index];
+        }
+        return std::bit_cast<Shape>(values);
+    }
+
+    /**
+     * Overwrites the shape at index "to" with the shape at index "from".
+     */
+    void Copy(size_t from, size_t to)
+    {
+        for (auto& component : components_) {
+            component[to] = component[from];
+        }
+    }
+
+    void Resize(size_t size)
+    {
+        for (auto& component : components_) {
+            component.resize(size);
+        }
+    }
+
+    void Reserve(size_t size)
+    {
+        for (auto& component : components_) {
+            component.reserve(size);
+        }
+    }
+
+    void Clear()
+    {
+        for (auto& component : components_) {
+            component.clear();
+        }
+    }
+
+    size_t Size() const
+    {
+        return components_[0].size();
+    }
+
+    size_t BytesAllocated() const
+    {
+        return components_[0].capacity() * sizeof(Scalar) * COMPONENT_COUNT;
+    }
+
+    std::span<const Scalar> Component(size_t component) const
+    {
+        return components_.at(component);
+    }
+
+    /**
+     * Sets out[i] to 1 if the collider collides with the i'th shape, else 0. Uses
+     * the batch functions from Shape.h where they exist for the pair of shapes,
+     * which are only implemented for double precision shapes.
+     */
+    template <typename Collider>
+    void CollidesWith(const Collider& collider, std::span<uint8_t> out) const
+    {
+        assert(out.size() >= Size());
+        if constexpr (std::is_same_v<Collider, Circle> && std::is_same_v<Shape, Circle>) {
+            CollidesMany(collider, components_[0], components_[1], components_[2], out);
+        } else if constexpr (std::is_same_v<Collider, Rect> && std::is_same_v<Shape, Rect>) {
+            CollidesMany(collider, components_[0], components_[1], components_[2], components_[3], out);
+        } else if constexpr (std::is_same_v<Collider, Circle> && std::is_same_v<Shape, Point>) {
+            ContainsMany(collider, components_[0], components_[1], out);
+        } else {
+            for (size_t i = 0; i < Size(); ++i) {
+                out[i] = Collides(collider, Get(i)) ? 1 : 0;
+            }
+        }
+    }
+
+private:
+    std::array<std::vector<Scalar>, COMPONENT_COUNT> components_;
+};
+
+} // end namespace util
+
+#endif // PACKEDSHAPES_H
@@ -2,6 +2,10 @@
 #define QUADTREE_H
 
 #include "Shape.h"
+#include "Concepts.h"
+#include "RegionTable.h"
+#include "ThreadPool.h"
+#include "ContainerStats.h"
 
 #include <vector>
 #include <memory>
@@ -9,24 +13,44 @@
 #include <algorithm>
 #include <cmath>
 #include <concepts>
+#include <ranges>
+#include <utility>
+#include <span>
+#include <limits>
+#include <cstdint>
+#include <mutex>
+#include <optional>
 
 namespace util {
 
 template <typename T>
 concept QuadTreeCompatible = requires (T& t) {
-    { t.GetLocation() } -> std::same_as<const Point&>;
+    { t.GetLocation() } -> std::convertible_to<Point>;
     { t.GetCollide() } -> Collidable;
 };
 
+/**
+ * Default filters for the templated iteration overloads, which unlike an empty
+ * std::function cost nothing once inlined.
+ */
+struct AcceptAll {
+    template <typename Arg>
+    constexpr bool operator()(const Arg&) const { return true; }
+};
+struct RejectAll {
+    template <typename Arg>
+    constexpr bool operator()(const Arg&) const { return false; }
+};
+
 /**
  * @brief Not really an iterator so much as a convinience class encapsulating
  * various iteration options and associated helpers.
  */
-template <typename T>
-requires QuadTreeCompatible<T>
+template <typename T, typename ItemPointer = std::shared_ptr<T>>
+requires QuadTreeCompatible<T> && PointerTo<ItemPointer, T>
 class QuadTreeIterator {
 public:
-    QuadTreeIterator(std::function<void(const std::shared_ptr<T>& item)>&& action)
+    QuadTreeIterator(std::function<void(const ItemPointer& item)>&& action)
         : itemAction_(std::move(action))
         , quadFilter_([](const Rect&){ return true; })
         , itemFilter_([](const T&){ return true; })
@@ -68,7 +92,7 @@ public:
         return *this;
     }
 
-    std::function<void(const std::shared_ptr<T>& item)> itemAction_;
+    std::function<void(const ItemPointer& item)> itemAction_;
     std::function<bool(const Rect& area)> quadFilter_;
     std::function<bool(const T& item)> itemFilter_;
     std::function<bool(const T& item)> removeItemPredicate_;
@@ -123,26 +147,119 @@ public:
     std::function<bool(const T& item)> itemFilter_;
 };
 
-template <typename T>
-requires QuadTreeCompatible<T>
+/**
+ * Items are held by std::shared_ptr by default. Any pointer type can be used
+ * instead, e.g. T* into a SlotMap<T>, to avoid reference counting and separate
+ * allocations. Items removed from a tree that holds non-owning pointers must
+ * then be erased from their owner.
+ *
+ * By default items are held by the leaf quad containing their location, so
+ * quad filters must be padded by the size of the largest item to find every
+ * item whose collide overlaps an area. If a looseness is specified, the tree is
+ * instead a loose quadtree: each quad's loose area is its area scaled about its
+ * centre by the looseness, and items are held by the deepest quad whose area
+ * contains their location and whose loose area contains the bounding rect of
+ * their collide. Quad filters are then passed loose areas, and need no
+ * padding. A looseness of 2 is typical.
+ */
+template <typename T, typename ItemPointer = std::shared_ptr<T>>
+requires QuadTreeCompatible<T> && PointerTo<ItemPointer, T>
 class QuadTree {
 public:
-    using Iter_t = QuadTreeIterator<T>;
+    using Iter_t = QuadTreeIterator<T, ItemPointer>;
     using ConstIter_t = ConstQuadTreeIterator<T>;
 
-    QuadTree(const Rect& startArea, size_t itemCountTarget, size_t itemCountLeeway, double minQuadDiameter)
+    QuadTree(const Rect& startArea, size_t itemCountTarget, size_t itemCountLeeway, double minQuadDiameter, std::optional<double> looseness = std::nullopt)
         : root_(std::make_shared<Quad>(nullptr, startArea))
         , rootExpandedCount_(0)
         , itemCountTarget_(std::max(itemCountTarget, size_t{1}))
         , itemCountLeeway_(std::min(itemCountTarget, itemCountLeeway))
         , minQuadDiameter_(minQuadDiameter)
+        , looseness_(looseness)
+        , parallelTaskItemCount_(256)
         , currentlyIterating_(false)
     {
+        assert(!looseness_ || looseness_.value() >= 1.0);
     }
 
-    void Insert(std::shared_ptr<T> item)
+    /**
+     * @brief Builds a tree holding items in one pass, rather than by repeated
+     * insertion. The tree's area is the smallest square containing every item,
+     * and its quads are exactly those that inserting the items into a tree of
+     * that area would produce.
+     *
+     * Items are sorted along a Z-order curve, so that the items within any quad
+     * are contiguous, and each quad is then built directly from its run of the
+     * sorted items, in O(N log N) overall.
+     */
+    template <std::ranges::input_range Items>
+        requires std::constructible_from<ItemPointer, std::ranges::range_reference_t<Items>>
+    static QuadTree Build(Items&& items, size_t itemCountTarget, size_t itemCountLeeway, double minQuadDiameter)
     {
-        AddItem(*root_, item, false);
+        std::vector<ItemPointer> pointers;
+        if constexpr (std::ranges::sized_range<Items>) {
+            pointers.reserve(std::ranges::size(items));
+        }
+        Point min{ std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+        Point max{ std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+        for (auto&& item : items) {
+            pointers.emplace_back(std::forward<decltype(item)>(item));
+            const Point& location = pointers.back()->GetLocation();
+            min = { std::min(min.x, location.x), std::min(min.y, location.y) };
+            max = { std::max(max.x, location.x), std::max(max.y, location.y) };
+        }
+        if (pointers.empty()) {
+            min = max = { 0.0, 0.0 };
+        }
+
+        double side = std::max({ max.x - min.x, max.y - min.y, minQuadDiameter }) * (1.0 + 1e-9);
+        // Rects exclude their right and bottom edges, so the furthest items need a little room
+        while (min.x + side <= max.x || min.y + side <= max.y) {
+            side *= 2.0;
+        }
+        QuadTree tree(Rect{ min.x, min.y, min.x + side, min.y + side }, itemCountTarget, itemCountLeeway, minQuadDiameter);
+
+        // Codes are sorted alongside indices, rather than items, as they are cheaper to move
+        constexpr double cells = static_cast<double>(std::numeric_limits<uint32_t>::max()) + 1.0;
+        std::vector<BuildEntry> entries;
+        entries.reserve(pointers.size());
+        for (size_t index = 0; index < pointers.size(); ++index) {
+            const Point& location = pointers[index]->GetLocation();
+            auto x = static_cast<uint32_t>(std::min(((location.x - min.x) / side) * cells, cells - 1.0));
+            auto y = static_cast<uint32_t>(std::min(((location.y - min.y) / side) * cells, cells - 1.0));
+            entries.push_back({ MortonEncode(x, y), index });
+        }
+        std::sort(std::begin(entries), std::end(entries), [](const BuildEntry& a, const BuildEntry& b)
+        {
+            return a.code < b.code;
+        });
+
+        std::vector<ItemPointer> misplaced;
+        tree.BuildQuad(*tree.root_, entries, pointers, 0, misplaced);
+        // Rounding may disagree with QuadAt for items within a hair of a quad's edge
+        for (auto& item : misplaced) {
+            tree.Insert(std::move(item));
+        }
+        return tree;
+    }
+
+    void Insert(ItemPointer item)
+    {
+        AddItem(*root_, std::move(item), false);
+    }
+    /**
+     * Inserts every item before rebalancing once, rather than after each item.
+     */
+    template <std::ranges::input_range Items>
+        requires std::constructible_from<ItemPointer, std::ranges::range_reference_t<Items>>
+    void BulkInsert(Items&& items)
+    {
+        for (auto&& item : items) {
+            AddItem(*root_, ItemPointer(std::forward<decltype(item)>(item)), true);
+        }
+        if (!currentlyIterating_) {
+            Rebalance();
+        }
     }
     void Clear()
     {
@@ -150,26 +267,73 @@ public:
         root_->children_ = std::nullopt;
         root_->items_.clear();
         root_->entering_.clear();
+        root_->dirty_ = false;
     }
     void RemoveIf(const std::function<bool(const T& item)>& predicate)
     {
         assert(!currentlyIterating_);
-        bool requiresRebalance_ = false;
         ForEachQuad(*root_, [&](Quad& quad)
         {
+            size_t count = quad.items_.size();
             quad.items_.erase(std::remove_if(std::begin(quad.items_), std::end(quad.items_), [&](const auto& item) -> bool
             {
                 return predicate(*item);
             }), std::end(quad.items_));
 
-            requiresRebalance_ = requiresRebalance_ || static_cast<size_t>(std::abs(static_cast<int64_t>(itemCountTarget_)) - static_cast<int64_t>(quad.items_.size())) > itemCountLeeway_;
+            if (quad.items_.size() != count) {
+                MarkDirty(quad);
+            }
         });
 
-        if (requiresRebalance_) {
-            Rebalance();
+        Rebalance();
+    }
+
+    /**
+     * @brief Rehomes a single item whose location has changed, without
+     * visiting the rest of the tree, as ForEachItem(const QuadTreeIterator&)
+     * would. The item is found by descending towards previousLocation, and if
+     * it no longer belongs in its quad, it moves up to the nearest quad that
+     * can hold it and back down from there. Only the quads it left and entered
+     * are rebalanced.
+     *
+     * Rebalancing rehomes items by their current location, so every item that
+     * has moved must be relocated before the tree is otherwise changed, e.g.
+     * by relocating another item. Use the overload taking a range of items to
+     * relocate several at once.
+     * @return false if the item was not found, in which case the tree is
+     * unchanged.
+     */
+    bool Relocate(const T& item, const Point& previousLocation)
+    {
+        bool found = RelocateItem(item, previousLocation);
+        Rebalance();
+        return found;
+    }
+    /**
+     * @brief As Relocate, for each of items, where previousLocation(item)
+     * returns the location item was at when it was last inserted or relocated.
+     * Rebalances once, after every item has been rehomed.
+     * @return The number of items found, and therefore relocated.
+     */
+    template <std::ranges::input_range Items, typename PreviousLocation>
+        requires std::convertible_to<decltype(*std::declval<std::ranges::range_reference_t<Items>>()), const T&>
+              && std::invocable<PreviousLocation&, const T&>
+    size_t Relocate(Items&& items, PreviousLocation&& previousLocation)
+    {
+        size_t found = 0;
+        for (auto&& item : items) {
+            const T& value = *item;
+            if (RelocateItem(value, previousLocation(value))) {
+                ++found;
+            }
         }
+        Rebalance();
+        return found;
     }
 
+    /**
+     * Calls action(area) for each quad. Areas are not loosened.
+     */
     void ForEachQuad(const std::function<void(const Rect& area)>& action) const
     {
         ForEachQuad(*root_, [&](const Quad& quad)
@@ -178,9 +342,9 @@ public:
         });
     }
 
-    QuadTreeIterator<T> Iterator(std::function<void(const std::shared_ptr<T>& item)>&& action)
+    QuadTreeIterator<T, ItemPointer> Iterator(std::function<void(const ItemPointer& item)>&& action)
     {
-        return QuadTreeIterator<T>(std::move(action));
+        return QuadTreeIterator<T, ItemPointer>(std::move(action));
     }
 
     ConstQuadTreeIterator<T> ConstIterator(std::function<void(const T& item)>&& action) const
@@ -199,14 +363,112 @@ public:
      */
     void ForEachItem(const ConstQuadTreeIterator<T>& iter) const
     {
+        ForEachItem(iter.itemAction_, iter.quadFilter_, iter.itemFilter_);
+    }
+
+    /**
+     * @brief As ForEachItem(const ConstQuadTreeIterator&), but the action and
+     * filters are template parameters rather than std::function, so that they
+     * can be inlined. Prefer this overload where the call is performance
+     * critical.
+     */
+    template <typename Action, typename QuadFilter = AcceptAll, typename ItemFilter = AcceptAll>
+        requires std::invocable<Action&, const T&>
+              && std::predicate<QuadFilter&, const Rect&>
+              && std::predicate<ItemFilter&, const T&>
+    void ForEachItem(Action&& action, QuadFilter&& quadFilter = {}, ItemFilter&& itemFilter = {}) const
+    {
+        queryCounters_.AddQuery();
         ForEachQuad(*root_, [&](const Quad& quad)
         {
+            queryCounters_.AddRegionsVisited();
             for (const auto& item : quad.items_) {
-                if (iter.itemFilter_(*item)) {
-                    iter.itemAction_(*item);
+                const T& value = *item;
+                bool matched = itemFilter(value);
+                queryCounters_.AddItemTested(matched);
+                if (matched) {
+                    action(value);
                 }
             }
-        }, iter.quadFilter_);
+        }, quadFilter);
+    }
+
+    /**
+     * @brief Calls action(item, distance) for each item whose collide the ray
+     * touches, nearest first, where distance is how far along the ray from
+     * ray.a the item is first touched. Quads are visited front to back, in the
+     * order the ray enters them, skipping those it misses, so with firstHitOnly
+     * the search ends as soon as no unvisited quad could hold a nearer item.
+     * @param quadPadding Items in a tight tree may overhang their quads, so
+     * quads are grown by this much before being tested against the ray, which
+     * should be the radius of the largest item. Unnecessary in a loose tree.
+     */
+    template <typename Action>
+        requires std::invocable<Action&, const T&, double>
+    void RayCast(const Line& ray, Action&& action, bool firstHitOnly = false, double quadPadding = 0.0) const
+    {
+        const double length = GetDistance(ray.a, ray.b);
+
+        // Quads are keyed by where the ray enters them, items by where the ray first touches them
+        struct Candidate {
+            double fraction;
+            const Quad* quad;
+            const ItemPointer* item;
+
+            bool operator>(const Candidate& other) const
+            {
+                return fraction > other.fraction;
+            }
+        };
+        std::vector<Candidate> candidates;
+        // With firstHitOnly, anything further away than the nearest item found so far can be ignored
+        double cutoff = std::numeric_limits<double>::infinity();
+        auto push = [&](const Candidate& candidate)
+        {
+            if (candidate.fraction > cutoff) {
+                return;
+            }
+            if (firstHitOnly && candidate.item) {
+                cutoff = candidate.fraction;
+            }
+            candidates.push_back(candidate);
+            std::push_heap(std::begin(candidates), std::end(candidates), std::greater<>{});
+        };
+        auto pushQuad = [&](const Quad& quad)
+        {
+            if (auto fraction = FirstIntersection(ray, BoundingRect(LooseRect(quad), quadPadding))) {
+                push({ *fraction, &quad, nullptr });
+            }
+        };
+
+        queryCounters_.AddQuery();
+        pushQuad(*root_);
+        while (!candidates.empty()) {
+            std::pop_heap(std::begin(candidates), std::end(candidates), std::greater<>{});
+            Candidate nearest = candidates.back();
+            candidates.pop_back();
+
+            if (nearest.item) {
+                action(std::as_const(**nearest.item), nearest.fraction * length);
+                if (firstHitOnly) {
+                    return;
+                }
+            } else {
+                queryCounters_.AddRegionsVisited();
+                for (const auto& item : nearest.quad->items_) {
+                    auto fraction = FirstIntersection(ray, item->GetCollide());
+                    queryCounters_.AddItemTested(fraction.has_value());
+                    if (fraction) {
+                        push({ *fraction, nullptr, &item });
+                    }
+                }
+                if (nearest.quad->children_.has_value()) {
+                    for (const auto& child : nearest.quad->children_.value()) {
+                        pushQuad(*child);
+                    }
+                }
+            }
+        }
     }
 
     /**
@@ -224,12 +486,16 @@ public:
      * WARNING when using this function you MUST NOT change the result of
      * GetLocation() for any of the items, or the tree will stop working
      */
-    void ForEachItemNoRebalance(const QuadTreeIterator<T>& iter) const
+    void ForEachItemNoRebalance(const QuadTreeIterator<T, ItemPointer>& iter) const
     {
+        queryCounters_.AddQuery();
         ForEachQuad(*root_, [&](const Quad& quad)
         {
+            queryCounters_.AddRegionsVisited();
             for (auto& item : quad.items_) {
-                if (iter.itemFilter_(*item)) {
+                bool matched = iter.itemFilter_(*item);
+                queryCounters_.AddItemTested(matched);
+                if (matched) {
                     iter.itemAction_(item);
                 }
             }
@@ -251,44 +517,138 @@ public:
      * which is equivalent to calling RemoveIf with the same predicate, but
      * wrapped up in a single pass.
      */
-    void ForEachItem(const QuadTreeIterator<T>& iter)
+    void ForEachItem(const QuadTreeIterator<T, ItemPointer>& iter)
+    {
+        ForEachItem(iter.itemAction_, iter.quadFilter_, iter.itemFilter_, iter.removeItemPredicate_);
+    }
+
+    /**
+     * @brief As ForEachItem(const QuadTreeIterator&), but the action, filters
+     * and removeItemPredicate are template parameters rather than
+     * std::function, so that they can be inlined. Prefer this overload where
+     * the call is performance critical.
+     */
+    template <typename Action, typename QuadFilter = AcceptAll, typename ItemFilter = AcceptAll, typename RemovePredicate = RejectAll>
+        requires std::invocable<Action&, const ItemPointer&>
+              && std::predicate<QuadFilter&, const Rect&>
+              && std::predicate<ItemFilter&, const T&>
+              && std::predicate<RemovePredicate&, const T&>
+    void ForEachItem(Action&& action, QuadFilter&& quadFilter = {}, ItemFilter&& itemFilter = {}, RemovePredicate&& removeItemPredicate = {})
     {
         bool wasIteratingAlready = currentlyIterating_;
         currentlyIterating_ = true;
 
+        queryCounters_.AddQuery();
         ForEachQuad(*root_, [&](const Quad& quad)
         {
+            queryCounters_.AddRegionsVisited();
             for (const auto& item : quad.items_) {
-                if (iter.itemFilter_(*item)) {
-                    iter.itemAction_(item);
+                bool matched = itemFilter(*item);
+                queryCounters_.AddItemTested(matched);
+                if (matched) {
+                    action(item);
                 }
             }
-        }, iter.quadFilter_);
+        }, quadFilter);
 
         // Let the very first non-const iteration deal with all of the re-balancing
         if (!wasIteratingAlready) {
             currentlyIterating_ = false;
+            EndIteration(removeItemPredicate);
+        }
+    }
 
-            ForEachQuad(*root_, [&](Quad& quad)
+    /**
+     * @brief As ForEachItem(action, quadFilter, itemFilter), but subtrees are
+     * split between the threads of the pool, so action must be safe to call
+     * concurrently. Subtrees holding no more than ParallelTaskItemCount() items
+     * are each a single task, and tasks are claimed by whichever thread is
+     * free, so that unbalanced trees are still spread evenly.
+     */
+    template <typename Action, typename QuadFilter = AcceptAll, typename ItemFilter = AcceptAll>
+        requires std::invocable<Action&, const T&>
+              && std::predicate<QuadFilter&, const Rect&>
+              && std::predicate<ItemFilter&, const T&>
+    void ForEachItem(ThreadPool& threads, Action&& action, QuadFilter&& quadFilter = {}, ItemFilter&& itemFilter = {}) const
+    {
+        queryCounters_.AddQuery();
+        std::vector<ParallelTask<const Quad>> tasks;
+        CollectTasks<const Quad>(*root_, quadFilter, parallelTaskItemCount_, tasks);
+        threads.ParallelForEach(tasks.size(), [&](size_t task)
+        {
+            RunTask(tasks[task], [&](const Quad& quad)
             {
-                quad.items_.erase(std::remove_if(std::begin(quad.items_), std::end(quad.items_), [&](const auto& item) -> bool
-                {
-                    bool removeFromTree = iter.removeItemPredicate_(*item);
-                    bool removeFromQuad = !Contains(quad.rect_, item->GetLocation());
-
-                    if (!removeFromTree && removeFromQuad) {
-                        AddItem(quad, item, true);
+                queryCounters_.AddRegionsVisited();
+                for (const auto& item : quad.items_) {
+                    const T& value = *item;
+                    bool matched = itemFilter(value);
+                    queryCounters_.AddItemTested(matched);
+                    if (matched) {
+                        action(value);
                     }
+                }
+            }, quadFilter);
+        });
+    }
 
-                    return removeFromTree || removeFromQuad;
-                }), std::end(quad.items_));
+    /**
+     * @brief As ForEachItem(action, quadFilter, itemFilter, removeItemPredicate),
+     * but subtrees are split between the threads of the pool, as for the const
+     * overload. Each item is only passed to one thread, so actions may change
+     * the item they are given, and may call Insert(), but may not call any
+     * other non-const function. Moved, removed and inserted items are dealt
+     * with, and the tree rebalanced, once every thread has finished, exactly
+     * as for the serial overload.
+     */
+    template <typename Action, typename QuadFilter = AcceptAll, typename ItemFilter = AcceptAll, typename RemovePredicate = RejectAll>
+        requires std::invocable<Action&, const ItemPointer&>
+              && std::predicate<QuadFilter&, const Rect&>
+              && std::predicate<ItemFilter&, const T&>
+              && std::predicate<RemovePredicate&, const T&>
+    void ForEachItem(ThreadPool& threads, Action&& action, QuadFilter&& quadFilter = {}, ItemFilter&& itemFilter = {}, RemovePredicate&& removeItemPredicate = {})
+    {
+        assert(!currentlyIterating_ && "Parallel iteration cannot be nested");
+        currentlyIterating_ = true;
+        staged_ = std::make_unique<Staged>();
 
-                std::move(std::begin(quad.entering_), std::end(quad.entering_), std::back_inserter(quad.items_));
-                quad.entering_.clear();
-            });
+        queryCounters_.AddQuery();
+        std::vector<ParallelTask<Quad>> tasks;
+        CollectTasks<Quad>(*root_, quadFilter, parallelTaskItemCount_, tasks);
+        threads.ParallelForEach(tasks.size(), [&](size_t task)
+        {
+            RunTask(tasks[task], [&](const Quad& quad)
+            {
+                queryCounters_.AddRegionsVisited();
+                for (const auto& item : quad.items_) {
+                    bool matched = itemFilter(*item);
+                    queryCounters_.AddItemTested(matched);
+                    if (matched) {
+                        action(item);
+                    }
+                }
+            }, quadFilter);
+        });
 
-            Rebalance();
+        // Items inserted by the actions enter the tree as they would have mid serial iteration
+        std::unique_ptr<Staged> staged = std::move(staged_);
+        for (auto& item : staged->items_) {
+            AddItem(*root_, std::move(item), true);
         }
+        currentlyIterating_ = false;
+        EndIteration(removeItemPredicate);
+    }
+
+    /**
+     * Subtrees holding no more than count items are iterated as a single task
+     * by the ThreadPool overloads of ForEachItem.
+     */
+    void SetParallelTaskItemCount(size_t count)
+    {
+        parallelTaskItemCount_ = count;
+    }
+    size_t GetParallelTaskItemCount() const
+    {
+        return parallelTaskItemCount_;
     }
 
     void SetItemCountTarget(unsigned target)
@@ -313,6 +673,24 @@ public:
         return RecursiveItemCount(*root_);
     }
 
+    /**
+     * @brief Walks the tree to report its shape and memory use, along with the
+     * totals of any queries made since ResetQueryStats, which are only gathered
+     * when UTILITY_CONTAINER_STATS is defined. The occupancy histogram only
+     * counts leaf quads.
+     */
+    ContainerStats GetStats() const
+    {
+        ContainerStats stats;
+        RecursiveStats(*root_, 1, stats);
+        stats.queries = queryCounters_.Get();
+        return stats;
+    }
+    void ResetQueryStats()
+    {
+        queryCounters_.Reset();
+    }
+
     /**
      * @brief Validate Used primarily for testing this container.
      */
@@ -343,9 +721,14 @@ public:
                 Require((quad.parent_ == nullptr));
             }
 
+            // Every item is held by the quad it belongs in
+            for (const auto& item : quad.items_) {
+                Require(BelongsIn(quad, *item));
+            }
+
             if (quad.children_.has_value()) {
-                // No items in quad containing chldren
-                Require(quad.items_.empty());
+                // No items in quad containing chldren, unless they are too large for the children of a loose tree
+                Require(looseness_ || quad.items_.empty());
                 Require(quad.entering_.empty());
 
                 // Having children implies at least one item stored within
@@ -374,11 +757,6 @@ public:
             } else {
                 // Leaf quad should only have items_ in a const context
                 Require(quad.entering_.empty());
-
-                // All items should be within the bounds of the quad
-                for (const auto& item : quad.items_) {
-                    Require(Contains(quad.rect_, item->GetLocation()));
-                }
             }
         });
 
@@ -391,8 +769,10 @@ private:
         std::optional<std::array<std::shared_ptr<Quad>, 4>> children_;
 
         Rect rect_;
-        std::vector<std::shared_ptr<T>> items_;
-        std::vector<std::shared_ptr<T>> entering_;
+        std::vector<ItemPointer> items_;
+        std::vector<ItemPointer> entering_;
+        // Set if this quad, or any of its descendants, has gained or lost items since the last Rebalance
+        bool dirty_;
 
         Quad(Quad* parent, Rect rect)
             : parent_(parent)
@@ -400,6 +780,7 @@ private:
             , rect_(rect)
             , items_{}
             , entering_{}
+            , dirty_(false)
         {
         }
     };
@@ -409,101 +790,288 @@ private:
     size_t itemCountTarget_;
     size_t itemCountLeeway_;
     double minQuadDiameter_;
+    std::optional<double> looseness_;
+    size_t parallelTaskItemCount_;
     bool currentlyIterating_;
 
-    void ForEachQuad(Quad& quad, const std::function<void(Quad& quad)>& action)
+    // Holds items inserted during a parallel iteration, which may be inserted by several threads at once
+    struct Staged {
+        std::mutex mutex_;
+        std::vector<ItemPointer> items_;
+    };
+    std::unique_ptr<Staged> staged_;
+    [[ no_unique_address ]] QueryCounters queryCounters_;
+
+    /**
+     * Rehomes items that have moved, removes items for which removeItemPredicate
+     * returns true, adds items that entered mid iteration, then rebalances.
+     */
+    template <typename RemovePredicate>
+    void EndIteration(RemovePredicate& removeItemPredicate)
     {
-        ForEachQuad(quad, action, [](auto){ return true; });
+        ForEachQuad(*root_, [&](Quad& quad)
+        {
+            // Compacted by hand so that migrating items can be moved rather than copied
+            size_t count = quad.items_.size();
+            auto kept = std::begin(quad.items_);
+            for (auto& item : quad.items_) {
+                bool removeFromTree = removeItemPredicate(std::as_const(*item));
+                bool removeFromQuad = !BelongsIn(quad, *item);
+
+                if (!removeFromTree && removeFromQuad) {
+                    AddItem(quad, std::move(item), true);
+                } else if (!removeFromTree) {
+                    if (&*kept != &item) {
+                        *kept = std::move(item);
+                    }
+                    ++kept;
+                }
+            }
+            quad.items_.erase(kept, std::end(quad.items_));
+
+            std::move(std::begin(quad.entering_), std::end(quad.entering_), std::back_inserter(quad.items_));
+            quad.entering_.clear();
+            if (quad.items_.size() != count) {
+                MarkDirty(quad);
+            }
+        });
+
+        Rebalance();
     }
-    void ForEachQuad(Quad& quad, const std::function<void(Quad& quad)>& action, const std::function<bool(const Rect&)>& filter)
+
+    template <typename QuadType>
+    struct ParallelTask {
+        QuadType* quad_;
+        // Otherwise only the quad's own items, as its children are separate tasks
+        bool subtree_;
+    };
+
+    /**
+     * Divides the quads passing quadFilter into subtrees for parallel iteration,
+     * merging sibling subtrees into their parent while it holds no more than
+     * maxItems items.
+     * @return The number of items in and beneath quad.
+     */
+    template <typename QuadType, typename QuadFilter>
+    size_t CollectTasks(QuadType& quad, QuadFilter& quadFilter, size_t maxItems, std::vector<ParallelTask<QuadType>>& tasks) const
+    {
+        if (!quad.children_.has_value()) {
+            if (!quad.items_.empty()) {
+                tasks.push_back({ &quad, true });
+            }
+            return quad.items_.size();
+        }
+
+        size_t firstTask = tasks.size();
+        size_t count = quad.items_.size();
+        for (auto& child : quad.children_.value()) {
+            if (quadFilter(LooseRect(*child))) {
+                count += CollectTasks<QuadType>(*child, quadFilter, maxItems, tasks);
+            }
+        }
+        if (count <= maxItems && tasks.size() - firstTask > 1) {
+            tasks.resize(firstTask);
+            tasks.push_back({ &quad, true });
+        } else if (!quad.items_.empty()) {
+            tasks.push_back({ &quad, tasks.size() == firstTask });
+        }
+        return count;
+    }
+    template <typename QuadType, typename Visitor, typename QuadFilter>
+    void RunTask(const ParallelTask<QuadType>& task, Visitor&& visitor, QuadFilter& quadFilter) const
+    {
+        if (task.subtree_) {
+            ForEachQuad(*task.quad_, visitor, quadFilter);
+        } else {
+            visitor(*task.quad_);
+        }
+    }
+
+    template <typename Action, typename Filter = AcceptAll>
+    void ForEachQuad(Quad& quad, Action&& action, Filter&& filter = {})
     {
         action(quad);
         if (quad.children_.has_value()) {
             for (auto& child : quad.children_.value()) {
-                if (filter(child->rect_)) {
+                if (filter(LooseRect(*child))) {
                     ForEachQuad(*child, action, filter);
                 }
             }
         }
     }
-    void ForEachQuad(const Quad& quad, const std::function<void(const Quad& quad)>& action) const
-    {
-        ForEachQuad(quad, action, [](auto){ return true; });
-    }
-    void ForEachQuad(const Quad& quad, const std::function<void(const Quad& quad)>& action, const std::function<bool(const Rect&)>& filter) const
+    template <typename Action, typename Filter = AcceptAll>
+    void ForEachQuad(const Quad& quad, Action&& action, Filter&& filter = {}) const
     {
         action(quad);
         if (quad.children_.has_value()) {
             for (const auto& child : quad.children_.value()) {
-                if (filter(child->rect_)) {
+                if (filter(LooseRect(*child))) {
                     ForEachQuad(*child, action, filter);
                 }
             }
         }
     }
 
-    void AddItem(Quad& startOfSearch, std::shared_ptr<T> item, bool preventRebalance)
+    void AddItem(Quad& startOfSearch, ItemPointer item, bool preventRebalance)
     {
-        if (currentlyIterating_) {
-            QuadAt(startOfSearch, item->GetLocation()).entering_.push_back(item);
+        if (staged_) {
+            std::scoped_lock lock(staged_->mutex_);
+            staged_->items_.push_back(std::move(item));
+        } else if (currentlyIterating_) {
+            QuadAt(startOfSearch, *item).entering_.push_back(std::move(item));
         } else {
-            Quad& targetQuad = QuadAt(startOfSearch, item->GetLocation());
-            targetQuad.items_.push_back(item);
+            Quad& targetQuad = QuadAt(startOfSearch, *item);
+            targetQuad.items_.push_back(std::move(item));
+            MarkDirty(targetQuad);
 
             if (!preventRebalance) {
                 Rebalance();
             }
         }
     }
-    Quad& QuadAt(Quad& startOfSearch, const Point& location)
+    bool RelocateItem(const T& item, const Point& previousLocation)
+    {
+        assert(!currentlyIterating_);
+
+        // Items are held by a quad on the path to the location they were inserted at
+        Quad* quad = root_.get();
+        auto held = std::end(quad->items_);
+        while (true) {
+            held = std::find_if(std::begin(quad->items_), std::end(quad->items_), [&](const ItemPointer& candidate)
+            {
+                return std::to_address(candidate) == &item;
+            });
+            if (held != std::end(quad->items_)) {
+                break;
+            }
+            if (!quad->children_.has_value() || !Contains(quad->rect_, previousLocation)) {
+                return false;
+            }
+            quad = quad->children_.value().at(SubQuadIndex(quad->rect_, previousLocation)).get();
+        }
+
+        if (BelongsIn(*quad, item)) {
+            return true;
+        }
+
+        ItemPointer moving = std::move(*held);
+        quad->items_.erase(held);
+        MarkDirty(*quad);
+
+        Quad* ancestor = quad;
+        while (ancestor->parent_ && !Fits(*ancestor, item)) {
+            ancestor = ancestor->parent_;
+        }
+        AddItem(*ancestor, std::move(moving), true);
+        return true;
+    }
+    void MarkDirty(Quad& quad)
+    {
+        // Ancestors of a dirty quad are always dirty, so stop at the first one found
+        for (Quad* current = &quad; current && !current->dirty_; current = current->parent_) {
+            current->dirty_ = true;
+        }
+    }
+    Quad& QuadAt(Quad& startOfSearch, const T& item)
     {
-        if (!Contains(startOfSearch.rect_, location)) {
+        const Point& location = item.GetLocation();
+        if (!Fits(startOfSearch, item)) {
             if (!startOfSearch.parent_) {
                 ExpandRoot();
             }
-            return QuadAt(*root_, location);
+            return QuadAt(*root_, item);
         } else if (startOfSearch.children_.has_value()) {
-            size_t index = SubQuadIndex(startOfSearch.rect_, location);
-            return QuadAt(*startOfSearch.children_.value().at(index), location);
+            Quad& child = *startOfSearch.children_.value().at(SubQuadIndex(startOfSearch.rect_, location));
+            // In a loose tree, items too large for the child remain here
+            if (looseness_ && !Fits(child, item)) {
+                return startOfSearch;
+            }
+            return QuadAt(child, item);
         } else {
             return startOfSearch;
         }
     }
+    Rect LooseRect(const Quad& quad) const
+    {
+        if (!looseness_) {
+            return quad.rect_;
+        }
+        double margin = (quad.rect_.right - quad.rect_.left) * (looseness_.value() - 1.0) / 2.0;
+        return { quad.rect_.left - margin, quad.rect_.top - margin, quad.rect_.right + margin, quad.rect_.bottom + margin };
+    }
+    /**
+     * @return true if quad, or one of its descendants, can hold item.
+     */
+    bool Fits(const Quad& quad, const T& item) const
+    {
+        return Contains(quad.rect_, item.GetLocation()) && (!looseness_ || Contains(LooseRect(quad), BoundingRect(item.GetCollide())));
+    }
+    /**
+     * @return true if item should be held by quad itself.
+     */
+    bool BelongsIn(const Quad& quad, const T& item) const
+    {
+        if (!Fits(quad, item)) {
+            return false;
+        }
+        if (!quad.children_.has_value()) {
+            return true;
+        }
+        return looseness_ && !Fits(*quad.children_.value().at(SubQuadIndex(quad.rect_, item.GetLocation())), item);
+    }
 
+    /**
+     * Only visits dirty quads, i.e. those whose item counts have changed since
+     * the last call, and their ancestors.
+     */
     void Rebalance()
     {
         assert(!currentlyIterating_);
 
-        std::function<void(Quad& quad)> recursiveRebalance = [&](Quad& quad)
-        {
-            if (quad.children_.has_value()) {
-                bool contract = true;
-                size_t count = 0;
-                for (auto& child : quad.children_.value()) {
-                    recursiveRebalance(*child);
-                    contract = contract && !child->children_.has_value();
-                    count += child->items_.size();
-                }
-                if (contract && (count == 0 || count < itemCountTarget_ - itemCountLeeway_)) {
-                    // Become a leaf quad if children contain too few entities
-                    quad.items_ = RecursiveCollectItems(quad);
-                    quad.children_ = std::nullopt;
-                }
-            } else if (quad.rect_.right - quad.rect_.left >= minQuadDiameter_ * 2.0 && quad.items_.size() > itemCountTarget_ + itemCountLeeway_) {
-                // Lose leaf quad status if contains too many children UNLESS the new quads would be below the minimum size!
-                quad.children_ = CreateChildren(quad);
-                std::vector<std::shared_ptr<T>> itemsToRehome;
-                itemsToRehome.swap(quad.items_);
-                for (auto& item : itemsToRehome) {
-                    QuadAt(quad, item->GetLocation()).items_.push_back(item);
-                }
-            }
-        };
-
-        recursiveRebalance(*root_);
+        if (root_->dirty_) {
+            RecursiveRebalance(*root_);
+        }
 
         ContractRoot();
     }
+    void RecursiveRebalance(Quad& quad)
+    {
+        quad.dirty_ = false;
+        if (quad.children_.has_value()) {
+            bool contract = true;
+            size_t count = 0;
+            for (auto& child : quad.children_.value()) {
+                if (child->dirty_) {
+                    RecursiveRebalance(*child);
+                }
+                contract = contract && !child->children_.has_value();
+                count += child->items_.size();
+            }
+            // Only loose trees hold items in quads with children
+            if (contract && (count == 0 || count + quad.items_.size() < itemCountTarget_ - itemCountLeeway_)) {
+                // Become a leaf quad if children contain too few entities
+                quad.items_ = RecursiveCollectItems(quad);
+                quad.children_ = std::nullopt;
+            }
+        } else if (quad.rect_.right - quad.rect_.left >= minQuadDiameter_ * 2.0 && quad.items_.size() > itemCountTarget_ + itemCountLeeway_) {
+            // Lose leaf quad status if contains too many children UNLESS the new quads would be below the minimum size!
+            quad.children_ = CreateChildren(quad);
+            std::vector<ItemPointer> itemsToRehome;
+            itemsToRehome.swap(quad.items_);
+            for (auto& item : itemsToRehome) {
+                QuadAt(quad, *item).items_.push_back(std::move(item));
+            }
+            if (quad.items_.size() == itemsToRehome.size()) {
+                // No items were small enough for the children of a loose tree
+                quad.children_ = std::nullopt;
+                return;
+            }
+            // The new children may need splitting too, e.g. after a BulkInsert
+            for (auto& child : quad.children_.value()) {
+                RecursiveRebalance(*child);
+            }
+        }
+    }
     size_t RecursiveItemCount(const Quad& quad) const
     {
         size_t count = 0;
@@ -513,15 +1081,66 @@ private:
         });
         return count;
     }
-    std::vector<std::shared_ptr<T>> RecursiveCollectItems(Quad& quad)
+    void RecursiveStats(const Quad& quad, size_t depth, ContainerStats& stats) const
+    {
+        stats.depth = std::max(stats.depth, depth);
+        // Quads are allocated by std::make_shared, alongside a control block of about two pointers
+        stats.bytesAllocated += sizeof(Quad) + (2 * sizeof(void*));
+        stats.bytesAllocated += (quad.items_.capacity() + quad.entering_.capacity()) * sizeof(ItemPointer);
+        if (quad.children_.has_value()) {
+            // Items held by a parent in a loose tree are counted, but not as a region's occupancy
+            ++stats.regions;
+            stats.items += quad.items_.size();
+            for (const auto& child : quad.children_.value()) {
+                RecursiveStats(*child, depth + 1, stats);
+            }
+        } else {
+            stats.AddRegion(quad.items_.size());
+        }
+    }
+    std::vector<ItemPointer> RecursiveCollectItems(Quad& quad)
     {
-        std::vector<std::shared_ptr<T>> collectedItems;
+        std::vector<ItemPointer> collectedItems;
         ForEachQuad(quad, [&](Quad& quad)
         {
             std::move(std::begin(quad.items_), std::end(quad.items_), std::back_inserter(collectedItems));
         });
         return collectedItems;
     }
+    struct BuildEntry {
+        uint64_t code;
+        size_t index;
+    };
+
+    void BuildQuad(Quad& quad, std::span<const BuildEntry> entries, std::vector<ItemPointer>& items, unsigned depth, std::vector<ItemPointer>& misplaced)
+    {
+        // Each level of the tree consumes two bits of the 64 bit codes
+        constexpr unsigned maxDepth = 32;
+        if (depth < maxDepth && quad.rect_.right - quad.rect_.left >= minQuadDiameter_ * 2.0 && entries.size() > itemCountTarget_ + itemCountLeeway_) {
+            quad.children_ = CreateChildren(quad);
+            unsigned shift = 2 * (maxDepth - 1 - depth);
+            auto begin = std::begin(entries);
+            for (uint64_t child = 0; child < 4; ++child) {
+                auto end = std::partition_point(begin, std::end(entries), [&](const BuildEntry& entry)
+                {
+                    return ((entry.code >> shift) & 3) <= child;
+                });
+                BuildQuad(*quad.children_->at(child), { begin, end }, items, depth + 1, misplaced);
+                begin = end;
+            }
+        } else {
+            quad.items_.reserve(entries.size());
+            for (const BuildEntry& entry : entries) {
+                ItemPointer& item = items[entry.index];
+                if (Contains(quad.rect_, item->GetLocation())) {
+                    quad.items_.push_back(std::move(item));
+                } else {
+                    misplaced.push_back(std::move(item));
+                }
+            }
+        }
+    }
+
     std::array<std::shared_ptr<Quad>, 4> CreateChildren(Quad& quad)
     {
         const Rect& parentRect = quad.rect_;
@@ -554,12 +1173,15 @@ private:
 
         root_ = std::make_shared<Quad>(nullptr, newRootRect);
         oldRoot->parent_ = root_.get();
+        // The old root may itself be an expansion with no items, to be contracted in the next Rebalance
+        oldRoot->dirty_ = true;
+        root_->dirty_ = true;
         root_->children_ = CreateChildren(*root_);
         root_->children_->at(expandOutwards ? 0 : 3).swap(oldRoot);
     }
     void ContractRoot()
     {
-        if (root_->children_.has_value()) {
+        if (root_->children_.has_value() && root_->items_.empty()) {
             unsigned count = 0;
             std::shared_ptr<Quad> quadWithItems;
             for (auto& child : root_->children_.value()) {
@@ -0,0 +1,895 @@
+#ifndef REGIONTABLE_H
+#define REGIONTABLE_H
+
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <iterator>
+#include <bit>
+#include <algorithm>
+#include <cstdint>
+#include <assert.h>
+
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#define UTILITY_HAS_BMI2 1
+#endif
+
+namespace util {
+
+/**
+ * Interleaves the bits of x and y, x in the even bits and y in the odd bits,
+ * so that sorting by the result orders points along a Z-order curve, and
+ * points that are close together are usually close in the order.
+ *
+ * BMI2 pdep is used if the compiler targets it (e.g. -mbmi2 or -march=native,
+ * /arch:AVX2 for MSVC). It is not detected at runtime, as a dispatch would cost
+ * more than the portable version.
+ */
+inline uint64_t MortonEncode(uint32_t x, uint32_t y)
+{
+#ifdef UTILITY_HAS_BMI2
+    return _pdep_u64(x, 0x5555555555555555ull) | _pdep_u64(y, 0xAAAAAAAAAAAAAAAAull);
+#else
+    auto spread = [](uint64_t bits) -> uint64_t
+    {
+        bits = (bits | (bits << 16)) & 0x0000FFFF0000FFFFull;
+        bits = (bits | (bits << 8))  & 0x00FF00FF00FF00FFull;
+        bits = (bits | (bits << 4))  & 0x0F0F0F0F0F0F0F0Full;
+        bits = (bits | (bits << 2))  & 0x3333333333333333ull;
+        bits = (bits | (bits << 1))  & 0x5555555555555555ull;
+        return bits;
+    };
+    return spread(x) | (spread(y) << 1);
+#endif
+}
+
+/**
+ * @return The x and y that MortonEncode interleaved to produce code.
+ */
+inline std::pair<uint32_t, uint32_t> MortonDecode(uint64_t code)
+{
+#ifdef UTILITY_HAS_BMI2
+    return { static_cast<uint32_t>(_pext_u64(code, 0x5555555555555555ull)), static_cast<uint32_t>(_pext_u64(code, 0xAAAAAAAAAAAAAAAAull)) };
+#else
+    auto compact = [](uint64_t bits) -> uint32_t
+    {
+        bits &= 0x5555555555555555ull;
+        bits = (bits | (bits >> 1))  & 0x3333333333333333ull;
+        bits = (bits | (bits >> 2))  & 0x0F0F0F0F0F0F0F0Full;
+        bits = (bits | (bits >> 4))  & 0x00FF00FF00FF00FFull;
+        bits = (bits | (bits >> 8))  & 0x0000FFFF0000FFFFull;
+        bits = (bits | (bits >> 16)) & 0x00000000FFFFFFFFull;
+        return static_cast<uint32_t>(bits);
+    };
+    return { compact(code), compact(code >> 1) };
+#endif
+}
+
+/**
+ * @return The Morton code of a region key (see below). Signed coordinates are
+ * offset, so that negative coordinates precede positive ones in either axis.
+ */
+inline uint64_t MortonRegionKey(uint64_t key)
+{
+    uint32_t x = static_cast<uint32_t>(key & 0xFFFFFFFF) ^ 0x80000000u;
+    uint32_t y = static_cast<uint32_t>(key >> 32) ^ 0x80000000u;
+    return MortonEncode(x, y);
+}
+
+/**
+ * Region tables are the storage policies used by SpatialMap to map a region key
+ * to a region. Keys hold the signed x coordinate of the region in the low 32
+ * bits, and the signed y coordinate in the high 32 bits. Any policy must be a
+ * class template taking the region type, and provide the following:
+ *
+ *   iterator / const_iterator, dereferencing to a pair of { key, region }
+ *   Value* Find(uint64_t key) (and a const overload)
+ *   Value& Emplace(uint64_t key, Args&&...) (returns the existing value if present)
+ *   bool Erase(uint64_t key)
+ *   size_t EraseIf(Predicate) (Predicate is invoked with the pair described above)
+ *   void Clear()
+ *   size_t Size() const
+ *   begin(), end(), cbegin() & cend()
+ */
+
+/**
+ * @brief The FlatRegionTable class is an open addressed hash table with a power
+ * of two capacity.
+ *
+ * Entries are placed using robin hood linear probing, which keeps every probe
+ * sequence sorted by distance from its home slot. This allows a failed Find to
+ * stop early, and allows Erase to shift the following entries back into the
+ * hole, so no tombstones are ever required.
+ *
+ * WARNING any call to Emplace, Erase or EraseIf may move existing entries, so
+ * references, pointers and iterators to entries are invalidated.
+ */
+template <typename Value>
+class FlatRegionTable {
+public:
+    using key_type = uint64_t;
+    using mapped_type = Value;
+    using value_type = std::pair<uint64_t, Value>;
+    using size_type = size_t;
+
+    template <bool IsConst>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = std::pair<uint64_t, Value>;
+        using pointer           = std::conditional_t<IsConst, const value_type*, value_type*>;
+        using reference         = std::conditional_t<IsConst, const value_type&, value_type&>;
+        using SlotPointer       = std::conditional_t<IsConst, const std::optional<value_type>*, std::optional<value_type>*>;
+
+        Iterator()
+            : slot_(nullptr)
+            , end_(nullptr)
+        {
+        }
+
+        Iterator(SlotPointer slot, SlotPointer end)
+            : slot_(slot)
+            , end_(end)
+        {
+            SkipEmptySlots();
+        }
+
+        reference operator*() const { return **slot_; }
+        pointer operator->() const { return &**slot_; }
+        Iterator& operator++()
+        {
+            ++slot_;
+            SkipEmptySlots();
+            return *this;
+        }
+        Iterator operator++(int) { Iterator copy = *this; ++(*this); return copy; }
+        friend bool operator== (const Iterator& a, const Iterator& b) { return a.slot_ == b.slot_; };
+        friend bool operator!= (const Iterator& a, const Iterator& b) { return a.slot_ != b.slot_; };
+
+    private:
+        SlotPointer slot_;
+        SlotPointer end_;
+
+        void SkipEmptySlots()
+        {
+            while (slot_ != end_ && !slot_->has_value()) {
+                ++slot_;
+            }
+        }
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatRegionTable()
+        : slots_{}
+        , size_(0)
+        , shift_(64)
+    {
+    }
+
+    iterator begin() { return iterator(slots_.data(), slots_.data() + slots_.size()); }
+    iterator end() { return iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+    const_iterator begin() const { return cbegin(); }
+    const_iterator end() const { return cend(); }
+    const_iterator cbegin() const { return const_iterator(slots_.data(), slots_.data() + slots_.size()); }
+    const_iterator cend() const { return const_iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size()); }
+
+    Value* Find(uint64_t key)
+    {
+        return const_cast<Value*>(std::as_const(*this).Find(key));
+    }
+
+    const Value* Find(uint64_t key) const
+    {
+        if (size_ == 0) {
+            return nullptr;
+        }
+        size_t mask = slots_.size() - 1;
+        size_t index = HomeIndex(key);
+        for (size_t distance = 0; ; ++distance, index = (index + 1) & mask) {
+            const std::optional<value_type>& slot = slots_[index];
+            // Robin hood ordering means our key cannot be further along than a closer-to-home entry
+            if (!slot.has_value() || Distance(slot->first, index) < distance) {
+                return nullptr;
+            } else if (slot->first == key) {
+                return &slot->second;
+            }
+        }
+    }
+
+    bool Contains(uint64_t key) const
+    {
+        return Find(key) != nullptr;
+    }
+
+    /**
+     * Returns the value stored against key, constructing it from args if no such
+     * value exists yet.
+     */
+    template <typename... Args>
+    Value& Emplace(uint64_t key, Args&&... args)
+    {
+        if (Value* existing = Find(key)) {
+            return *existing;
+        }
+        if ((size_ + 1) * 2 > slots_.size()) {
+            Rehash(std::max(slots_.size() * 2, MIN_CAPACITY));
+        }
+        return Place(value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...)));
+    }
+
+    bool Erase(uint64_t key)
+    {
+        if (size_ == 0) {
+            return false;
+        }
+        size_t mask = slots_.size() - 1;
+        size_t index = HomeIndex(key);
+        for (size_t distance = 0; ; ++distance, index = (index + 1) & mask) {
+            const std::optional<value_type>& slot = slots_[index];
+            if (!slot.has_value() || Distance(slot->first, index) < distance) {
+                return false;
+            } else if (slot->first == key) {
+                EraseAt(index);
+                return true;
+            }
+        }
+    }
+
+    /**
+     * Erases every entry for which predicate returns true, each entry is visited
+     * exactly once.
+     */
+    template <typename Predicate>
+    size_t EraseIf(Predicate&& predicate)
+    {
+        if (size_ == 0) {
+            return 0;
+        }
+
+        // Start just after an empty slot, so that no probe sequence wraps past the
+        // start of the sweep. Entries are then only ever shifted back into slots
+        // we are yet to visit, or into the slot we are currently visiting.
+        size_t mask = slots_.size() - 1;
+        size_t start = 0;
+        while (slots_[start].has_value()) {
+            ++start;
+        }
+
+        size_t erased = 0;
+        size_t visited = 0;
+        size_t index = (start + 1) & mask;
+        while (visited < slots_.size()) {
+            std::optional<value_type>& slot = slots_[index];
+            if (slot.has_value() && predicate(*slot)) {
+                EraseAt(index);
+                ++erased;
+                // Revisit this slot as it may now contain a shifted entry
+                continue;
+            }
+            index = (index + 1) & mask;
+            ++visited;
+        }
+        return erased;
+    }
+
+    void Clear()
+    {
+        slots_.clear();
+        size_ = 0;
+        shift_ = 64;
+    }
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+    size_t Capacity() const
+    {
+        return slots_.size();
+    }
+
+    /**
+     * @return The memory held by the table itself, excluding any held by the
+     * values.
+     */
+    size_t BytesAllocated() const
+    {
+        return slots_.capacity() * sizeof(std::optional<value_type>);
+    }
+
+private:
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    std::vector<std::optional<value_type>> slots_;
+    size_t size_;
+    // Used to reduce the 64 bit hash to an index, equal to 64 - log2(capacity)
+    unsigned shift_;
+
+    size_t HomeIndex(uint64_t key) const
+    {
+        // Fibonacci hashing, spreads sequential coordinates evenly over the table
+        return static_cast<size_t>((key * 11400714819323198485ull) >> shift_);
+    }
+
+    size_t Distance(uint64_t key, size_t index) const
+    {
+        return (index - HomeIndex(key)) & (slots_.size() - 1);
+    }
+
+    Value& Place(value_type&& entry)
+    {
+        size_t mask = slots_.size() - 1;
+        size_t index = HomeIndex(entry.first);
+        size_t distance = 0;
+        Value* placed = nullptr;
+
+        while (true) {
+            std::optional<value_type>& slot = slots_[index];
+            if (!slot.has_value()) {
+                slot.emplace(std::move(entry));
+                ++size_;
+                return placed ? *placed : slot->second;
+            }
+
+            size_t residentDistance = Distance(slot->first, index);
+            if (residentDistance < distance) {
+                // Take from the rich and give to the poor, then continue placing the evicted entry
+                std::swap(*slot, entry);
+                distance = residentDistance;
+                if (!placed) {
+                    placed = &slot->second;
+                }
+            }
+
+            index = (index + 1) & mask;
+            ++distance;
+        }
+    }
+
+    void EraseAt(size_t index)
+    {
+        size_t mask = slots_.size() - 1;
+        size_t next = (index + 1) & mask;
+        // Backward shift, each following entry that is not in its home slot moves one closer to home
+        while (slots_[next].has_value() && Distance(slots_[next]->first, next) != 0) {
+            slots_[index] = std::move(slots_[next]);
+            index = next;
+            next = (next + 1) & mask;
+        }
+        slots_[index].reset();
+        --size_;
+    }
+
+    void Rehash(size_t capacity)
+    {
+        assert(std::has_single_bit(capacity));
+        std::vector<std::optional<value_type>> oldSlots(capacity);
+        oldSlots.swap(slots_);
+        shift_ = 64 - static_cast<unsigned>(std::countr_zero(capacity));
+        size_ = 0;
+        for (auto& slot : oldSlots) {
+            if (slot.has_value()) {
+                Place(std::move(*slot));
+            }
+        }
+    }
+};
+
+/**
+ * @brief The GridRegionTable class stores the regions within a bounded area in a
+ * dense row-major grid, so finding them is simple index arithmetic. Regions
+ * outside of the bounds are stored in a FlatRegionTable.
+ *
+ * Without bounds it behaves exactly as a FlatRegionTable. A cell is allocated
+ * for every region within the bounds, so they should be chosen with the region
+ * size in mind.
+ *
+ * WARNING Emplace, Erase and EraseIf may move regions stored outside of the
+ * bounds, but never those stored within the grid.
+ */
+template <typename Value>
+class GridRegionTable {
+public:
+    using key_type = uint64_t;
+    using mapped_type = Value;
+    using value_type = std::pair<uint64_t, Value>;
+    using size_type = size_t;
+
+    template <bool IsConst>
+    class Iterator {
+    public:
+        using CellIterator      = typename FlatRegionTable<Value>::template Iterator<IsConst>;
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type   = std::ptrdiff_t;
+        using value_type        = std::pair<uint64_t, Value>;
+        using pointer           = CellIterator::pointer;
+        using reference         = CellIterator::reference;
+
+        // Iterates the grid first, then the overflow
+        Iterator(CellIterator iter, CellIterator gridEnd, CellIterator overflowBegin)
+            : iter_(iter == gridEnd ? overflowBegin : iter)
+            , gridEnd_(gridEnd)
+            , overflowBegin_(overflowBegin)
+        {
+        }
+
+        reference operator*() const { return *iter_; }
+        pointer operator->() const { return iter_.operator->(); }
+        Iterator& operator++()
+        {
+            if (++iter_ == gridEnd_) {
+                iter_ = overflowBegin_;
+            }
+            return *this;
+        }
+        Iterator operator++(int) { Iterator copy = *this; ++(*this); return copy; }
+        friend bool operator== (const Iterator& a, const Iterator& b) { return a.iter_ == b.iter_; };
+        friend bool operator!= (const Iterator& a, const Iterator& b) { return a.iter_ != b.iter_; };
+
+    private:
+        CellIterator iter_;
+        CellIterator gridEnd_;
+        CellIterator overflowBegin_;
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    GridRegionTable()
+        : cells_{}
+        , cellCount_(0)
+        , minX_(0)
+        , minY_(0)
+        , width_(0)
+        , height_(0)
+        , overflow_{}
+    {
+    }
+
+    iterator begin() { return iterator(CellBegin(), CellEnd(), std::begin(overflow_)); }
+    iterator end() { return iterator(std::end(overflow_), CellEnd(), std::end(overflow_)); }
+    const_iterator begin() const { return cbegin(); }
+    const_iterator end() const { return cend(); }
+    const_iterator cbegin() const { return const_iterator(CellBegin(), CellEnd(), std::cbegin(overflow_)); }
+    const_iterator cend() const { return const_iterator(std::cend(overflow_), CellEnd(), std::cend(overflow_)); }
+
+    /**
+     * Regions with coordinates within the inclusive range [min, max] are stored in
+     * the grid, any existing regions are re-homed.
+     */
+    void SetBounds(int32_t minX, int32_t minY, int32_t maxX, int32_t maxY)
+    {
+        assert(minX <= maxX && minY <= maxY);
+        GridRegionTable rebuilt;
+        rebuilt.minX_ = minX;
+        rebuilt.minY_ = minY;
+        rebuilt.width_ = static_cast<uint64_t>(static_cast<int64_t>(maxX) - minX) + 1;
+        rebuilt.height_ = static_cast<uint64_t>(static_cast<int64_t>(maxY) - minY) + 1;
+        rebuilt.cells_.resize(rebuilt.width_ * rebuilt.height_);
+        for (auto& [ key, value ] : *this) {
+            rebuilt.Emplace(key, std::move(value));
+        }
+        *this = std::move(rebuilt);
+    }
+
+    bool Bounded() const
+    {
+        return !cells_.empty();
+    }
+
+    Value* Find(uint64_t key)
+    {
+        return const_cast<Value*>(std::as_const(*this).Find(key));
+    }
+
+    const Value* Find(uint64_t key) const
+    {
+        if (const std::optional<value_type>* cell = CellAt(key)) {
+            return cell->has_value() ? &(*cell)->second : nullptr;
+        }
+        return overflow_.Find(key);
+    }
+
+    bool Contains(uint64_t key) const
+    {
+        return Find(key) != nullptr;
+    }
+
+    template <typename... Args>
+    Value& Emplace(uint64_t key, Args&&... args)
+    {
+        if (std::optional<value_type>* cell = CellAt(key)) {
+            if (!cell->has_value()) {
+                cell->emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+                ++cellCount_;
+            }
+            return (*cell)->second;
+        }
+        return overflow_.Emplace(key, std::forward<Args>(args)...);
+    }
+
+    bool Erase(uint64_t key)
+    {
+        if (std::optional<value_type>* cell = CellAt(key)) {
+            if (cell->has_value()) {
+                cell->reset();
+                --cellCount_;
+                return true;
+            }
+            return false;
+        }
+        return overflow_.Erase(key);
+    }
+
+    template <typename Predicate>
+    size_t EraseIf(Predicate&& predicate)
+    {
+        size_t erased = 0;
+        if (cellCount_ > 0) {
+            for (auto& cell : cells_) {
+                if (cell.has_value() && predicate(*cell)) {
+                    cell.reset();
+                    ++erased;
+                }
+            }
+            cellCount_ -= erased;
+        }
+        return erased + overflow_.EraseIf(predicate);
+    }
+
+    void Clear()
+    {
+        // Keep the grid allocated, the bounds are unchanged
+        if (cellCount_ > 0) {
+            for (auto& cell : cells_) {
+                cell.reset();
+            }
+            cellCount_ = 0;
+        }
+        overflow_.Clear();
+    }
+
+    size_t Size() const
+    {
+        return cellCount_ + overflow_.Size();
+    }
+
+    size_t BytesAllocated() const
+    {
+        return (cells_.capacity() * sizeof(std::optional<value_type>)) + overflow_.BytesAllocated();
+    }
+
+private:
+    std::vector<std::optional<value_type>> cells_;
+    size_t cellCount_;
+    int64_t minX_;
+    int64_t minY_;
+    uint64_t width_;
+    uint64_t height_;
+    FlatRegionTable<Value> overflow_;
+
+    typename FlatRegionTable<Value>::iterator CellBegin() { return { cells_.data(), cells_.data() + cells_.size() }; }
+    typename FlatRegionTable<Value>::iterator CellEnd() { return { cells_.data() + cells_.size(), cells_.data() + cells_.size() }; }
+    typename FlatRegionTable<Value>::const_iterator CellBegin() const { return { cells_.data(), cells_.data() + cells_.size() }; }
+    typename FlatRegionTable<Value>::const_iterator CellEnd() const { return { cells_.data() + cells_.size(), cells_.data() + cells_.size() }; }
+
+    std::optional<value_type>* CellAt(uint64_t key)
+    {
+        return const_cast<std::optional<value_type>*>(std::as_const(*this).CellAt(key));
+    }
+
+    const std::optional<value_type>* CellAt(uint64_t key) const
+    {
+        // Out of range coordinates wrap around to very large unsigned values
+        uint64_t column = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(key & 0xFFFFFFFF)) - minX_);
+        uint64_t row = static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(key >> 32)) - minY_);
+        if (column < width_ && row < height_) {
+            return &cells_[(row * width_) + column];
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * @brief The SortedRegionTable class keeps its regions in an array sorted by the
+ * Morton code of their key, so iterating over every region visits neighbouring
+ * regions one after another in memory, which suits maps that are swept in full
+ * (e.g. Items()) more often than regions are created.
+ *
+ * Find is a binary search. Regions added since the last merge are held in a
+ * FlatRegionTable and iterated after all of the others. They are sorted and
+ * merged into the array once they number more than a quarter of it, and by
+ * every EraseIf, so a SpatialMap is fully in Morton order after each
+ * MoveAndRemove. Erased regions leave an empty slot in the array, which is
+ * reused if the same region is added again, and removed by the next merge.
+ *
+ * WARNING Emplace, Erase and EraseIf may move existing entries, so references,
+ * pointers and iterators to entries are invalidated.
+ */
+template <typename Value>
+class SortedRegionTable {
+public:
+    using key_type = uint64_t;
+    using mapped_type = Value;
+    using value_type = std::pair<uint64_t, Value>;
+    using size_type = size_t;
+    // Iterates the sorted array, then the recently added regions
+    using iterator = typename GridRegionTable<Value>::iterator;
+    using const_iterator = typename GridRegionTable<Value>::const_iterator;
+
+    SortedRegionTable()
+        : codes_{}
+        , slots_{}
+        , sortedCount_(0)
+        , added_{}
+    {
+    }
+
+    iterator begin() { return iterator(SlotBegin(), SlotEnd(), std::begin(added_)); }
+    iterator end() { return iterator(std::end(added_), SlotEnd(), std::end(added_)); }
+    const_iterator begin() const { return cbegin(); }
+    const_iterator end() const { return cend(); }
+    const_iterator cbegin() const { return const_iterator(SlotBegin(), SlotEnd(), std::cbegin(added_)); }
+    const_iterator cend() const { return const_iterator(std::cend(added_), SlotEnd(), std::cend(added_)); }
+
+    Value* Find(uint64_t key)
+    {
+        return const_cast<Value*>(std::as_const(*this).Find(key));
+    }
+
+    const Value* Find(uint64_t key) const
+    {
+        if (const std::optional<value_type>* slot = SlotAt(MortonRegionKey(key))) {
+            return slot->has_value() ? &(*slot)->second : nullptr;
+        }
+        return added_.Find(key);
+    }
+
+    bool Contains(uint64_t key) const
+    {
+        return Find(key) != nullptr;
+    }
+
+    template <typename... Args>
+    Value& Emplace(uint64_t key, Args&&... args)
+    {
+        if (std::optional<value_type>* slot = SlotAt(MortonRegionKey(key))) {
+            if (!slot->has_value()) {
+                slot->emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+                ++sortedCount_;
+            }
+            return (*slot)->second;
+        }
+        if (added_.Size() >= std::max<size_t>(slots_.size() / 4, MIN_MERGE_SIZE) && !added_.Contains(key)) {
+            Merge();
+        }
+        return added_.Emplace(key, std::forward<Args>(args)...);
+    }
+
+    bool Erase(uint64_t key)
+    {
+        if (std::optional<value_type>* slot = SlotAt(MortonRegionKey(key))) {
+            if (slot->has_value()) {
+                slot->reset();
+                --sortedCount_;
+                return true;
+            }
+            return false;
+        }
+        return added_.Erase(key);
+    }
+
+    template <typename Predicate>
+    size_t EraseIf(Predicate&& predicate)
+    {
+        Merge();
+        size_t erased = 0;
+        for (auto& slot : slots_) {
+            if (predicate(*slot)) {
+                slot.reset();
+                ++erased;
+            }
+        }
+        if (erased > 0) {
+            sortedCount_ -= erased;
+            Compact();
+        }
+        return erased;
+    }
+
+    void Clear()
+    {
+        codes_.clear();
+        slots_.clear();
+        sortedCount_ = 0;
+        added_.Clear();
+    }
+
+    size_t Size() const
+    {
+        return sortedCount_ + added_.Size();
+    }
+
+    size_t BytesAllocated() const
+    {
+        return (codes_.capacity() * sizeof(uint64_t)) + (slots_.capacity() * sizeof(std::optional<value_type>)) + added_.BytesAllocated();
+    }
+
+private:
+    static constexpr size_t MIN_MERGE_SIZE = 64;
+
+    // Parallel arrays, empty slots are kept until the next merge so that codes_ stays sorted
+    std::vector<uint64_t> codes_;
+    std::vector<std::optional<value_type>> slots_;
+    size_t sortedCount_;
+    FlatRegionTable<Value> added_;
+
+    typename FlatRegionTable<Value>::iterator SlotBegin() { return { slots_.data(), slots_.data() + slots_.size() }; }
+    typename FlatRegionTable<Value>::iterator SlotEnd() { return { slots_.data() + slots_.size(), slots_.data() + slots_.size() }; }
+    typename FlatRegionTable<Value>::const_iterator SlotBegin() const { return { slots_.data(), slots_.data() + slots_.size() }; }
+    typename FlatRegionTable<Value>::const_iterator SlotEnd() const { return { slots_.data() + slots_.size(), slots_.data() + slots_.size() }; }
+
+    std::optional<value_type>* SlotAt(uint64_t code)
+    {
+        return const_cast<std::optional<value_type>*>(std::as_const(*this).SlotAt(code));
+    }
+
+    const std::optional<value_type>* SlotAt(uint64_t code) const
+    {
+        auto iter = std::lower_bound(std::cbegin(codes_), std::cend(codes_), code);
+        if (iter != std::cend(codes_) && *iter == code) {
+            return &slots_[static_cast<size_t>(iter - std::cbegin(codes_))];
+        }
+        return nullptr;
+    }
+
+    void Compact()
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            if (slots_[i].has_value()) {
+                if (kept != i) {
+                    codes_[kept] = codes_[i];
+                    slots_[kept] = std::move(slots_[i]);
+                }
+                ++kept;
+            }
+        }
+        codes_.resize(kept);
+        slots_.resize(kept);
+    }
+
+    void Merge()
+    {
+        if (added_.Size() == 0) {
+            if (sortedCount_ != slots_.size()) {
+                Compact();
+            }
+            return;
+        }
+
+        std::vector<std::pair<uint64_t, value_type*>> added;
+        added.reserve(added_.Size());
+        for (auto& entry : added_) {
+            added.emplace_back(MortonRegionKey(entry.first), &entry);
+        }
+        std::sort(std::begin(added), std::end(added), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        std::vector<uint64_t> codes;
+        std::vector<std::optional<value_type>> slots;
+        codes.reserve(Size());
+        slots.reserve(Size());
+        auto sorted = std::begin(added);
+        for (size_t i = 0; i <= slots_.size(); ++i) {
+            while (sorted != std::end(added) && (i == slots_.size() || sorted->first < codes_[i])) {
+                codes.push_back(sorted->first);
+                slots.emplace_back(std::move(*sorted->second));
+                ++sorted;
+            }
+            if (i < slots_.size() && slots_[i].has_value()) {
+                codes.push_back(codes_[i]);
+                slots.push_back(std::move(slots_[i]));
+            }
+        }
+        codes_ = std::move(codes);
+        slots_ = std::move(slots);
+        sortedCount_ = slots_.size();
+        added_.Clear();
+    }
+};
+
+/**
+ * @brief The NodeRegionTable class adapts std::unordered_map to the region table
+ * interface. Entries are individually allocated, so they are never moved by
+ * subsequent insertions or erasures.
+ */
+template <typename Value>
+class NodeRegionTable {
+public:
+    using MapType = std::unordered_map<uint64_t, Value>;
+    using key_type = uint64_t;
+    using mapped_type = Value;
+    using value_type = MapType::value_type;
+    using size_type = size_t;
+    using iterator = MapType::iterator;
+    using const_iterator = MapType::const_iterator;
+
+    iterator begin() { return std::begin(map_); }
+    iterator end() { return std::end(map_); }
+    const_iterator begin() const { return std::cbegin(map_); }
+    const_iterator end() const { return std::cend(map_); }
+    const_iterator cbegin() const { return std::cbegin(map_); }
+    const_iterator cend() const { return std::cend(map_); }
+
+    Value* Find(uint64_t key)
+    {
+        auto iter = map_.find(key);
+        return iter != std::end(map_) ? &iter->second : nullptr;
+    }
+
+    const Value* Find(uint64_t key) const
+    {
+        auto iter = map_.find(key);
+        return iter != std::cend(map_) ? &iter->second : nullptr;
+    }
+
+    bool Contains(uint64_t key) const
+    {
+        return map_.contains(key);
+    }
+
+    template <typename... Args>
+    Value& Emplace(uint64_t key, Args&&... args)
+    {
+        return map_.try_emplace(key, std::forward<Args>(args)...).first->second;
+    }
+
+    bool Erase(uint64_t key)
+    {
+        return map_.erase(key) > 0;
+    }
+
+    template <typename Predicate>
+    size_t EraseIf(Predicate&& predicate)
+    {
+        size_t erased = 0;
+        for (auto iter = std::begin(map_); iter != std::end(map_); ) {
+            if (predicate(*iter)) {
+                iter = map_.erase(iter);
+                ++erased;
+            } else {
+                ++iter;
+            }
+        }
+        return erased;
+    }
+
+    void Clear()
+    {
+        map_.clear();
+    }
+
+    size_t Size() const
+    {
+        return map_.size();
+    }
+
+    size_t BytesAllocated() const
+    {
+        // Approximate, each node also holds the pointer to the next
+        return (map_.size() * (sizeof(value_type) + sizeof(void*))) + (map_.bucket_count() * sizeof(void*));
+    }
+
+private:
+    MapType map_;
+};
+
+} // namespace util
+
+#endif // REGIONTABLE_H
@@ -0,0 +1,269 @@
+#include "Shape.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64)
+// SSE2 is part of the x86-64 baseline, AVX2 must be detected at runtime
+#define SHAPE_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SHAPE_TARGET_AVX2
+#else
+#define SHAPE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+SimdLevel SupportedSimdLevel()
+{
+#if defined(SHAPE_SIMD_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+        __cpuidex(info, 7, 0);
+        if (osSavesYmm && (info[1] & (1 << 5)) != 0) {
+            return SimdLevel::Avx2;
+        }
+    }
+    return SimdLevel::Sse2;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? SimdLevel::Avx2 : SimdLevel::Sse2;
+#endif
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+std::atomic<SimdLevel> currentSimdLevel = SupportedSimdLevel();
+
+///
+/// Scalar implementations, also used for the remainder of SIMD batches
+///
+
+void CollidesManyScalar(const Circle& query, const double* xs, const double* ys, const double* radii, uint8_t* out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        out[i] = Collides(query, Circle{ xs[i], ys[i], radii[i] }) ? 1 : 0;
+    }
+}
+
+void CollidesManyScalar(const Rect& query, const double* lefts, const double* tops, const double* rights, const double* bottoms, uint8_t* out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        out[i] = Collides(query, Rect{ lefts[i], tops[i], rights[i], bottoms[i] }) ? 1 : 0;
+    }
+}
+
+void ContainsManyScalar(const Circle& query, const double* xs, const double* ys, uint8_t* out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        out[i] = Contains(query, Point{ xs[i], ys[i] }) ? 1 : 0;
+    }
+}
+
+#if defined(SHAPE_SIMD_X86)
+
+template <size_t Lanes>
+void WriteMask(int mask, uint8_t* out)
+{
+    for (size_t lane = 0; lane < Lanes; ++lane) {
+        out[lane] = static_cast<uint8_t>((mask >> lane) & 1);
+    }
+}
+
+// Rounds exactly as SumOfSquares in Shape.h does
+inline __m128d SumOfSquares(__m128d a, __m128d b)
+{
+#if defined(__FMA__)
+    return _mm_fmadd_pd(a, a, _mm_mul_pd(b, b));
+#else
+    return _mm_add_pd(_mm_mul_pd(a, a), _mm_mul_pd(b, b));
+#endif
+}
+
+SHAPE_TARGET_AVX2 inline __m256d SumOfSquares(__m256d a, __m256d b)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_pd(a, a, _mm256_mul_pd(b, b));
+#else
+    return _mm256_add_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b));
+#endif
+}
+
+///
+/// SSE2, two doubles per instruction. Squared distances are summed by
+/// SumOfSquares, so results are bit-identical to the scalar functions.
+///
+
+void CollidesManySse2(const Circle& query, const double* xs, const double* ys, const double* radii, uint8_t* out, size_t count)
+{
+    const __m128d qx = _mm_set1_pd(query.x);
+    const __m128d qy = _mm_set1_pd(query.y);
+    const __m128d qr = _mm_set1_pd(query.radius);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d dx = _mm_sub_pd(qx, _mm_loadu_pd(xs + i));
+        __m128d dy = _mm_sub_pd(qy, _mm_loadu_pd(ys + i));
+        __m128d r = _mm_add_pd(qr, _mm_loadu_pd(radii + i));
+        __m128d distanceSquare = SumOfSquares(dx, dy);
+        WriteMask<2>(_mm_movemask_pd(_mm_cmple_pd(distanceSquare, _mm_mul_pd(r, r))), out + i);
+    }
+    CollidesManyScalar(query, xs, ys, radii, out, i, count);
+}
+
+void CollidesManySse2(const Rect& query, const double* lefts, const double* tops, const double* rights, const double* bottoms, uint8_t* out, size_t count)
+{
+    const __m128d qLeft = _mm_set1_pd(query.left);
+    const __m128d qTop = _mm_set1_pd(query.top);
+    const __m128d qRight = _mm_set1_pd(query.right);
+    const __m128d qBottom = _mm_set1_pd(query.bottom);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d horizontal = _mm_and_pd(_mm_cmpge_pd(_mm_loadu_pd(rights + i), qLeft), _mm_cmplt_pd(_mm_loadu_pd(lefts + i), qRight));
+        __m128d vertical = _mm_and_pd(_mm_cmpge_pd(_mm_loadu_pd(bottoms + i), qTop), _mm_cmplt_pd(_mm_loadu_pd(tops + i), qBottom));
+        WriteMask<2>(_mm_movemask_pd(_mm_and_pd(horizontal, vertical)), out + i);
+    }
+    CollidesManyScalar(query, lefts, tops, rights, bottoms, out, i, count);
+}
+
+void ContainsManySse2(const Circle& query, const double* xs, const double* ys, uint8_t* out, size_t count)
+{
+    const __m128d qx = _mm_set1_pd(query.x);
+    const __m128d qy = _mm_set1_pd(query.y);
+    const __m128d radiusSquare = _mm_set1_pd(query.radius * query.radius);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d dx = _mm_sub_pd(qx, _mm_loadu_pd(xs + i));
+        __m128d dy = _mm_sub_pd(qy, _mm_loadu_pd(ys + i));
+        __m128d distanceSquare = SumOfSquares(dx, dy);
+        WriteMask<2>(_mm_movemask_pd(_mm_cmple_pd(distanceSquare, radiusSquare)), out + i);
+    }
+    ContainsManyScalar(query, xs, ys, out, i, count);
+}
+
+///
+/// AVX2, four doubles per instruction
+///
+
+SHAPE_TARGET_AVX2 void CollidesManyAvx2(const Circle& query, const double* xs, const double* ys, const double* radii, uint8_t* out, size_t count)
+{
+    const __m256d qx = _mm256_set1_pd(query.x);
+    const __m256d qy = _mm256_set1_pd(query.y);
+    const __m256d qr = _mm256_set1_pd(query.radius);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d dx = _mm256_sub_pd(qx, _mm256_loadu_pd(xs + i));
+        __m256d dy = _mm256_sub_pd(qy, _mm256_loadu_pd(ys + i));
+        __m256d r = _mm256_add_pd(qr, _mm256_loadu_pd(radii + i));
+        __m256d distanceSquare = SumOfSquares(dx, dy);
+        WriteMask<4>(_mm256_movemask_pd(_mm256_cmp_pd(distanceSquare, _mm256_mul_pd(r, r), _CMP_LE_OQ)), out + i);
+    }
+    CollidesManyScalar(query, xs, ys, radii, out, i, count);
+}
+
+SHAPE_TARGET_AVX2 void CollidesManyAvx2(const Rect& query, const double* lefts, const double* tops, const double* rights, const double* bottoms, uint8_t* out, size_t count)
+{
+    const __m256d qLeft = _mm256_set1_pd(query.left);
+    const __m256d qTop = _mm256_set1_pd(query.top);
+    const __m256d qRight = _mm256_set1_pd(query.right);
+    const __m256d qBottom = _mm256_set1_pd(query.bottom);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d horizontal = _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(rights + i), qLeft, _CMP_GE_OQ), _mm256_cmp_pd(_mm256_loadu_pd(lefts + i), qRight, _CMP_LT_OQ));
+        __m256d vertical = _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(bottoms + i), qTop, _CMP_GE_OQ), _mm256_cmp_pd(_mm256_loadu_pd(tops + i), qBottom, _CMP_LT_OQ));
+        WriteMask<4>(_mm256_movemask_pd(_mm256_and_pd(horizontal, vertical)), out + i);
+    }
+    CollidesManyScalar(query, lefts, tops, rights, bottoms, out, i, count);
+}
+
+SHAPE_TARGET_AVX2 void ContainsManyAvx2(const Circle& query, const double* xs, const double* ys, uint8_t* out, size_t count)
+{
+    const __m256d qx = _mm256_set1_pd(query.x);
+    const __m256d qy = _mm256_set1_pd(query.y);
+    const __m256d radiusSquare = _mm256_set1_pd(query.radius * query.radius);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d dx = _mm256_sub_pd(qx, _mm256_loadu_pd(xs + i));
+        __m256d dy = _mm256_sub_pd(qy, _mm256_loadu_pd(ys + i));
+        __m256d distanceSquare = SumOfSquares(dx, dy);
+        WriteMask<4>(_mm256_movemask_pd(_mm256_cmp_pd(distanceSquare, radiusSquare, _CMP_LE_OQ)), out + i);
+    }
+    ContainsManyScalar(query, xs, ys, out, i, count);
+}
+
+#endif // SHAPE_SIMD_X86
+
+} // end anon namespace
+
+SimdLevel GetSimdLevel()
+{
+    return currentSimdLevel.load(std::memory_order_relaxed);
+}
+
+SimdLevel SetSimdLevel(SimdLevel level)
+{
+    SimdLevel applied = std::min(level, SupportedSimdLevel());
+    currentSimdLevel.store(applied, std::memory_order_relaxed);
+    return applied;
+}
+
+void CollidesMany(const Circle& query, std::span<const double> xs, std::span<const double> ys, std::span<const double> radii, std::span<uint8_t> out)
+{
+    assert(ys.size() == xs.size() && radii.size() == xs.size() && out.size() >= xs.size());
+    switch (GetSimdLevel()) {
+#if defined(SHAPE_SIMD_X86)
+    case SimdLevel::Avx2:
+        CollidesManyAvx2(query, xs.data(), ys.data(), radii.data(), out.data(), xs.size());
+        return;
+    case SimdLevel::Sse2:
+        CollidesManySse2(query, xs.data(), ys.data(), radii.data(), out.data(), xs.size());
+        return;
+#endif
+    default:
+        CollidesManyScalar(query, xs.data(), ys.data(), radii.data(), out.data(), 0, xs.size());
+        return;
+    }
+}
+
+void CollidesMany(const Rect& query, std::span<const double> lefts, std::span<const double> tops, std::span<const double> rights, std::span<const double> bottoms, std::span<uint8_t> out)
+{
+    assert(tops.size() == lefts.size() && rights.size() == lefts.size() && bottoms.size() == lefts.size() && out.size() >= lefts.size());
+    switch (GetSimdLevel()) {
+#if defined(SHAPE_SIMD_X86)
+    case SimdLevel::Avx2:
+        CollidesManyAvx2(query, lefts.data(), tops.data(), rights.data(), bottoms.data(), out.data(), lefts.size());
+        return;
+    case SimdLevel::Sse2:
+        CollidesManySse2(query, lefts.data(), tops.data(), rights.data(), bottoms.data(), out.data(), lefts.size());
+        return;
+#endif
+    default:
+        CollidesManyScalar(query, lefts.data(), tops.data(), rights.data(), bottoms.data(), out.data(), 0, lefts.size());
+        return;
+    }
+}
+
+void ContainsMany(const Circle& query, std::span<const double> xs, std::span<const double> ys, std::span<uint8_t> out)
+{
+    assert(ys.size() == xs.size() && out.size() >= xs.size());
+    switch (GetSimdLevel()) {
+#if defined(SHAPE_SIMD_X86)
+    case SimdLevel::Avx2:
+        ContainsManyAvx2(query, xs.data(), ys.data(), out.data(), xs.size());
+        return;
+    case SimdLevel::Sse2:
+        ContainsManySse2(query, xs.data(), ys.data(), out.data(), xs.size());
+        return;
+#endif
+    default:
+        ContainsManyScalar(query, xs.data(), ys.data(), out.data(), 0, xs.size());
+        return;
+    }
+}
@@ -7,8 +7,13 @@
 
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
 #include <limits>
 #include <numbers>
+#include <optional>
+#include <span>
+#include <concepts>
+#include <type_traits>
 #include <math.h>
 #include <stdint.h>
 #include <assert.h>
@@ -17,95 +22,213 @@ namespace {
     inline constexpr double tau = std::numbers::pi * 2.0;
 }
 
-struct Vec2 {
-    double x;
-    double y;
+/**
+ * Shapes may use any floating point type, or a signed integer type as fixed
+ * point, e.g. int32_t coordinates in millimetres. Squared distances of integer
+ * shapes are calculated in 64 bits, so integer coordinates should stay within
+ * +/-2^29.
+ */
+template <typename T>
+concept ShapeScalar = std::floating_point<T> || std::signed_integral<T>;
+
+// The type in which shapes of the given scalar types are added, subtracted and squared
+template <ShapeScalar... Scalars>
+using ShapeArithmetic = std::conditional_t<std::floating_point<std::common_type_t<Scalars...>>, std::common_type_t<Scalars...>, int64_t>;
+
+// The type in which fractions and lengths of shapes with the given scalar types are calculated
+template <ShapeScalar... Scalars>
+using ShapeReal = std::conditional_t<std::floating_point<std::common_type_t<Scalars...>>, std::common_type_t<Scalars...>, double>;
+
+// Shapes convert implicitly to shapes whose scalar type can hold every value of their own, otherwise explicitly
+template <typename From, typename To>
+constexpr inline bool IsWideningScalar = (std::floating_point<From> == std::floating_point<To> && sizeof(To) >= sizeof(From))
+                                      || (std::signed_integral<From> && std::floating_point<To> && std::numeric_limits<To>::digits >= std::numeric_limits<From>::digits);
+
+template <ShapeScalar Scalar>
+struct BasicVec2 {
+    Scalar x;
+    Scalar y;
+
+    template <ShapeScalar Other>
+        requires (!std::same_as<Other, Scalar>)
+    explicit(!IsWideningScalar<Scalar, Other>) constexpr operator BasicVec2<Other>() const
+    {
+        return { static_cast<Other>(x), static_cast<Other>(y) };
+    }
 };
 
-struct Point {
-    double x;
-    double y;
+template <ShapeScalar Scalar>
+struct BasicPoint {
+    Scalar x;
+    Scalar y;
+
+    template <ShapeScalar Other>
+        requires (!std::same_as<Other, Scalar>)
+    explicit(!IsWideningScalar<Scalar, Other>) constexpr operator BasicPoint<Other>() const
+    {
+        return { static_cast<Other>(x), static_cast<Other>(y) };
+    }
 };
 
-struct Line {
-    Point a;
-    Point b;
+template <ShapeScalar Scalar>
+struct BasicLine {
+    BasicPoint<Scalar> a;
+    BasicPoint<Scalar> b;
+
+    template <ShapeScalar Other>
+        requires (!std::same_as<Other, Scalar>)
+    explicit(!IsWideningScalar<Scalar, Other>) constexpr operator BasicLine<Other>() const
+    {
+        return { static_cast<BasicPoint<Other>>(a), static_cast<BasicPoint<Other>>(b) };
+    }
 };
 
-struct Circle {
-    double x;
-    double y;
+template <ShapeScalar Scalar>
+struct BasicCircle {
+    Scalar x;
+    Scalar y;
     // inclusive
-    double radius;
+    Scalar radius;
+
+    template <ShapeScalar Other>
+        requires (!std::same_as<Other, Scalar>)
+    explicit(!IsWideningScalar<Scalar, Other>) constexpr operator BasicCircle<Other>() const
+    {
+        return { static_cast<Other>(x), static_cast<Other>(y), static_cast<Other>(radius) };
+    }
 };
 
-struct Rect {
+template <ShapeScalar Scalar>
+struct BasicRect {
     // inclusive, top left point is point closest to (0, 0)
-    double left;
-    double top;
+    Scalar left;
+    Scalar top;
     // exclusive
-    double right;
-    double bottom;
+    Scalar right;
+    Scalar bottom;
+
+    template <ShapeScalar Other>
+        requires (!std::same_as<Other, Scalar>)
+    explicit(!IsWideningScalar<Scalar, Other>) constexpr operator BasicRect<Other>() const
+    {
+        return { static_cast<Other>(left), static_cast<Other>(top), static_cast<Other>(right), static_cast<Other>(bottom) };
+    }
 };
 
-inline bool operator!=(const Point& p1, const Point& p2)
+using Vec2 = BasicVec2<double>;
+using Point = BasicPoint<double>;
+using Line = BasicLine<double>;
+using Circle = BasicCircle<double>;
+using Rect = BasicRect<double>;
+
+template <typename Shape>
+struct ShapeTraits {};
+template <ShapeScalar Scalar>
+struct ShapeTraits<BasicPoint<Scalar>> { using ScalarType = Scalar; };
+template <ShapeScalar Scalar>
+struct ShapeTraits<BasicLine<Scalar>> { using ScalarType = Scalar; };
+template <ShapeScalar Scalar>
+struct ShapeTraits<BasicCircle<Scalar>> { using ScalarType = Scalar; };
+template <ShapeScalar Scalar>
+struct ShapeTraits<BasicRect<Scalar>> { using ScalarType = Scalar; };
+
+template <ShapeScalar Scalar>
+constexpr bool operator!=(const BasicPoint<Scalar>& p1, const BasicPoint<Scalar>& p2)
 {
     return p1.x != p2.x || p1.y != p2.y;
 }
 
-inline bool operator==(const Point& p1, const Point& p2)
+template <ShapeScalar Scalar>
+constexpr bool operator==(const BasicPoint<Scalar>& p1, const BasicPoint<Scalar>& p2)
 {
     return p1.x == p2.x && p1.y == p2.y;
 }
 
-inline bool operator==(const Rect& r1, const Rect& r2)
+template <ShapeScalar Scalar>
+constexpr bool operator==(const BasicRect<Scalar>& r1, const BasicRect<Scalar>& r2)
 {
     return r1.left == r2.left && r1.top == r2.top && r1.right == r2.right && r1.bottom == r2.bottom;
 }
 
-inline Point operator+(const Point& p, const Vec2& v)
+template <ShapeScalar Scalar>
+constexpr BasicPoint<Scalar> operator+(const BasicPoint<Scalar>& p, const BasicVec2<Scalar>& v)
 {
     return { p.x + v.x, p.y + v.y };
 }
 
-inline Point operator-(const Point& p, const Vec2& v)
+template <ShapeScalar Scalar>
+constexpr BasicPoint<Scalar> operator-(const BasicPoint<Scalar>& p, const BasicVec2<Scalar>& v)
 {
     return { p.x - v.x, p.y - v.y };
 }
 
-inline Point operator+(const Point& a, const Point& b)
+template <ShapeScalar Scalar>
+constexpr BasicPoint<Scalar> operator+(const BasicPoint<Scalar>& a, const BasicPoint<Scalar>& b)
 {
     return { a.x + b.x, a.y + b.y };
 }
 
-inline Point operator-(const Point& a, const Point& b)
+template <ShapeScalar Scalar>
+constexpr BasicPoint<Scalar> operator-(const BasicPoint<Scalar>& a, const BasicPoint<Scalar>& b)
 {
     return { a.x - b.x, a.y - b.y };
 }
 
-inline Point operator-(const Point& p)
+template <ShapeScalar Scalar>
+constexpr BasicPoint<Scalar> operator-(const BasicPoint<Scalar>& p)
 {
     return { -p.x, -p.y };
 }
 
-inline Point operator*(const Point& p, double scale)
+template <ShapeScalar Scalar>
+constexpr BasicPoint<Scalar> operator*(const BasicPoint<Scalar>& p, std::type_identity_t<Scalar> scale)
 {
     return { p.x * scale, p.y * scale };
 }
 
-inline double GetDistanceSquare(const Point& a, const Point& b)
+/*
+ * Functions taking shapes of two different scalar types calculate in the
+ * ShapeArithmetic of both. Where a shape argument is brace initialised, its
+ * scalar type defaults to that of the other argument, or double.
+ */
+
+/**
+ * When compiling for a CPU with FMA (e.g. -mfma or -march=native) the sum is
+ * fused explicitly, rather than however the compiler chooses to contract it,
+ * so that it rounds exactly as the SIMD kernels behind CollidesMany do.
+ */
+template <typename Arithmetic>
+constexpr Arithmetic SumOfSquares(Arithmetic a, Arithmetic b)
+{
+#if defined(__FMA__)
+    if constexpr (std::floating_point<Arithmetic>) {
+        if (!std::is_constant_evaluated()) {
+            return std::fma(a, a, b * b);
+        }
+    }
+#endif
+    return (a * a) + (b * b);
+}
+
+template <ShapeScalar A = double, ShapeScalar B = A>
+constexpr ShapeArithmetic<A, B> GetDistanceSquare(const BasicPoint<A>& a, const BasicPoint<B>& b)
 {
     // Keep this func as sqrt is expensive, and isn't always needed
-    return std::pow(a.x - b.x, 2) + std::pow(a.y - b.y, 2);
+    using Arithmetic = ShapeArithmetic<A, B>;
+    Arithmetic dx = static_cast<Arithmetic>(a.x) - static_cast<Arithmetic>(b.x);
+    Arithmetic dy = static_cast<Arithmetic>(a.y) - static_cast<Arithmetic>(b.y);
+    return SumOfSquares(dx, dy);
 }
 
-inline double GetDistance(const Point& a, const Point& b)
+template <ShapeScalar A = double, ShapeScalar B = A>
+inline ShapeReal<A, B> GetDistance(const BasicPoint<A>& a, const BasicPoint<B>& b)
 {
     // Don't use std::hypot, naive impl is fit for purpose and faster
-    return std::sqrt(GetDistanceSquare(a, b));
+    return std::sqrt(static_cast<ShapeReal<A, B>>(GetDistanceSquare(a, b)));
 }
 
-inline Rect RectFromCircle(const Circle& c)
+template <ShapeScalar Scalar>
+constexpr BasicRect<Scalar> RectFromCircle(const BasicCircle<Scalar>& c)
 {
     return {c.x - c.radius, c.y - c.radius, c.x + c.radius , c.y + c.radius };
 }
@@ -153,214 +276,264 @@ inline std::tuple<double, double> DeconstructMovementVector(const Vec2& movement
     return { bearing, speed };
 }
 
-inline double GetArea(const Rect& rectangle)
+template <ShapeScalar Scalar>
+constexpr ShapeArithmetic<Scalar> GetArea(const BasicRect<Scalar>& rectangle)
 {
-    double width = rectangle.right - rectangle.left;
-    double height = rectangle.bottom - rectangle.top;
+    ShapeArithmetic<Scalar> width = static_cast<ShapeArithmetic<Scalar>>(rectangle.right) - rectangle.left;
+    ShapeArithmetic<Scalar> height = static_cast<ShapeArithmetic<Scalar>>(rectangle.bottom) - rectangle.top;
     return width * height;
 }
 
-inline double GetArea(const Circle& circle)
+template <ShapeScalar Scalar>
+constexpr ShapeReal<Scalar> GetArea(const BasicCircle<Scalar>& circle)
 {
-    return std::numbers::pi * std::pow(circle.radius, 2);
+    ShapeReal<Scalar> radius = static_cast<ShapeReal<Scalar>>(circle.radius);
+    return std::numbers::pi_v<ShapeReal<Scalar>> * (radius * radius);
 }
 
-inline Rect BoundingRect(const Point& point, double margin = 0.0)
+template <ShapeScalar Scalar>
+inline BasicRect<Scalar> BoundingRect(const BasicPoint<Scalar>& point, std::type_identity_t<Scalar> margin = 0)
 {
-    assert(margin >= 0.0);
-    double minX = point.x - margin;
-    double maxX = point.x + margin;
-    double minY = point.y - margin;
-    double maxY = point.y + margin;
-    return Rect{ minX, minY, maxX, maxY };
+    assert(margin >= 0);
+    Scalar minX = point.x - margin;
+    Scalar maxX = point.x + margin;
+    Scalar minY = point.y - margin;
+    Scalar maxY = point.y + margin;
+    return BasicRect<Scalar>{ minX, minY, maxX, maxY };
 }
 
-inline Rect BoundingRect(const Line& line, double margin = 0.0)
+template <ShapeScalar Scalar>
+inline BasicRect<Scalar> BoundingRect(const BasicLine<Scalar>& line, std::type_identity_t<Scalar> margin = 0)
 {
-    assert(margin >= 0.0);
-    double minX = std::min(line.a.x, line.b.x) - margin;
-    double maxX = std::max(line.a.x, line.b.x) + margin;
-    double minY = std::min(line.a.y, line.b.y) - margin;
-    double maxY = std::max(line.a.y, line.b.y) + margin;
-    return Rect{ minX, minY, maxX, maxY };
+    assert(margin >= 0);
+    Scalar minX = std::min(line.a.x, line.b.x) - margin;
+    Scalar maxX = std::max(line.a.x, line.b.x) + margin;
+    Scalar minY = std::min(line.a.y, line.b.y) - margin;
+    Scalar maxY = std::max(line.a.y, line.b.y) + margin;
+    return BasicRect<Scalar>{ minX, minY, maxX, maxY };
 }
 
-inline Rect BoundingRect(const Rect& rect, double margin = 0.0)
+template <ShapeScalar Scalar>
+inline BasicRect<Scalar> BoundingRect(const BasicRect<Scalar>& rect, std::type_identity_t<Scalar> margin = 0)
 {
-    assert(margin >= 0.0);
-    double minX = rect.left   - margin;
-    double maxX = rect.right  + margin;
-    double minY = rect.top    - margin;
-    double maxY = rect.bottom + margin;
-    return Rect{ minX, minY, maxX, maxY };
+    assert(margin >= 0);
+    Scalar minX = rect.left   - margin;
+    Scalar maxX = rect.right  + margin;
+    Scalar minY = rect.top    - margin;
+    Scalar maxY = rect.bottom + margin;
+    return BasicRect<Scalar>{ minX, minY, maxX, maxY };
 }
 
-inline Rect BoundingRect(const Circle& circle, double margin = 0.0)
+template <ShapeScalar Scalar>
+inline BasicRect<Scalar> BoundingRect(const BasicCircle<Scalar>& circle, std::type_identity_t<Scalar> margin = 0)
 {
-    double minX = (circle.x - circle.radius) - margin;
-    double maxX = (circle.x + circle.radius) + margin;
-    double minY = (circle.y - circle.radius) - margin;
-    double maxY = (circle.y + circle.radius) + margin;
-    return Rect{ minX, minY, maxX, maxY };
+    Scalar minX = (circle.x - circle.radius) - margin;
+    Scalar maxX = (circle.x + circle.radius) + margin;
+    Scalar minY = (circle.y - circle.radius) - margin;
+    Scalar maxY = (circle.y + circle.radius) + margin;
+    return BasicRect<Scalar>{ minX, minY, maxX, maxY };
 }
 
-inline bool Contains(const Line& l, const Point& p)
+template <ShapeScalar A, ShapeScalar B = A>
+inline bool Contains(const BasicLine<A>& l, const BasicPoint<B>& p)
 {
-    if (p == l.a || p == l.b) {
+    using Real = ShapeReal<A, B>;
+    if ((p.x == l.a.x && p.y == l.a.y) || (p.x == l.b.x && p.y == l.b.y)) {
         return true;
-    } else if (util::Range<double>(l.a.x, l.b.x).Contains(p.x) && util::Range<double>(l.a.y, l.b.y).Contains(p.y)) {
+    } else if (util::Range<Real>(l.a.x, l.b.x).Contains(p.x) && util::Range<Real>(l.a.y, l.b.y).Contains(p.y)) {
         // Work out the slope of the line & a line connecting the point to the line
-        double ldx = l.b.x - l.a.x;
-        double ldy = l.b.y - l.a.y;
-        double pdx = l.b.x - p.x;
-        double pdy = l.b.y - p.y;
+        Real ldx = static_cast<Real>(l.b.x) - static_cast<Real>(l.a.x);
+        Real ldy = static_cast<Real>(l.b.y) - static_cast<Real>(l.a.y);
+        Real pdx = static_cast<Real>(l.b.x) - static_cast<Real>(p.x);
+        Real pdy = static_cast<Real>(l.b.y) - static_cast<Real>(p.y);
 
         // Work out the slopes of the lines (checking for infinite slopes)
-        if (ldy == 0.0 || pdy == 0.0) {
-            return ldy == pdy && l.a.y == p.y && util::Range<double>(l.a.x, l.b.x).Contains(p.x);
+        if (ldy == 0 || pdy == 0) {
+            return ldy == pdy && l.a.y == p.y && util::Range<Real>(l.a.x, l.b.x).Contains(p.x);
         }
 
         // Allow for floating point error
-        double lSlope = ldx / ldy;
-        double pSlope = pdx / pdy;
-        return std::abs(lSlope - pSlope) < 0.0000001;
+        Real lSlope = ldx / ldy;
+        Real pSlope = pdx / pdy;
+        return std::abs(lSlope - pSlope) < static_cast<Real>(0.0000001);
     }
     return false;
 }
 
-inline bool Contains(const Circle& c, const Point& p)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicCircle<A>& c, const BasicPoint<B>& p)
 {
-    return std::pow(std::abs(c.x - p.x), 2) + std::pow(std::abs(c.y - p.y), 2) <= std::pow(c.radius, 2);
+    using Arithmetic = ShapeArithmetic<A, B>;
+    Arithmetic radius = static_cast<Arithmetic>(c.radius);
+    return GetDistanceSquare(BasicPoint<A>{ c.x, c.y }, p) <= radius * radius;
 }
 
-inline bool Contains(const Circle& c, const Line& l)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicCircle<A>& c, const BasicLine<B>& l)
 {
     return Contains(c, l.a) && Contains(c, l.b);
 }
 
-inline bool Contains(const Rect& r, const Point& p)
+/**
+ * A Circle carrying its squared radius, for when many points are tested against
+ * the same circle, e.g. a query area. Contains(CircleSq(c), p) is always equal
+ * to Contains(c, p).
+ */
+template <ShapeScalar Scalar>
+struct BasicCircleSq {
+    Scalar x;
+    Scalar y;
+    Scalar radius;
+    ShapeArithmetic<Scalar> radiusSquare;
+
+    explicit constexpr BasicCircleSq(const BasicCircle<Scalar>& c)
+        : x(c.x)
+        , y(c.y)
+        , radius(c.radius)
+        , radiusSquare(static_cast<ShapeArithmetic<Scalar>>(c.radius) * static_cast<ShapeArithmetic<Scalar>>(c.radius))
+    {
+    }
+};
+
+using CircleSq = BasicCircleSq<double>;
+
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicCircleSq<A>& c, const BasicPoint<B>& p)
+{
+    return GetDistanceSquare(BasicPoint<A>{ c.x, c.y }, p) <= c.radiusSquare;
+}
+
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicCircleSq<A>& c, const BasicLine<B>& l)
+{
+    return Contains(c, l.a) && Contains(c, l.b);
+}
+
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicRect<A>& r, const BasicPoint<B>& p)
 {
     return p.x >= r.left && p.x < r.right && p.y >= r.top && p.y < r.bottom;
 }
 
-inline bool Contains(const Rect& r, const Line& l)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicRect<A>& r, const BasicLine<B>& l)
 {
     return Contains(r, l.a) && Contains(r, l.b);
 }
 
-inline bool Contains(const Rect& container, const Rect& containee)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicRect<A>& container, const BasicRect<B>& containee)
 {
     return containee.left >= container.left && containee.left < container.right && containee.right <= container.right
             && containee.top >= container.top && containee.top < container.bottom && containee.bottom <= container.bottom;
 }
 
-inline bool Contains(const Rect& r, const Circle& c)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Contains(const BasicRect<A>& r, const BasicCircle<B>& c)
 {
     return Contains(r, RectFromCircle(c));
 }
 
 template <typename T>
-concept Collidable = std::same_as<std::decay_t<T>, Circle>
-                  || std::same_as<std::decay_t<T>, Rect>
-                  || std::same_as<std::decay_t<T>, Line>
-                  || std::same_as<std::decay_t<T>, Point>;
+concept Collidable = requires { typename ShapeTraits<std::decay_t<T>>::ScalarType; };
 
-inline bool Collides(const Line& l1, const Line& l2)
+template <ShapeScalar A, ShapeScalar B = A>
+inline bool Collides(const BasicLine<A>& l1, const BasicLine<B>& l2)
 {
-    auto& [x1, y1] = l1.a;
-    auto& [x2, y2] = l1.b;
-    auto& [x3, y3] = l2.a;
-    auto& [x4, y4] = l2.b;
+    using Real = ShapeReal<A, B>;
+    Real x1 = l1.a.x, y1 = l1.a.y;
+    Real x2 = l1.b.x, y2 = l1.b.y;
+    Real x3 = l2.a.x, y3 = l2.a.y;
+    Real x4 = l2.b.x, y4 = l2.b.y;
 
     // calculate the direction of the lines
-    double uA = ((x4 - x3) * (y1 - y3) - (y4 - y3) * (x1 - x3)) / ((y4 - y3) * (x2 - x1) - (x4 - x3) * (y2 - y1));
-    double uB = ((x2 - x1) * (y1 - y3) - (y2 - y1) * (x1 - x3)) / ((y4 - y3) * (x2 - x1) - (x4 - x3) * (y2 - y1));
+    Real uA = ((x4 - x3) * (y1 - y3) - (y4 - y3) * (x1 - x3)) / ((y4 - y3) * (x2 - x1) - (x4 - x3) * (y2 - y1));
+    Real uB = ((x2 - x1) * (y1 - y3) - (y2 - y1) * (x1 - x3)) / ((y4 - y3) * (x2 - x1) - (x4 - x3) * (y2 - y1));
 
     // if uA and uB are between 0-1, lines are colliding
     if (uA >= 0 && uA <= 1 && uB >= 0 && uB <= 1) {
         // optionally, draw a circle where the lines meet
-        // double intersectionX = x1 + (uA * (x2-x1));
-        // double intersectionY = y1 + (uA * (y2-y1));
+        // Real intersectionX = x1 + (uA * (x2-x1));
+        // Real intersectionY = y1 + (uA * (y2-y1));
         return true;
     }
     return false;
 }
 
-inline bool Collides(const Line& line, const Circle& circle)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Collides(const BasicLine<A>& line, const BasicCircle<B>& circle)
 {
-    if (Contains(circle, line.a) || Contains(circle, line.b)) {
-        return true;
-    }
+    using Real = ShapeReal<A, B>;
+    Real lineDeltaX = static_cast<Real>(line.b.x) - static_cast<Real>(line.a.x);
+    Real lineDeltaY = static_cast<Real>(line.b.y) - static_cast<Real>(line.a.y);
+    Real lengthSquare = (lineDeltaX * lineDeltaX) + (lineDeltaY * lineDeltaY);
 
-    double lineLength = GetDistance(line.a, line.b);
+    // Fraction along the line of the point closest to the circle, clamped to the line's ends
+    Real dot = ((static_cast<Real>(circle.x) - static_cast<Real>(line.a.x)) * lineDeltaX) + ((static_cast<Real>(circle.y) - static_cast<Real>(line.a.y)) * lineDeltaY);
+    Real fraction = lengthSquare > 0 ? std::clamp(dot / lengthSquare, Real{ 0 }, Real{ 1 }) : Real{ 0 };
+    BasicPoint<Real> nearest{ static_cast<Real>(line.a.x) + (fraction * lineDeltaX), static_cast<Real>(line.a.y) + (fraction * lineDeltaY) };
 
-    // Dot product of line and circle
-    double lineDeltaX = line.b.x - line.a.x;
-    double lineDeltaY = line.b.y - line.a.y;
-    double dot = (((circle.x - line.a.x) * lineDeltaX) + ((circle.y - line.a.y) * lineDeltaY)) / std::pow(lineLength , 2.0);
-
-    // Point on infinite line closest to circle
-    Point nearest{ line.a.x + (dot * lineDeltaX), line.a.y + (dot * lineDeltaY) };
-
-    // Check point is not past either end of the specified line
-    if (!Contains(line, nearest)) {
-        return false;
-    }
-
-  return GetDistance({ circle.x, circle.y }, nearest) <= circle.radius;
+    // The ends are tested exactly, as the nearest point may be off by a rounding error
+    return Contains(circle, line.a) || Contains(circle, line.b) || Contains(circle, nearest);
 }
 
-inline bool Collides(const Line& l, const Rect& r)
+template <ShapeScalar A, ShapeScalar B = A>
+inline bool Collides(const BasicLine<A>& l, const BasicRect<B>& r)
 {
     return Contains(r, l.a)
         || Contains(r, l.b)
-        || Collides(l, { { r.top, r.left }, { r.top, r.right } })
-        || Collides(l, { { r.top, r.left }, { r.bottom, r.left } })
-        || Collides(l, { { r.bottom, r.right }, { r.top, r.right } })
-        || Collides(l, { { r.bottom, r.right }, { r.bottom, r.left } });
+        || Collides(l, BasicLine<B>{ { r.top, r.left }, { r.top, r.right } })
+        || Collides(l, BasicLine<B>{ { r.top, r.left }, { r.bottom, r.left } })
+        || Collides(l, BasicLine<B>{ { r.bottom, r.right }, { r.top, r.right } })
+        || Collides(l, BasicLine<B>{ { r.bottom, r.right }, { r.bottom, r.left } });
 }
 
-inline bool Collides(const Circle& c1, const Circle& c2)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Collides(const BasicCircle<A>& c1, const BasicCircle<B>& c2)
 {
-    return (std::pow(c1.x - c2.x, 2.0) + std::pow(c1.y - c2.y, 2.0)) <= std::pow(c1.radius + c2.radius, 2.0);
+    using Arithmetic = ShapeArithmetic<A, B>;
+    Arithmetic radii = static_cast<Arithmetic>(c1.radius) + static_cast<Arithmetic>(c2.radius);
+    return GetDistanceSquare(BasicPoint<A>{ c1.x, c1.y }, BasicPoint<B>{ c2.x, c2.y }) <= radii * radii;
 }
 
-inline bool Collides(const Rect& r1, const Rect& r2)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Collides(const BasicRect<A>& r1, const BasicRect<B>& r2)
 {
     return r2.right >= r1.left && r2.left < r1.right && r2.bottom >= r1.top && r2.top < r1.bottom;
 }
 
-inline bool Collides(const Rect& r, const Circle& c)
+template <ShapeScalar A, ShapeScalar B = A>
+constexpr bool Collides(const BasicRect<A>& r, const BasicCircle<B>& c)
 {
     if (Collides(r, RectFromCircle(c))) {
         // contains/above/below
-        if (Collides(r, Rect{c.x, c.y - c.radius, c.x, c.y + c.radius})) {
+        if (Collides(r, BasicRect<B>{c.x, c.y - c.radius, c.x, c.y + c.radius})) {
             return true;
         }
         // left/right
-        else if (Collides(r, Rect{c.x - c.radius, c.y, c.x + c.radius, c.y})) {
+        else if (Collides(r, BasicRect<B>{c.x - c.radius, c.y, c.x + c.radius, c.y})) {
             return true;
         }
         // corners
         // top
         else if (c.y <= r.top) {
             // top-left
-            if (c.x < r.left && Contains(c, Point{r.left, r.top})) {
+            if (c.x < r.left && Contains(c, BasicPoint<A>{r.left, r.top})) {
                 return true;
             }
             // top-right
-            else if (c.x > r.right && Contains(c, Point{r.right, r.top})) {
+            else if (c.x > r.right && Contains(c, BasicPoint<A>{r.right, r.top})) {
                 return true;
             }
         }
         // bottom
         else if (c.y >= r.bottom) {
             // bottom-left
-            if (c.x < r.left && Contains(c, Point{r.left, r.bottom})) {
+            if (c.x < r.left && Contains(c, BasicPoint<A>{r.left, r.bottom})) {
                 return true;
             }
             // bottom-right
-            else if (c.x > r.right && Contains(c, Point{r.right, r.bottom})) {
+            else if (c.x > r.right && Contains(c, BasicPoint<A>{r.right, r.bottom})) {
                 return true;
             }
         } else {
@@ -374,8 +547,8 @@ inline bool Collides(const Rect& r, const Circle& c)
  * Generically allow Collide and Contain to be synonymous when one or more of
  * the types is a Point
  */
-template <typename Shape>
-inline bool Collides(const Shape& s, const Point& p)
+template <typename Shape, ShapeScalar Scalar = double>
+constexpr bool Collides(const Shape& s, const BasicPoint<Scalar>& p)
 {
     return Contains(s, p);
 }
@@ -385,12 +558,133 @@ inline bool Collides(const Shape& s, const Point& p)
  * https://stackoverflow.com/questions/61485764/call-a-function-that-is-specifically-not-templated
  */
 template<typename Shape1, typename Shape2>
-auto Collides(Shape1 a, Shape2 b) -> decltype(::Collides(b, a))
+constexpr auto Collides(Shape1 a, Shape2 b) -> decltype(::Collides(b, a))
 {
     // Uses SFINAE to prevent recursive calling
     return Collides(b, a);
 }
 
+/**
+ * Ray intersection tests, for line of sight checks and the like. Each returns
+ * the fraction of the way from line.a to line.b at which the line first touches
+ * the shape, 0 if line.a is already within it, or std::nullopt if the line
+ * misses the shape entirely.
+ */
+inline std::optional<double> FirstIntersection(const Line& line, const Rect& rect)
+{
+    // Slab test, clipping [0, 1] against the span of each axis in turn
+    double first = 0.0;
+    double last = 1.0;
+    for (auto [ start, delta, low, high ] : { std::tuple{ line.a.x, line.b.x - line.a.x, rect.left, rect.right },
+                                             std::tuple{ line.a.y, line.b.y - line.a.y, rect.top, rect.bottom } }) {
+        if (delta == 0.0) {
+            if (start < low || start > high) {
+                return std::nullopt;
+            }
+        } else {
+            double enter = (low - start) / delta;
+            double leave = (high - start) / delta;
+            if (enter > leave) {
+                std::swap(enter, leave);
+            }
+            first = std::max(first, enter);
+            last = std::min(last, leave);
+            if (first > last) {
+                return std::nullopt;
+            }
+        }
+    }
+    return first;
+}
+
+inline std::optional<double> FirstIntersection(const Line& line, const Circle& circle)
+{
+    // Solve |a + t(b - a) - c|^2 = r^2 for the smaller t
+    double dx = line.b.x - line.a.x;
+    double dy = line.b.y - line.a.y;
+    double fx = line.a.x - circle.x;
+    double fy = line.a.y - circle.y;
+    double a = (dx * dx) + (dy * dy);
+    double b = 2.0 * ((fx * dx) + (fy * dy));
+    double c = (fx * fx) + (fy * fy) - (circle.radius * circle.radius);
+    if (c <= 0.0) {
+        return 0.0;
+    }
+    double discriminant = (b * b) - (4.0 * a * c);
+    if (a == 0.0 || discriminant < 0.0) {
+        return std::nullopt;
+    }
+    double t = (-b - std::sqrt(discriminant)) / (2.0 * a);
+    if (t < 0.0 || t > 1.0) {
+        return std::nullopt;
+    }
+    return t;
+}
+
+inline std::optional<double> FirstIntersection(const Line& line, const Point& point)
+{
+    if (!Contains(line, point)) {
+        return std::nullopt;
+    }
+    double dx = line.b.x - line.a.x;
+    double dy = line.b.y - line.a.y;
+    double lengthSquare = (dx * dx) + (dy * dy);
+    if (lengthSquare == 0.0) {
+        return 0.0;
+    }
+    return std::clamp((((point.x - line.a.x) * dx) + ((point.y - line.a.y) * dy)) / lengthSquare, 0.0, 1.0);
+}
+
+inline std::optional<double> FirstIntersection(const Line& line, const Line& other)
+{
+    double dx = line.b.x - line.a.x;
+    double dy = line.b.y - line.a.y;
+    double ox = other.b.x - other.a.x;
+    double oy = other.b.y - other.a.y;
+    double denominator = (oy * dx) - (ox * dy);
+    if (denominator == 0.0) {
+        // Parallel, so only touching if collinear, in which case the nearest touching point is one of the ends
+        std::optional<double> nearest = FirstIntersection(line, other.a);
+        for (std::optional<double> t : { FirstIntersection(line, other.b), Contains(other, line.a) ? std::optional(0.0) : std::nullopt }) {
+            if (t && (!nearest || *t < *nearest)) {
+                nearest = t;
+            }
+        }
+        return nearest;
+    }
+    double t = ((ox * (line.a.y - other.a.y)) - (oy * (line.a.x - other.a.x))) / denominator;
+    double u = ((dx * (line.a.y - other.a.y)) - (dy * (line.a.x - other.a.x))) / denominator;
+    if (t < 0.0 || t > 1.0 || u < 0.0 || u > 1.0) {
+        return std::nullopt;
+    }
+    return t;
+}
+
+/**
+ * Batch collision tests. Each shape is described by the i'th element of each of
+ * the component spans, e.g. Circle{ xs[i], ys[i], radii[i] }, and out[i] is set
+ * to 1 if Collides(query, shape) (or Contains(query, point)) is true, else 0.
+ * Results are identical to testing each shape individually, provided the caller
+ * and this library are both compiled either with or without FMA support, see
+ * SumOfSquares. All component spans must be the same size, and out must be at
+ * least that size.
+ *
+ * The fastest implementation supported by the CPU is chosen at runtime.
+ */
+enum class SimdLevel {
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+SimdLevel GetSimdLevel();
+// Used to compare implementations, the level is limited to that which the CPU supports, the applied level is returned
+SimdLevel SetSimdLevel(SimdLevel level);
+
+void CollidesMany(const Circle& query, std::span<const double> xs, std::span<const double> ys, std::span<const double> radii, std::span<uint8_t> out);
+void CollidesMany(const Rect& query, std::span<const double> lefts, std::span<const double> tops, std::span<const double> rights, std::span<const double> bottoms, std::span<uint8_t> out);
+void ContainsMany(const Circle& query, std::span<const double> xs, std::span<const double> ys, std::span<uint8_t> out);
+
 template<>
 class esd::Serialiser<Vec2> : public esd::ClassHelper<Vec2, double, double> {
 public:
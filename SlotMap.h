@@ -0,0 +1,216 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <vector>
+#include <memory>
+#include <optional>
+#include <limits>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+#include <concepts>
+#include <assert.h>
+
+namespace util {
+
+/**
+ * @brief The SlotMap class owns items by value in a pooled arena. Items never
+ * move once created, so raw pointers to them remain valid until the item is
+ * erased, and can be stored in containers such as SpatialMap and QuadTree in
+ * place of std::shared_ptr, without reference counting or an allocation per
+ * item.
+ *
+ * External references should use a Handle, which can always be safely tested
+ * for validity: the generation of a slot is incremented each time its item is
+ * erased, so a Handle to an erased item never refers to a later item that
+ * reuses the same slot.
+ *
+ * A slot whose generation reaches the maximum of Generation is retired rather
+ * than reused, so generations never wrap around to match a stale Handle. Each
+ * slot can therefore hold at most max(Generation) items over the life of the
+ * map. At most max(uint32_t) - 1 slots can be created, Emplace throws
+ * std::length_error once every slot is in use or retired.
+ */
+template <typename T, std::unsigned_integral Generation = uint32_t>
+class SlotMap {
+public:
+    struct Handle {
+        uint32_t index = std::numeric_limits<uint32_t>::max();
+        Generation generation = 0;
+
+        bool operator==(const Handle& other) const = default;
+    };
+
+    SlotMap() = default;
+    SlotMap(const SlotMap& other) = delete;
+    SlotMap& operator=(const SlotMap& other) = delete;
+    SlotMap(SlotMap&& other) = default;
+    SlotMap& operator=(SlotMap&& other) = default;
+
+    template <typename... Args>
+    Handle Emplace(Args&&... args)
+    {
+        uint32_t index;
+        if (!freeSlots_.empty()) {
+            index = freeSlots_.back();
+            freeSlots_.pop_back();
+        } else {
+            // The maximum index is reserved for a default constructed Handle
+            if (slotCount_ == std::numeric_limits<uint32_t>::max()) {
+                throw std::length_error("SlotMap has no slots left");
+            }
+            index = slotCount_++;
+            if (index % CHUNK_SIZE == 0) {
+                chunks_.push_back(std::make_unique<Slot[]>(CHUNK_SIZE));
+            }
+        }
+        Slot& slot = SlotAt(index);
+        assert(!slot.item_.has_value());
+        slot.item_.emplace(std::forward<Args>(args)...);
+        ++size_;
+        return { index, slot.generation_ };
+    }
+
+    /**
+     * @return The item, or nullptr if the handle's item has been erased.
+     */
+    T* Get(const Handle& handle)
+    {
+        Slot* slot = Find(handle);
+        return slot ? &slot->item_.value() : nullptr;
+    }
+
+    const T* Get(const Handle& handle) const
+    {
+        const Slot* slot = Find(handle);
+        return slot ? &slot->item_.value() : nullptr;
+    }
+
+    bool Contains(const Handle& handle) const
+    {
+        return Get(handle) != nullptr;
+    }
+
+    bool Erase(const Handle& handle)
+    {
+        if (Find(handle)) {
+            EraseAt(handle.index);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Erases every item for which predicate(item) returns true.
+     * @return The number of items erased.
+     */
+    template <typename Predicate>
+    size_t EraseIf(Predicate&& predicate)
+    {
+        size_t erased = 0;
+        for (uint32_t index = 0; index < slotCount_; ++index) {
+            Slot& slot = SlotAt(index);
+            if (slot.item_.has_value() && predicate(std::as_const(slot.item_.value()))) {
+                EraseAt(index);
+                ++erased;
+            }
+        }
+        return erased;
+    }
+
+    /**
+     * Calls action(handle, item) for each item, in slot order.
+     */
+    template <typename Action>
+    void ForEach(Action&& action)
+    {
+        for (uint32_t index = 0; index < slotCount_; ++index) {
+            Slot& slot = SlotAt(index);
+            if (slot.item_.has_value()) {
+                action(Handle{ index, slot.generation_ }, slot.item_.value());
+            }
+        }
+    }
+
+    template <typename Action>
+    void ForEach(Action&& action) const
+    {
+        for (uint32_t index = 0; index < slotCount_; ++index) {
+            const Slot& slot = SlotAt(index);
+            if (slot.item_.has_value()) {
+                action(Handle{ index, slot.generation_ }, slot.item_.value());
+            }
+        }
+    }
+
+    /**
+     * Destroys every item, invalidating every handle. Memory is retained.
+     */
+    void Clear()
+    {
+        for (uint32_t index = 0; index < slotCount_; ++index) {
+            if (SlotAt(index).item_.has_value()) {
+                EraseAt(index);
+            }
+        }
+    }
+
+    size_t Size() const
+    {
+        return size_;
+    }
+
+private:
+    // Chunks are never reallocated, so items never move
+    static constexpr uint32_t CHUNK_SIZE = 256;
+
+    struct Slot {
+        std::optional<T> item_;
+        Generation generation_ = 0;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    std::vector<uint32_t> freeSlots_;
+    uint32_t slotCount_ = 0;
+    size_t size_ = 0;
+
+    Slot& SlotAt(uint32_t index)
+    {
+        return chunks_[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    const Slot& SlotAt(uint32_t index) const
+    {
+        return chunks_[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    Slot* Find(const Handle& handle)
+    {
+        return const_cast<Slot*>(std::as_const(*this).Find(handle));
+    }
+
+    const Slot* Find(const Handle& handle) const
+    {
+        if (handle.index >= slotCount_) {
+            return nullptr;
+        }
+        const Slot& slot = SlotAt(handle.index);
+        return slot.item_.has_value() && slot.generation_ == handle.generation ? &slot : nullptr;
+    }
+
+    void EraseAt(uint32_t index)
+    {
+        Slot& slot = SlotAt(index);
+        slot.item_.reset();
+        ++slot.generation_;
+        // A slot at the last generation is retired, a further erase would wrap and revive stale handles
+        if (slot.generation_ != std::numeric_limits<Generation>::max()) {
+            freeSlots_.push_back(index);
+        }
+        --size_;
+    }
+};
+
+} // namespace util
+
+#endif // SLOTMAP_H
@@ -2,24 +2,77 @@
 #define SPATIALMAP_H
 
 #include "Shape.h"
+#include "Concepts.h"
+#include "RegionTable.h"
+#include "PackedShapes.h"
+#include "ThreadPool.h"
+#include "ContainerStats.h"
 
 #include <vector>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include <functional>
 #include <algorithm>
 #include <cmath>
-#include <unordered_map>
+#include <optional>
+#include <limits>
+#include <variant>
+#include <ranges>
+#include <assert.h>
 
 namespace util {
 
 template <typename T>
 concept SpatialMapCompatible = requires (T& t, const T& ct) {
-    { ct.GetLocation() } -> std::same_as<const Point&>;
+    { ct.GetLocation() } -> std::convertible_to<Point>;
     { ct.GetCollide() } -> Collidable;
     { ct.Exists() } -> std::same_as<bool>;
     { t.Move() } -> std::same_as<bool>;
 };
 
+/**
+ * Optionally, items can store their own index within their region, allowing
+ * SpatialMap::Erase to find them without a search. Only valid for items held
+ * in a single SpatialMap.
+ */
+template <typename T>
+concept SpatialMapIndexed = requires (T& t, const T& ct, size_t index) {
+    { t.SetSpatialMapIndex(index) };
+    { ct.GetSpatialMapIndex() } -> std::convertible_to<size_t>;
+};
+
+enum class RegionLayout {
+    // Each region stores only a pointer per item
+    Pointers,
+    // Each region also caches the collide of every item in packed arrays, so
+    // collision queries need not dereference items that do not collide
+    Packed,
+};
+
+/**
+ * Parameters for SpatialMap::SetAutoRegionSize. Occupancy is the mean number
+ * of items sharing a region with each item, so is weighted towards crowded
+ * regions, which dominate the cost of queries.
+ */
+struct AutoRegionSize {
+    // The region size is changed when occupancy drifts outside of this band
+    double minOccupancy = 2.0;
+    double maxOccupancy = 16.0;
+    // The occupancy aimed for when the region size is changed
+    double targetOccupancy = 6.0;
+    // Region size is never less than twice the max entity radius, so that a query
+    // for an entity never covers more than 3x3 regions
+    double minRegionSize = 0.0;
+    double maxRegionSize = std::numeric_limits<double>::infinity();
+    // Occupancy is sampled by MoveAndRemove, every sampleInterval calls
+    unsigned sampleInterval = 30;
+    // The number of calls to MoveAndRemove a rebuild is spread over
+    unsigned rebuildTicks = 8;
+};
+
 /**
  * @brief The SpatialMap class is meant to be an alternative to QuadTree.
  *
@@ -34,16 +87,61 @@ concept SpatialMapCompatible = requires (T& t, const T& ct) {
  *     for (auto& item : spatialMap.Items()) { ... };
  * ```
  *
+ * The storage of regions is a policy, see RegionTable.h. The default
+ * GridRegionTable keeps all regions in contiguous allocations, and if the map is
+ * constructed with bounds, regions within those bounds are found without any
+ * hashing. NodeRegionTable allocates each region individually.
+ *
+ * With RegionLayout::Packed, each region caches a copy of each item's collide.
+ * The cache is refreshed for every item during MoveAndRemove, so an item's
+ * collide must only change during its Move() call.
+ *
+ * Items are held by std::shared_ptr by default. Any pointer type can be used
+ * instead, e.g. T* into a SlotMap<T>, to avoid reference counting and separate
+ * allocations. Items held by non-owning pointers that MoveAndRemove drops
+ * because they no longer Exist() must then be erased from their owner. With
+ * move only pointers, e.g. std::unique_ptr<T>, SetAutoRegionSize is not
+ * available, and Nearest and KNearest return plain pointers to the items.
+ *
+ * Const queries may always run concurrently with each other. Between
+ * BeginEpoch() and EndEpoch() they may also run concurrently with Insert(),
+ * which stages items per thread rather than modifying the regions.
+ *
  * Future work may include fleshing out the iterators to allow for stl algorithm
  * compatability.
  */
-template <typename T>
-    requires SpatialMapCompatible<T>
+template <typename T, template <typename> typename RegionTable = GridRegionTable, RegionLayout Layout = RegionLayout::Pointers, typename ItemPointer = std::shared_ptr<T>>
+    requires SpatialMapCompatible<T> && PointerTo<ItemPointer, T>
 class SpatialMap {
+public:
+    // e.g. std::shared_ptr<const T> for std::shared_ptr<T>, or const T* for T*
+    using ConstItemPointer = typename std::pointer_traits<ItemPointer>::template rebind<const T>;
+    // Returned by Nearest and KNearest, a copy of the item's pointer, or a plain pointer if ItemPointer is move only
+    using ResultPointer = std::conditional_t<std::copyable<ItemPointer>, ItemPointer, T*>;
+    using ConstResultPointer = std::conditional_t<std::copyable<ItemPointer>, ConstItemPointer, const T*>;
+
 private:
+    using CollideType = std::decay_t<decltype(std::declval<const T&>().GetCollide())>;
     struct Region;
-    using MapType = std::unordered_map<uint64_t, Region>;
-    using ContainerType = std::vector<std::shared_ptr<T>>;
+    using MapType = RegionTable<Region>;
+    using ContainerType = std::vector<ItemPointer>;
+    // Packed regions test all of their items against a collider at once
+    struct CollisionMaskCache {
+        const Region* region = nullptr;
+        std::vector<uint8_t> collides;
+    };
+    using CollisionMaskType = std::conditional_t<Layout == RegionLayout::Packed, CollisionMaskCache, std::monostate>;
+    // Below this many items a region's batch setup costs more than it saves
+    static constexpr size_t BATCH_COLLISION_THRESHOLD = 8;
+    // Per chunk state of a single MoveAndRemove
+    struct SweepResult {
+        ContainerType copied;
+        std::vector<const T*> removed;
+        // Copied items that moved to a different region, and the key of that region
+        std::vector<std::pair<const T*, uint64_t>> relocated;
+        size_t items = 0;
+        size_t weightedItems = 0;
+    };
 
 public:
     ///
@@ -54,7 +152,7 @@ public:
     public:
         class RegionIterator {
         public:
-            explicit RegionIterator(MapType::iterator&& iter)
+            explicit RegionIterator(typename MapType::iterator&& iter)
                 : regionIter_(std::move(iter))
             {
             }
@@ -86,14 +184,14 @@ public:
             }
 
         private:
-            MapType::iterator regionIter_;
+            typename MapType::iterator regionIter_;
         };
 
         using iterator = RegionIterator;
         using value_type = Rect;
         using size_type = size_t;
 
-        RegionIteratorHelper(SpatialMap<T>& container)
+        RegionIteratorHelper(SpatialMap& container)
             : container_(container)
         {
         }
@@ -109,7 +207,7 @@ public:
         }
 
     private:
-        SpatialMap<T>& container_;
+        SpatialMap& container_;
     };
 
     class FilteredRegionIteratorHelper {
@@ -122,12 +220,12 @@ public:
                 return *this;
             }
 
-            static RegionIterator Begin(SpatialMap<T>& container, const Rect& regionFilter)
+            static RegionIterator Begin(SpatialMap& container, const Rect& regionFilter)
             {
                 return RegionIterator(container, regionFilter);
             }
 
-            static RegionIterator End(SpatialMap<T>& container, const Rect& regionFilter)
+            static RegionIterator End(SpatialMap& container, const Rect& regionFilter)
             {
                 return RegionIterator(regionFilter, container);
             }
@@ -152,8 +250,13 @@ public:
                 return *currentRegion_;
             }
 
+            const QueryCounters& Counters() const
+            {
+                return container_.queryCounters_;
+            }
+
         private:
-            SpatialMap<T>& container_;
+            SpatialMap& container_;
             const Rect& regionFilter_;
             int32_t minX_, maxX_, minY_, maxY_;
             MapType& map_;
@@ -161,7 +264,7 @@ public:
             int32_t x_, y_;
 
             // Begin constructor
-            RegionIterator(SpatialMap<T>& container, const Rect& regionFilter)
+            RegionIterator(SpatialMap& container, const Rect& regionFilter)
                 : container_(container)
                 , regionFilter_(regionFilter)
                 , map_(container.regions_)
@@ -171,11 +274,12 @@ public:
                 std::tie(maxX_, maxY_) = container_.GetCoordinate({ regionFilter_.right, regionFilter_.bottom });
                 x_ = minX_ - 1;
                 y_ = minY_;
+                container_.queryCounters_.AddQuery();
                 Next();
             }
 
             // End constructor
-            RegionIterator(const Rect& regionFilter, SpatialMap<T>& container)
+            RegionIterator(const Rect& regionFilter, SpatialMap& container)
                 : container_(container)
                 , regionFilter_(regionFilter)
                 , map_(container.regions_)
@@ -194,9 +298,9 @@ public:
                             return;
                         }
                     }
-                    auto key = Key();
-                    currentRegion_ = map_.count(key) > 0 ? &map_.at(key) : nullptr;
+                    currentRegion_ = map_.Find(Key());
                 } while (currentRegion_ == nullptr);
+                container_.queryCounters_.AddRegionsVisited();
             }
         };
 
@@ -204,7 +308,7 @@ public:
         using value_type = Rect;
         using size_type = size_t;
 
-        FilteredRegionIteratorHelper(SpatialMap<T>& container, const Rect& regionFilter)
+        FilteredRegionIteratorHelper(SpatialMap& container, const Rect& regionFilter)
             : container_(container)
             , regionFilter_(regionFilter)
         {
@@ -221,7 +325,7 @@ public:
         }
 
     private:
-        SpatialMap<T>& container_;
+        SpatialMap& container_;
         Rect regionFilter_;
     };
 
@@ -259,7 +363,7 @@ public:
                 return other.regionIter_ != regionIter_ && other.itemIter_ != itemIter_;
             }
 
-            std::shared_ptr<T>& operator*()
+            ItemPointer& operator*()
             {
                 return *itemIter_;
             }
@@ -291,10 +395,10 @@ public:
         };
 
         using iterator = ItemIterator;
-        using value_type = std::shared_ptr<T>;
+        using value_type = ItemPointer;
         using size_type = size_t;
 
-        ItemIteratorHelper(RegionIteratorHelperType&& regionIteratorHelper, SpatialMap<T>& container)
+        ItemIteratorHelper(RegionIteratorHelperType&& regionIteratorHelper, SpatialMap& container)
             : container_(container)
             , regionIteratorHelper_(std::move(regionIteratorHelper))
         {
@@ -317,7 +421,7 @@ public:
         }
 
     private:
-        SpatialMap<T>& container_;
+        SpatialMap& container_;
         RegionIteratorHelperType regionIteratorHelper_;
     };
 
@@ -347,7 +451,7 @@ public:
                 return other.regionIter_ != regionIter_ && other.itemIter_ != itemIter_;
             }
 
-            std::shared_ptr<T>& operator*()
+            ItemPointer& operator*()
             {
                 return *itemIter_;
             }
@@ -358,6 +462,7 @@ public:
             ContainerType::iterator itemIter_;
             ContainerType::iterator nullIter_;
             const ColliderType& collider_;
+            [[no_unique_address]] CollisionMaskType collisionMask_;
 
             // Begin
             explicit ItemIterator(RegionIteratorHelperType& regionIteratorHelper, const ColliderType& collider)
@@ -366,13 +471,14 @@ public:
                 , itemIter_{}
                 , nullIter_{}
                 , collider_(collider)
+                , collisionMask_{}
             {
                 if (regionIter_ != std::end(regionIteratorHelper_)) {
                     itemIter_ = std::begin(regionIter_.CurrentRegion().items_);
                 }
                 if (itemIter_ != nullIter_) {
                     IncrementRegionIfNecessary();
-                    if (itemIter_ != nullIter_ && !Collides(collider_, (*itemIter_)->GetCollide())) {
+                    if (itemIter_ != nullIter_ && !CurrentItemCollides()) {
                         SkipToNextValidItemIter();
                     }
                 }
@@ -385,6 +491,7 @@ public:
                 , itemIter_{}
                 , nullIter_{}
                 , collider_(collider)
+                , collisionMask_{}
             {
             }
 
@@ -393,7 +500,29 @@ public:
                 do {
                     ++itemIter_;
                     IncrementRegionIfNecessary();
-                } while (itemIter_ != nullIter_ && !Collides(collider_, (*itemIter_)->GetCollide()));
+                } while (itemIter_ != nullIter_ && !CurrentItemCollides());
+            }
+
+            bool CurrentItemCollides()
+            {
+                bool collides = TestCurrentItem();
+                regionIter_.Counters().AddItemTested(collides);
+                return collides;
+            }
+
+            bool TestCurrentItem()
+            {
+                const Region& region = regionIter_.CurrentRegion();
+                if constexpr (Layout == RegionLayout::Packed) {
+                    if (region.items_.size() >= BATCH_COLLISION_THRESHOLD) {
+                        if (collisionMask_.region != &region) {
+                            region.CollisionMask(collider_, collisionMask_.collides);
+                            collisionMask_.region = &region;
+                        }
+                        return collisionMask_.collides[static_cast<size_t>(itemIter_ - std::cbegin(region.items_))];
+                    }
+                }
+                return region.ItemCollides(itemIter_, collider_);
             }
 
             void IncrementRegionIfNecessary()
@@ -410,10 +539,10 @@ public:
         };
 
         using iterator = ItemIterator;
-        using value_type = std::shared_ptr<T>;
+        using value_type = ItemPointer;
         using size_type = size_t;
 
-        FilteredItemIteratorHelper(RegionIteratorHelperType&& regionIteratorHelper, SpatialMap<T>& container, const ColliderType& collider)
+        FilteredItemIteratorHelper(RegionIteratorHelperType&& regionIteratorHelper, SpatialMap& container, const ColliderType& collider)
             : container_(container)
             , regionIteratorHelper_(std::move(regionIteratorHelper))
             , collider_(collider)
@@ -437,16 +566,17 @@ public:
         }
 
     private:
-        SpatialMap<T>& container_;
+        SpatialMap& container_;
         RegionIteratorHelperType regionIteratorHelper_;
-        const ColliderType& collider_;
+        // Stored by value, the ItemsCollidingWith argument does not outlive the call
+        ColliderType collider_;
     };
 
     class ConstRegionIteratorHelper {
     public:
         class RegionIterator {
         public:
-            explicit RegionIterator(MapType::const_iterator&& iter)
+            explicit RegionIterator(typename MapType::const_iterator&& iter)
                 : regionIter_(std::move(iter))
             {
             }
@@ -478,14 +608,14 @@ public:
             }
 
         private:
-            MapType::const_iterator regionIter_;
+            typename MapType::const_iterator regionIter_;
         };
 
         using const_iterator = RegionIterator;
         using value_type = Rect;
         using size_type = size_t;
 
-        ConstRegionIteratorHelper(const SpatialMap<T>& container)
+        ConstRegionIteratorHelper(const SpatialMap& container)
             : container_(container)
         {
         }
@@ -511,7 +641,7 @@ public:
         }
 
     private:
-        const SpatialMap<T>& container_;
+        const SpatialMap& container_;
     };
 
     class ConstFilteredRegionIteratorHelper {
@@ -524,12 +654,12 @@ public:
                 return *this;
             }
 
-            static RegionIterator CBegin(const SpatialMap<T>& container, const Rect& regionFilter)
+            static RegionIterator CBegin(const SpatialMap& container, const Rect& regionFilter)
             {
                 return RegionIterator(container, regionFilter);
             }
 
-            static RegionIterator CEnd(const SpatialMap<T>& container, const Rect& regionFilter)
+            static RegionIterator CEnd(const SpatialMap& container, const Rect& regionFilter)
             {
                 return RegionIterator(regionFilter, container);
             }
@@ -554,8 +684,13 @@ public:
                 return *currentRegion_;
             }
 
+            const QueryCounters& Counters() const
+            {
+                return container_.queryCounters_;
+            }
+
         private:
-            const SpatialMap<T>& container_;
+            const SpatialMap& container_;
             const Rect& regionFilter_;
             int32_t minX_, maxX_, minY_, maxY_;
             const MapType& map_;
@@ -563,7 +698,7 @@ public:
             int32_t x_, y_;
 
             // Begin constructor
-            RegionIterator(const SpatialMap<T>& container, const Rect& regionFilter)
+            RegionIterator(const SpatialMap& container, const Rect& regionFilter)
                 : container_(container)
                 , regionFilter_(regionFilter)
                 , map_(container.regions_)
@@ -573,11 +708,12 @@ public:
                 std::tie(maxX_, maxY_) = container_.GetCoordinate({ regionFilter_.right, regionFilter_.bottom });
                 x_ = minX_ - 1;
                 y_ = minY_;
+                container_.queryCounters_.AddQuery();
                 Next();
             }
 
             // End constructor
-            RegionIterator(const Rect& regionFilter, const SpatialMap<T>& container)
+            RegionIterator(const Rect& regionFilter, const SpatialMap& container)
                 : container_(container)
                 , regionFilter_(regionFilter)
                 , map_(container.regions_)
@@ -596,9 +732,9 @@ public:
                             return;
                         }
                     }
-                    auto key = Key();
-                    currentRegion_ = map_.count(key) > 0 ? &map_.at(key) : nullptr;
+                    currentRegion_ = map_.Find(Key());
                 } while (currentRegion_ == nullptr);
+                container_.queryCounters_.AddRegionsVisited();
             }
         };
 
@@ -606,7 +742,7 @@ public:
         using value_type = Rect;
         using size_type = size_t;
 
-        ConstFilteredRegionIteratorHelper(const SpatialMap<T>& container, const Rect& regionFilter)
+        ConstFilteredRegionIteratorHelper(const SpatialMap& container, const Rect& regionFilter)
             : container_(container)
             , regionFilter_(regionFilter)
         {
@@ -633,7 +769,7 @@ public:
         }
 
     private:
-        const SpatialMap<T>& container_;
+        const SpatialMap& container_;
         Rect regionFilter_;
     };
 
@@ -703,10 +839,10 @@ public:
         };
 
         using iterator = ItemIterator;
-        using value_type = std::shared_ptr<T>;
+        using value_type = ItemPointer;
         using size_type = size_t;
 
-        ConstItemIteratorHelper(ConstRegionIteratorHelperType&& regionIteratorHelper, const SpatialMap<T>& container)
+        ConstItemIteratorHelper(ConstRegionIteratorHelperType&& regionIteratorHelper, const SpatialMap& container)
             : container_(container)
             , regionIteratorHelper_(std::move(regionIteratorHelper))
         {
@@ -733,7 +869,7 @@ public:
         }
 
     private:
-        const SpatialMap<T>& container_;
+        const SpatialMap& container_;
         ConstRegionIteratorHelperType regionIteratorHelper_;
     };
 
@@ -774,6 +910,7 @@ public:
             ContainerType::const_iterator itemIter_;
             ContainerType::const_iterator nullIter_;
             const ColliderType& collider_;
+            [[no_unique_address]] CollisionMaskType collisionMask_;
 
             // Begin
             explicit ItemIterator(const ConstRegionIteratorHelperType& regionIteratorHelper, const ColliderType& collider)
@@ -782,13 +919,14 @@ public:
                 , itemIter_{}
                 , nullIter_{}
                 , collider_(collider)
+                , collisionMask_{}
             {
                 if (regionIter_ != std::cend(regionIteratorHelper_)) {
                     itemIter_ = std::cbegin(regionIter_.CurrentRegion().items_);
                 }
                 if (itemIter_ != nullIter_) {
                     IncrementRegionIfNecessary();
-                    if (itemIter_ != nullIter_ && !Collides(collider_, (*itemIter_)->GetCollide())) {
+                    if (itemIter_ != nullIter_ && !CurrentItemCollides()) {
                         SkipToNextValidItemIter();
                     }
                 }
@@ -801,6 +939,7 @@ public:
                 , itemIter_{}
                 , nullIter_{}
                 , collider_(collider)
+                , collisionMask_{}
             {
             }
 
@@ -809,7 +948,29 @@ public:
                 do {
                     ++itemIter_;
                     IncrementRegionIfNecessary();
-                } while (itemIter_ != nullIter_ && !Collides(collider_, (*itemIter_)->GetCollide()));
+                } while (itemIter_ != nullIter_ && !CurrentItemCollides());
+            }
+
+            bool CurrentItemCollides()
+            {
+                bool collides = TestCurrentItem();
+                regionIter_.Counters().AddItemTested(collides);
+                return collides;
+            }
+
+            bool TestCurrentItem()
+            {
+                const Region& region = regionIter_.CurrentRegion();
+                if constexpr (Layout == RegionLayout::Packed) {
+                    if (region.items_.size() >= BATCH_COLLISION_THRESHOLD) {
+                        if (collisionMask_.region != &region) {
+                            region.CollisionMask(collider_, collisionMask_.collides);
+                            collisionMask_.region = &region;
+                        }
+                        return collisionMask_.collides[static_cast<size_t>(itemIter_ - std::cbegin(region.items_))];
+                    }
+                }
+                return region.ItemCollides(itemIter_, collider_);
             }
 
             void IncrementRegionIfNecessary()
@@ -826,10 +987,10 @@ public:
         };
 
         using iterator = ItemIterator;
-        using value_type = std::shared_ptr<T>;
+        using value_type = ItemPointer;
         using size_type = size_t;
 
-        ConstFilteredItemIteratorHelper(ConstRegionIteratorHelperType&& regionIteratorHelper, const SpatialMap<T>& container, const ColliderType& collider)
+        ConstFilteredItemIteratorHelper(ConstRegionIteratorHelperType&& regionIteratorHelper, const SpatialMap& container, const ColliderType& collider)
             : container_(container)
             , regionIteratorHelper_(std::move(regionIteratorHelper))
             , collider_(collider)
@@ -857,9 +1018,9 @@ public:
         }
 
     private:
-        const SpatialMap<T>& container_;
+        const SpatialMap& container_;
         ConstRegionIteratorHelperType regionIteratorHelper_;
-        const ColliderType& collider_;
+        ColliderType collider_;
     };
 
     ///
@@ -868,12 +1029,25 @@ public:
 
     SpatialMap(double maxEntityRadius, double regionSize)
         : regions_{}
+        , bounds_(std::nullopt)
         , maxEntityRadius_(maxEntityRadius)
         , regionSize_(regionSize)
         , currentIterators_(0)
     {
     }
 
+    /**
+     * Regions within bounds are stored in a dense grid, so are found by index
+     * rather than by hashing. Items outside of the bounds are still supported,
+     * their regions are stored in a hash table instead.
+     */
+    SpatialMap(const Rect& bounds, double maxEntityRadius, double regionSize)
+        requires requires (MapType& table) { table.SetBounds(0, 0, 0, 0); }
+        : SpatialMap(maxEntityRadius, regionSize)
+    {
+        SetBounds(bounds);
+    }
+
     RegionIteratorHelper Regions()
     {
         return RegionIteratorHelper(*this);
@@ -892,14 +1066,14 @@ public:
     ItemIteratorHelper<FilteredRegionIteratorHelper> Items(const Rect& regionFilter)
     {
         // increase bounding rect size because entities might be in a neighboring region, but overlap into our filter area
-        return ItemIteratorHelper(FilteredRegionIteratorHelper(*this, BoundingRect(regionFilter, maxEntityRadius_)), *this);
+        return ItemIteratorHelper(FilteredRegionIteratorHelper(*this, QueryArea(regionFilter)), *this);
     }
 
     template <typename ColliderType>
         requires Collidable<ColliderType>
     FilteredItemIteratorHelper<FilteredRegionIteratorHelper, ColliderType> ItemsCollidingWith(ColliderType itemFilter)
     {
-        return FilteredItemIteratorHelper(FilteredRegionIteratorHelper(*this, BoundingRect(itemFilter, maxEntityRadius_)), *this, itemFilter);
+        return FilteredItemIteratorHelper(FilteredRegionIteratorHelper(*this, QueryArea(itemFilter)), *this, itemFilter);
     }
 
     ConstRegionIteratorHelper Regions() const
@@ -920,14 +1094,14 @@ public:
     ConstItemIteratorHelper<ConstFilteredRegionIteratorHelper> Items(const Rect& regionFilter) const
     {
         // increase bounding rect size because entities might be in a neighboring region, but overlap into our filter area
-        return ConstItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, BoundingRect(regionFilter, maxEntityRadius_)), *this);
+        return ConstItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, QueryArea(regionFilter)), *this);
     }
 
     template <typename ColliderType>
         requires Collidable<ColliderType>
     ConstFilteredItemIteratorHelper<ConstFilteredRegionIteratorHelper, ColliderType> ItemsCollidingWith(ColliderType itemFilter) const
     {
-        return ConstFilteredItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, BoundingRect(itemFilter, maxEntityRadius_)), *this, itemFilter);
+        return ConstFilteredItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, QueryArea(itemFilter)), *this, itemFilter);
     }
 
     ConstRegionIteratorHelper CRegions() const
@@ -948,55 +1122,347 @@ public:
     ConstItemIteratorHelper<ConstFilteredRegionIteratorHelper> CItems(const Rect& regionFilter) const
     {
         // increase bounding rect size because entities might be in a neighboring region, but overlap into our filter area
-        return ConstItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, BoundingRect(regionFilter, maxEntityRadius_)), *this);
+        return ConstItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, QueryArea(regionFilter)), *this);
     }
 
     template <typename ColliderType>
         requires Collidable<ColliderType>
     ConstFilteredItemIteratorHelper<ConstFilteredRegionIteratorHelper, ColliderType> CItemsCollidingWith(ColliderType itemFilter) const
     {
-        return ConstFilteredItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, BoundingRect(itemFilter, maxEntityRadius_)), *this, itemFilter);
+        return ConstFilteredItemIteratorHelper(ConstFilteredRegionIteratorHelper(*this, QueryArea(itemFilter)), *this, itemFilter);
+    }
+
+    /**
+     * Equivalent to calling ItemsCollidingWith for each query, but regions
+     * touched by several queries are looked up once, and regions are visited
+     * in key order rather than per query. action(queryIndex, item) is called
+     * once for each colliding pair, grouped by region.
+     */
+    template <std::ranges::random_access_range Queries, typename Action>
+        requires Collidable<std::ranges::range_value_t<Queries>>
+              && std::invocable<Action&, size_t, ItemPointer&>
+    void QueryBatch(const Queries& queries, Action&& action)
+    {
+        OnBeginIteration();
+        QueryBatch(*this, queries, action);
+        OnEndIteration();
+    }
+
+    template <std::ranges::random_access_range Queries, typename Action>
+        requires Collidable<std::ranges::range_value_t<Queries>>
+              && std::invocable<Action&, size_t, const T&>
+    void QueryBatch(const Queries& queries, Action&& action) const
+    {
+        QueryBatch(*this, queries, [&](size_t queryIndex, const ItemPointer& item)
+        {
+            action(queryIndex, std::as_const(*item));
+        });
+    }
+
+    /**
+     * Calls action(a, b) once for every pair of items whose collides collide.
+     * Each region is tested against itself and only the neighbouring regions
+     * "after" it (a half-neighbourhood stencil), so no pair is tested twice.
+     */
+    template <typename Action>
+        requires std::invocable<Action&, ItemPointer&, ItemPointer&>
+    void ForEachCollidingPair(Action&& action)
+    {
+        OnBeginIteration();
+        for (auto& [ key, region ] : regions_) {
+            ForEachCollidingPair(*this, region, action);
+        }
+        OnEndIteration();
+    }
+
+    template <typename Action>
+        requires std::invocable<Action&, const T&, const T&>
+    void ForEachCollidingPair(Action&& action) const
+    {
+        for (const auto& [ key, region ] : regions_) {
+            ForEachCollidingPair(*this, region, [&](const ItemPointer& a, const ItemPointer& b)
+            {
+                action(std::as_const(*a), std::as_const(*b));
+            });
+        }
+    }
+
+    /**
+     * As ForEachCollidingPair, but regions are split between the threads of the
+     * pool, so action(a, b, chunkIndex) is called concurrently. chunkIndex is
+     * less than threads.ThreadCount() and is never used by two threads at once,
+     * so can index per-thread results.
+     */
+    template <typename Action>
+        requires std::invocable<Action&, const T&, const T&, size_t>
+    void ForEachCollidingPair(ThreadPool& threads, Action&& action) const
+    {
+        std::vector<const Region*> regions;
+        regions.reserve(regions_.Size());
+        for (const auto& [ key, region ] : regions_) {
+            regions.push_back(&region);
+        }
+
+        threads.ParallelFor(regions.size(), [&](size_t begin, size_t end, size_t chunk)
+        {
+            for (size_t i = begin; i < end; ++i) {
+                ForEachCollidingPair(*this, *regions[i], [&](const ItemPointer& a, const ItemPointer& b)
+                {
+                    action(std::as_const(*a), std::as_const(*b), chunk);
+                });
+            }
+        });
+    }
+
+    /**
+     * @return Up to k items whose locations are closest to point, nearest first,
+     * ignoring items further than maxDistance away. Regions are searched in
+     * rings outward from the point, stopping once no unsearched region could
+     * contain a closer item.
+     */
+    std::vector<ResultPointer> KNearest(const Point& point, size_t k, double maxDistance = std::numeric_limits<double>::infinity())
+    {
+        std::vector<ResultPointer> nearest;
+        for (const auto& candidate : FindNearest(point, k, maxDistance)) {
+            nearest.push_back(ToResult<ResultPointer>(*candidate.item));
+        }
+        return nearest;
+    }
+
+    std::vector<ConstResultPointer> KNearest(const Point& point, size_t k, double maxDistance = std::numeric_limits<double>::infinity()) const
+    {
+        std::vector<ConstResultPointer> nearest;
+        for (const auto& candidate : FindNearest(point, k, maxDistance)) {
+            nearest.push_back(ToResult<ConstResultPointer>(*candidate.item));
+        }
+        return nearest;
+    }
+
+    /**
+     * @return The item whose location is closest to point, or nullptr if there
+     * are no items within maxDistance.
+     */
+    ResultPointer Nearest(const Point& point, double maxDistance = std::numeric_limits<double>::infinity())
+    {
+        auto nearest = FindNearest(point, 1, maxDistance);
+        return nearest.empty() ? nullptr : ToResult<ResultPointer>(*nearest.front().item);
+    }
+
+    ConstResultPointer Nearest(const Point& point, double maxDistance = std::numeric_limits<double>::infinity()) const
+    {
+        auto nearest = FindNearest(point, 1, maxDistance);
+        return nearest.empty() ? nullptr : ToResult<ConstResultPointer>(*nearest.front().item);
+    }
+
+    /**
+     * Calls action(item, distance) for each item whose collide the ray touches,
+     * nearest first, where distance is how far along the ray from ray.a the
+     * item is first touched. Rather than searching the ray's bounding rect, the
+     * regions the ray passes through are walked in order (Amanatides & Woo),
+     * each along with the regions within maxEntityRadius of it. Hits are
+     * reported as soon as the walk has passed them, so with firstHitOnly the
+     * walk ends at the region holding the first hit.
+     */
+    template <typename Action>
+        requires std::invocable<Action&, const T&, double>
+    void RayCast(const Line& ray, Action&& action, bool firstHitOnly = false) const
+    {
+        queryCounters_.AddQuery();
+        if (regions_.Size() == 0) {
+            return;
+        }
+
+        const double dx = ray.b.x - ray.a.x;
+        const double dy = ray.b.y - ray.a.y;
+        const double length = std::sqrt((dx * dx) + (dy * dy));
+        // Items may overhang into the ray's path from regions up to this many away
+        const int64_t reach = static_cast<int64_t>(std::floor(maxEntityRadius_ / regionSize_)) + 1;
+
+        // Min-heap of items touched by the ray but not yet reported
+        std::vector<RayHit> hits;
+        auto visit = [&](int64_t x, int64_t y)
+        {
+            if (x >= std::numeric_limits<int32_t>::min() && x <= std::numeric_limits<int32_t>::max()
+             && y >= std::numeric_limits<int32_t>::min() && y <= std::numeric_limits<int32_t>::max()) {
+                if (const Region* region = regions_.Find(GetCoordinateKey({ static_cast<int32_t>(x), static_cast<int32_t>(y) }))) {
+                    queryCounters_.AddRegionsVisited();
+                    for (auto item = std::cbegin(region->items_); item != std::cend(region->items_); ++item) {
+                        auto fraction = FirstIntersection(ray, region->CollideOf(item));
+                        queryCounters_.AddItemTested(fraction.has_value());
+                        if (fraction) {
+                            hits.push_back({ *fraction, &*item });
+                            std::push_heap(std::begin(hits), std::end(hits), std::greater<>{});
+                        }
+                    }
+                }
+            }
+        };
+
+        const auto [ startX, startY ] = GetCoordinate(ray.a);
+        int64_t x = startX;
+        int64_t y = startY;
+        const int64_t stepX = dx < 0.0 ? -1 : 1;
+        const int64_t stepY = dy < 0.0 ? -1 : 1;
+        // The fraction along the ray at which it next crosses into a new column or row, and between each crossing
+        double nextX = dx == 0.0 ? std::numeric_limits<double>::infinity() : (((x + (stepX > 0 ? 1 : 0)) * regionSize_) - ray.a.x) / dx;
+        double nextY = dy == 0.0 ? std::numeric_limits<double>::infinity() : (((y + (stepY > 0 ? 1 : 0)) * regionSize_) - ray.a.y) / dy;
+        const double deltaX = dx == 0.0 ? std::numeric_limits<double>::infinity() : regionSize_ / std::abs(dx);
+        const double deltaY = dy == 0.0 ? std::numeric_limits<double>::infinity() : regionSize_ / std::abs(dy);
+
+        std::optional<std::pair<int64_t, int64_t>> previous;
+        while (true) {
+            // Consecutive neighbourhoods overlap, only regions new to this one need visiting
+            for (int64_t neighbourX = x - reach; neighbourX <= x + reach; ++neighbourX) {
+                for (int64_t neighbourY = y - reach; neighbourY <= y + reach; ++neighbourY) {
+                    if (!previous || std::abs(neighbourX - previous->first) > reach || std::abs(neighbourY - previous->second) > reach) {
+                        visit(neighbourX, neighbourY);
+                    }
+                }
+            }
+
+            // Every item touched before the ray leaves this region has now been found
+            const double leave = std::min({ nextX, nextY, 1.0 });
+            while (!hits.empty() && hits.front().fraction <= leave) {
+                std::pop_heap(std::begin(hits), std::end(hits), std::greater<>{});
+                action(std::as_const(**hits.back().item), hits.back().fraction * length);
+                hits.pop_back();
+                if (firstHitOnly) {
+                    return;
+                }
+            }
+
+            if (leave >= 1.0) {
+                break;
+            }
+            previous = { x, y };
+            if (nextX < nextY) {
+                x += stepX;
+                nextX += deltaX;
+            } else {
+                y += stepY;
+                nextY += deltaY;
+            }
+        }
     }
 
-    void Insert(const std::shared_ptr<T>& item)
+    void Insert(const ItemPointer& item)
     {
-        if (currentIterators_ != 0) {
+        if (InEpoch()) {
+            StagingBuffer().push_back(item);
+        } else if (currentIterators_ != 0) {
             itemsAddedDuringIteration_.push_back(item);
         } else {
-            RegionAt(item->GetLocation()).items_.push_back(item);
+            CopyToRebuild(item);
+            RegionAt(item->GetLocation()).PushBack(item);
         }
     }
 
-    void Insert(std::shared_ptr<T>&& item)
+    void Insert(ItemPointer&& item)
     {
-        if (currentIterators_ != 0) {
+        if (InEpoch()) {
+            StagingBuffer().push_back(std::move(item));
+        } else if (currentIterators_ != 0) {
             itemsAddedDuringIteration_.push_back(std::move(item));
         } else {
-            RegionAt(item->GetLocation()).items_.push_back(std::move(item));
+            CopyToRebuild(item);
+            Place(std::move(item));
         }
     }
 
-    void Erase(const std::shared_ptr<T>& toErase)
+    /**
+     * Freezes the regions until EndEpoch(). During an epoch any number of
+     * threads may run const queries (e.g. CItemsCollidingWith) and Insert()
+     * concurrently, without locks on the query path. Inserted items are staged
+     * in a buffer per thread, are not visible to queries or Size(), and are
+     * added to the map at EndEpoch(). No other non-const functions may be
+     * called during an epoch.
+     */
+    void BeginEpoch()
     {
-        std::vector<std::shared_ptr<T>>& container = RegionAt(toErase->GetLocation()).items_;
-        container.erase(std::remove_if(std::begin(container), std::end(container), [&](const auto& x) -> bool { return x.get() == toErase.get();}), std::end(container));
+        assert(!InEpoch() && currentIterators_ == 0);
+        epoch_ = std::make_unique<Epoch>();
+        epoch_->id = ++epochCounter;
+    }
+
+    /**
+     * Must not be called concurrently with any other function. Staged items are
+     * inserted grouped by the thread that staged them.
+     */
+    void EndEpoch()
+    {
+        assert(InEpoch());
+        std::unique_ptr<Epoch> epoch = std::move(epoch_);
+        for (auto& [ thread, staged ] : epoch->buffers) {
+            for (auto& item : staged) {
+                Insert(std::move(item));
+            }
+        }
+    }
+
+    bool InEpoch() const
+    {
+        return epoch_ != nullptr;
+    }
+
+    /**
+     * Constant time if T is SpatialMapIndexed, otherwise linear in the number of
+     * items in the item's region. Does not preserve the order of items within
+     * the region, and reclaims the region if it becomes empty.
+     */
+    void Erase(const ItemPointer& toErase)
+    {
+        assert(!InEpoch());
+        uint64_t key = GetCoordinateKey(GetCoordinate(toErase->GetLocation()));
+        Region* region = regions_.Find(key);
+        if (!region) {
+            return;
+        }
+
+        const T* target = std::to_address(toErase);
+        auto isTarget = [&](size_t index) { return index < region->items_.size() && std::to_address(region->items_[index]) == target; };
+        size_t index = region->items_.size();
+        if constexpr (SpatialMapIndexed<T>) {
+            index = static_cast<size_t>(target->GetSpatialMapIndex());
+        }
+        if (!isTarget(index)) {
+            // Not indexed, or indexed by a different container
+            auto iter = std::find_if(std::begin(region->items_), std::end(region->items_), [&](const auto& item) { return std::to_address(item) == target; });
+            index = static_cast<size_t>(iter - std::begin(region->items_));
+        }
+        if (isTarget(index)) {
+            region->SwapAndPop(index);
+            OnRemoved(target);
+        }
+
+        // Regions cannot be erased while they are being iterated
+        if (region->items_.empty() && currentIterators_ == 0) {
+            regions_.Erase(key);
+        }
     }
 
     void Clear()
     {
-        regions_.clear();
+        assert(!InEpoch());
+        regions_.Clear();
+        retired_.Clear();
+        retiredCopies_.clear();
+        rebuild_.reset();
     }
 
     void RemoveIf(const std::function<bool(const T& item)>& predicate)
     {
         OnBeginIteration();
-        std::erase_if(regions_, [&](auto& iter) -> bool
+        regions_.EraseIf([&](auto& iter) -> bool
         {
             auto& [ key, region ] = iter;
-            region.items_.erase(std::remove_if(std::begin(region.items_), std::end(region.items_), [&](const auto& item) -> bool
+            region.EraseIf([&](const auto& item) -> bool
                 {
-                    return predicate(*item);
-                }), std::end(region.items_));
+                    bool remove = predicate(*item);
+                    if (remove) {
+                        OnRemoved(std::to_address(item));
+                    }
+                    return remove;
+                });
             return region.items_.empty();
         });
         OnEndIteration();
@@ -1004,32 +1470,117 @@ public:
 
     void MoveAndRemove()
     {
+        BeginSweep();
+        SweepResult result;
+        ContainerType migrated;
         OnBeginIteration();
 
-        std::erase_if(regions_, [&](auto& pair) -> bool
+        regions_.EraseIf([&](auto& pair) -> bool
         {
             auto& [ key, region ] = pair;
-
-            region.items_.erase(std::remove_if(std::begin(region.items_), std::end(region.items_), [&](auto& item) -> bool
+            MoveAndRemoveItems(region, result, [&](ItemPointer&& item)
             {
-                bool removeItemCompletely = !item->Exists();
-                bool movedToDifferentRegion = !removeItemCompletely && item->Move() && GetCoordinate(item->GetLocation()) != region.coordinates_;
-
-                if (movedToDifferentRegion) {
-                    Insert(std::move(item));
-                }
-                return removeItemCompletely || movedToDifferentRegion;
-            }), std::end(region.items_));
-
+                migrated.push_back(std::move(item));
+            });
             return region.items_.empty();
         });
 
+        EndSweep(std::span(&result, 1));
+        OnEndIteration();
+        for (auto& item : migrated) {
+            Place(std::move(item));
+        }
+    }
+
+    /**
+     * As MoveAndRemove, but regions are split between the threads of the pool,
+     * so Exists() and Move() are called concurrently for items in different
+     * regions, and must not modify other items or this container. Items that
+     * move to a different region are buffered per chunk of regions and
+     * inserted afterwards in region order, so the result does not depend on
+     * the number of threads.
+     */
+    void MoveAndRemove(ThreadPool& threads)
+    {
+        BeginSweep();
+        std::vector<Region*> regions;
+        regions.reserve(regions_.Size());
+        for (auto& [ key, region ] : regions_) {
+            regions.push_back(&region);
+        }
+
+        std::vector<ContainerType> migrating(threads.ThreadCount());
+        std::vector<SweepResult> results(threads.ThreadCount());
+        OnBeginIteration();
+        threads.ParallelFor(regions.size(), [&](size_t begin, size_t end, size_t chunk)
+        {
+            ContainerType& migrated = migrating[chunk];
+            for (size_t i = begin; i < end; ++i) {
+                MoveAndRemoveItems(*regions[i], results[chunk], [&](ItemPointer&& item)
+                {
+                    migrated.push_back(std::move(item));
+                });
+            }
+        });
+        regions_.EraseIf([](const auto& pair) -> bool
+        {
+            return pair.second.items_.empty();
+        });
+        EndSweep(results);
         OnEndIteration();
+
+        for (auto& migrated : migrating) {
+            for (auto& item : migrated) {
+                Place(std::move(item));
+            }
+        }
+    }
+
+    /**
+     * Lets MoveAndRemove choose the region size, based on how crowded regions
+     * are, so that the map stays efficient as the density of items changes.
+     * Rather than rebuilding the map at once, as SetRegionSize does, items are
+     * copied into the new regions over several calls to MoveAndRemove, and the
+     * old regions are released over several more. Queries use the current
+     * regions until the new ones are complete.
+     *
+     * Passing std::nullopt disables automatic sizing, and abandons any rebuild
+     * in progress.
+     *
+     * Only available if ItemPointer is copyable, as the new regions hold a copy
+     * of each item's pointer until they replace the current regions.
+     */
+    void SetAutoRegionSize(const std::optional<AutoRegionSize>& params)
+        requires std::copyable<ItemPointer>
+    {
+        autoRegionSize_ = params;
+        ticksSinceSample_ = 0;
+        if (!autoRegionSize_) {
+            rebuild_.reset();
+        }
+    }
+
+    double RegionSize() const
+    {
+        return regionSize_;
+    }
+
+    /**
+     * @return true while items are being copied into regions of a new size.
+     */
+    bool Rebuilding() const
+    {
+        return rebuild_ != nullptr;
     }
 
     void SetRegionSize(double newRegionSize)
     {
-        SpatialMap<T> temp(maxEntityRadius_, newRegionSize);
+        assert(!InEpoch());
+        rebuild_.reset();
+        SpatialMap temp(maxEntityRadius_, newRegionSize);
+        if (bounds_.has_value()) {
+            temp.SetBounds(bounds_.value());
+        }
         for (auto& item : Items()) {
             temp.Insert(std::move(item));
         }
@@ -1048,12 +1599,42 @@ public:
 
     size_t RegionCount() const
     {
-        return regions_.size();
+        return regions_.Size();
+    }
+
+    /**
+     * @return A snapshot of the map's regions and memory use, along with the
+     * totals for its queries since the last ResetQueryStats(). Regions are
+     * visited by queries over an area, e.g. ItemsCollidingWith, QueryBatch,
+     * KNearest and RayCast.
+     */
+    ContainerStats GetStats() const
+    {
+        ContainerStats stats;
+        stats.depth = 1;
+        for (const auto& [ key, region ] : regions_) {
+            stats.AddRegion(region.items_.size());
+        }
+        stats.items += itemsAddedDuringIteration_.size();
+        stats.bytesAllocated = BytesAllocated(regions_) + BytesAllocated(retired_) + (itemsAddedDuringIteration_.capacity() * sizeof(ItemPointer));
+        if (rebuild_) {
+            stats.bytesAllocated += rebuild_->target->GetStats().bytesAllocated + BytesAllocated(rebuild_->copies);
+        }
+        stats.bytesAllocated += BytesAllocated(retiredCopies_);
+        stats.queries = queryCounters_.Get();
+        return stats;
+    }
+
+    void ResetQueryStats()
+    {
+        queryCounters_.Reset();
     }
 
 private:
     struct Region {
         ContainerType items_ {};
+        // Parallel to items_ when using RegionLayout::Packed
+        [[ no_unique_address ]] std::conditional_t<Layout == RegionLayout::Packed, PackedShapes<CollideType>, std::monostate> collides_ {};
         Rect area_;
         std::pair<int32_t, int32_t> coordinates_;
 
@@ -1062,19 +1643,598 @@ private:
             , coordinates_(coordinates)
         {
         }
+
+        /**
+         * Regions that are not where the map finds the item, i.e. those of a
+         * rebuild in progress or retired by one, must not set its index.
+         */
+        void PushBack(ItemPointer&& item, bool setIndex = true)
+        {
+            if constexpr (Layout == RegionLayout::Packed) {
+                collides_.PushBack(item->GetCollide());
+            }
+            if constexpr (SpatialMapIndexed<T>) {
+                if (setIndex) {
+                    item->SetSpatialMapIndex(items_.size());
+                }
+            }
+            items_.push_back(std::move(item));
+        }
+
+        /**
+         * Replaces the item at index with the last item, so does not preserve
+         * the order of items.
+         */
+        void SwapAndPop(size_t index, bool setIndex = true)
+        {
+            size_t last = items_.size() - 1;
+            if (index != last) {
+                items_[index] = std::move(items_[last]);
+                if constexpr (Layout == RegionLayout::Packed) {
+                    collides_.Copy(last, index);
+                }
+                if constexpr (SpatialMapIndexed<T>) {
+                    if (setIndex) {
+                        items_[index]->SetSpatialMapIndex(index);
+                    }
+                }
+            }
+            items_.pop_back();
+            if constexpr (Layout == RegionLayout::Packed) {
+                collides_.Resize(last);
+            }
+        }
+
+        void PushBack(const ItemPointer& item)
+        {
+            PushBack(ItemPointer(item));
+        }
+
+        /**
+         * Removes the item, found by address so that it is never dereferenced,
+         * from a region that does not set indices.
+         */
+        void Drop(const T* item)
+        {
+            auto iter = std::find_if(std::begin(items_), std::end(items_), [&](const auto& candidate) { return std::to_address(candidate) == item; });
+            if (iter != std::end(items_)) {
+                SwapAndPop(static_cast<size_t>(iter - std::begin(items_)), false);
+            }
+        }
+
+        /**
+         * Preserves the order of the remaining items. If refresh is true the
+         * state cached for each remaining item (collide and index) is updated.
+         */
+        template <typename Predicate>
+        void EraseIf(Predicate&& predicate, bool refresh = false)
+        {
+            size_t kept = 0;
+            for (size_t i = 0; i < items_.size(); ++i) {
+                if (!predicate(items_[i])) {
+                    if (kept != i) {
+                        items_[kept] = std::move(items_[i]);
+                    }
+                    if constexpr (SpatialMapIndexed<T>) {
+                        if (refresh || kept != i) {
+                            items_[kept]->SetSpatialMapIndex(kept);
+                        }
+                    }
+                    if constexpr (Layout == RegionLayout::Packed) {
+                        if (refresh) {
+                            collides_.Set(kept, items_[kept]->GetCollide());
+                        } else if (kept != i) {
+                            collides_.Copy(i, kept);
+                        }
+                    }
+                    ++kept;
+                }
+            }
+            items_.resize(kept);
+            if constexpr (Layout == RegionLayout::Packed) {
+                collides_.Resize(kept);
+            }
+        }
+
+        template <typename ColliderType>
+        bool ItemCollides(ContainerType::const_iterator item, const ColliderType& collider) const
+        {
+            if constexpr (Layout == RegionLayout::Packed) {
+                return Collides(collider, collides_.Get(static_cast<size_t>(item - std::cbegin(items_))));
+            } else {
+                return Collides(collider, (*item)->GetCollide());
+            }
+        }
+
+        decltype(auto) CollideOf(ContainerType::const_iterator item) const
+        {
+            if constexpr (Layout == RegionLayout::Packed) {
+                return collides_.Get(static_cast<size_t>(item - std::cbegin(items_)));
+            } else {
+                return (*item)->GetCollide();
+            }
+        }
+
+        template <typename ColliderType>
+        void CollisionMask(const ColliderType& collider, std::vector<uint8_t>& mask) const
+            requires (Layout == RegionLayout::Packed)
+        {
+            mask.resize(items_.size());
+            collides_.CollidesWith(collider, mask);
+        }
     };
 
     MapType regions_;
+    std::optional<Rect> bounds_;
 
     double maxEntityRadius_;
     double regionSize_;
 
     // Intended to track recursive iteration, not multi-threaded iteration
     unsigned currentIterators_;
-    std::vector<std::shared_ptr<T>> itemsAddedDuringIteration_;
+    [[ no_unique_address ]] QueryCounters queryCounters_;
+    std::vector<ItemPointer> itemsAddedDuringIteration_;
+
+    /*
+     * Each item is copied into the new regions during the MoveAndRemove whose
+     * phase matches the item's address, or when inserted if that phase has
+     * passed. Copies go stale as items move, so the first MoveAndRemove to use
+     * the new regions relocates any item in the wrong region, and sets every
+     * item's index. Until then items stay indexed by the current regions.
+     *
+     * The region holding each copy, and the current region of the item, are
+     * recorded so that a removed item is dropped from the new regions at once,
+     * and from the current regions once they are retired. Records are kept in
+     * a flat table per phase, keyed by the item's address, so a rebuild never
+     * allocates or frees anything per item.
+     */
+    struct Copy {
+        uint64_t targetKey;
+        uint64_t liveKey;
+    };
+    using CopyTables = std::vector<FlatRegionTable<Copy>>;
+    struct Rebuild {
+        std::unique_ptr<SpatialMap> target;
+        CopyTables copies;
+        size_t phase = 0;
+        size_t phaseCount = 1;
+    };
+    std::optional<AutoRegionSize> autoRegionSize_;
+    unsigned ticksSinceSample_ = 0;
+    std::unique_ptr<Rebuild> rebuild_;
+    bool reconciling_ = false;
+    // Regions replaced by a rebuild, released a few at a time
+    MapType retired_;
+    CopyTables retiredCopies_;
+    size_t retiredPerSweep_ = 0;
+
+    struct Epoch {
+        uint64_t id;
+        std::mutex mutex;
+        // A deque so that existing buffers never move while another thread registers
+        std::deque<std::pair<std::thread::id, ContainerType>> buffers;
+    };
+    // Unique across all maps of this type, so that threads can cache their buffer per epoch
+    static inline std::atomic<uint64_t> epochCounter = 0;
+    std::unique_ptr<Epoch> epoch_;
+
+    ContainerType& StagingBuffer()
+    {
+        struct CachedBuffer {
+            uint64_t epochId = 0;
+            ContainerType* buffer = nullptr;
+        };
+        thread_local CachedBuffer cached;
+
+        if (cached.epochId != epoch_->id) {
+            std::scoped_lock lock(epoch_->mutex);
+            auto threadId = std::this_thread::get_id();
+            auto iter = std::find_if(std::begin(epoch_->buffers), std::end(epoch_->buffers), [&](const auto& buffer) { return buffer.first == threadId; });
+            ContainerType& buffer = iter != std::end(epoch_->buffers) ? iter->second : epoch_->buffers.emplace_back(threadId, ContainerType{}).second;
+            cached = { epoch_->id, &buffer };
+        }
+        return *cached.buffer;
+    }
+
+    template <typename Self, typename Queries, typename Action>
+    static void QueryBatch(Self& self, const Queries& queries, Action&& action)
+    {
+        // Every (region key, query index) pair, sorted so each region is found once
+        std::vector<std::pair<uint64_t, size_t>> touched;
+        for (size_t queryIndex = 0; queryIndex < std::ranges::size(queries); ++queryIndex) {
+            self.queryCounters_.AddQuery();
+            Rect area = self.QueryArea(queries[queryIndex]);
+            auto [ minX, minY ] = self.GetCoordinate({ area.left, area.top });
+            auto [ maxX, maxY ] = self.GetCoordinate({ area.right, area.bottom });
+            for (int64_t y = minY; y <= maxY; ++y) {
+                for (int64_t x = minX; x <= maxX; ++x) {
+                    touched.emplace_back(GetCoordinateKey({ static_cast<int32_t>(x), static_cast<int32_t>(y) }), queryIndex);
+                }
+            }
+        }
+        std::sort(std::begin(touched), std::end(touched));
+
+        for (auto regionBegin = std::begin(touched); regionBegin != std::end(touched); ) {
+            auto regionEnd = std::find_if(regionBegin, std::end(touched), [&](const auto& entry) { return entry.first != regionBegin->first; });
+            if (auto* region = self.regions_.Find(regionBegin->first)) {
+                self.queryCounters_.AddRegionsVisited(static_cast<size_t>(regionEnd - regionBegin));
+                // Each item is tested against every query while it is hot in cache
+                for (auto item = std::begin(region->items_); item != std::end(region->items_); ++item) {
+                    for (auto entry = regionBegin; entry != regionEnd; ++entry) {
+                        bool collides = region->ItemCollides(item, queries[entry->second]);
+                        self.queryCounters_.AddItemTested(collides);
+                        if (collides) {
+                            action(entry->second, *item);
+                        }
+                    }
+                }
+            }
+            regionBegin = regionEnd;
+        }
+    }
+
+    template <typename Self, typename RegionType, typename Action>
+    static void ForEachCollidingPair(Self& self, RegionType& region, Action&& action)
+    {
+        auto& items = region.items_;
+        for (auto a = std::begin(items); a != std::end(items); ++a) {
+            const auto& collide = region.CollideOf(a);
+            for (auto b = std::next(a); b != std::end(items); ++b) {
+                if (region.ItemCollides(b, collide)) {
+                    action(*a, *b);
+                }
+            }
+        }
+
+        // Items may collide with items up to this many regions away
+        const int64_t reach = static_cast<int64_t>(std::floor((2.0 * self.maxEntityRadius_) / self.regionSize_)) + 1;
+        const auto [ x, y ] = region.coordinates_;
+        for (int64_t offsetY = 0; offsetY <= reach; ++offsetY) {
+            for (int64_t offsetX = (offsetY == 0 ? 1 : -reach); offsetX <= reach; ++offsetX) {
+                int64_t neighbourX = x + offsetX;
+                int64_t neighbourY = y + offsetY;
+                if (neighbourX < std::numeric_limits<int32_t>::min() || neighbourX > std::numeric_limits<int32_t>::max() || neighbourY > std::numeric_limits<int32_t>::max()) {
+                    continue;
+                }
+                auto* neighbour = self.regions_.Find(GetCoordinateKey({ static_cast<int32_t>(neighbourX), static_cast<int32_t>(neighbourY) }));
+                if (!neighbour) {
+                    continue;
+                }
+                for (auto a = std::begin(items); a != std::end(items); ++a) {
+                    const auto& collide = region.CollideOf(a);
+                    for (auto b = std::begin(neighbour->items_); b != std::end(neighbour->items_); ++b) {
+                        if (neighbour->ItemCollides(b, collide)) {
+                            action(*a, *b);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    struct NearestCandidate {
+        double distanceSquare;
+        const ItemPointer* item;
+
+        bool operator<(const NearestCandidate& other) const
+        {
+            return distanceSquare < other.distanceSquare;
+        }
+    };
+
+    /**
+     * @return The area of regions that may hold items colliding with collider.
+     * The collider's bounds are widened to double before the margin is added,
+     * so the margin is never truncated to the collider's scalar type.
+     */
+    template <typename ColliderType>
+    Rect QueryArea(const ColliderType& collider) const
+    {
+        return BoundingRect(Rect(BoundingRect(collider)), maxEntityRadius_);
+    }
+
+    static size_t BytesAllocated(const MapType& regions)
+    {
+        size_t bytes = regions.BytesAllocated();
+        for (const auto& [ key, region ] : regions) {
+            bytes += region.items_.capacity() * sizeof(ItemPointer);
+            if constexpr (Layout == RegionLayout::Packed) {
+                bytes += region.collides_.BytesAllocated();
+            }
+        }
+        return bytes;
+    }
+
+    static size_t BytesAllocated(const CopyTables& copies)
+    {
+        size_t bytes = copies.capacity() * sizeof(FlatRegionTable<Copy>);
+        for (const auto& table : copies) {
+            bytes += table.BytesAllocated();
+        }
+        return bytes;
+    }
+
+    struct RayHit {
+        double fraction;
+        const ItemPointer* item;
+
+        bool operator>(const RayHit& other) const
+        {
+            return fraction > other.fraction;
+        }
+    };
+
+    // Returns up to k candidates sorted nearest first
+    std::vector<NearestCandidate> FindNearest(const Point& point, size_t k, double maxDistance) const
+    {
+        std::vector<NearestCandidate> nearest;
+        queryCounters_.AddQuery();
+        if (k == 0 || regions_.Size() == 0) {
+            return nearest;
+        }
+        nearest.reserve(k);
+
+        // Max-heap of the best k so far, so the kth best is always at the front
+        const double maxDistanceSquare = maxDistance * maxDistance;
+        [[ maybe_unused ]] size_t tested = 0;
+        auto consider = [&](const Region& region)
+        {
+            queryCounters_.AddRegionsVisited();
+            tested += region.items_.size();
+            for (const auto& item : region.items_) {
+                double dx = item->GetLocation().x - point.x;
+                double dy = item->GetLocation().y - point.y;
+                double distanceSquare = (dx * dx) + (dy * dy);
+                if (distanceSquare > maxDistanceSquare) {
+                    continue;
+                }
+                if (nearest.size() < k) {
+                    nearest.push_back({ distanceSquare, &item });
+                    std::push_heap(std::begin(nearest), std::end(nearest));
+                } else if (distanceSquare < nearest.front().distanceSquare) {
+                    std::pop_heap(std::begin(nearest), std::end(nearest));
+                    nearest.back() = { distanceSquare, &item };
+                    std::push_heap(std::begin(nearest), std::end(nearest));
+                }
+            }
+        };
+
+        const auto [ centreX, centreY ] = GetCoordinate(point);
+        // Every item in ring r (r > 0) is at least (r - 1) regions plus this far from point
+        const double edgeDistance = std::clamp(std::min({ point.x - (centreX * regionSize_),
+                                                          ((centreX + 1.0) * regionSize_) - point.x,
+                                                          point.y - (centreY * regionSize_),
+                                                          ((centreY + 1.0) * regionSize_) - point.y }), 0.0, regionSize_);
+
+        auto visit = [&](int64_t x, int64_t y)
+        {
+            if (x >= std::numeric_limits<int32_t>::min() && x <= std::numeric_limits<int32_t>::max()
+             && y >= std::numeric_limits<int32_t>::min() && y <= std::numeric_limits<int32_t>::max()) {
+                if (const Region* region = regions_.Find(GetCoordinateKey({ static_cast<int32_t>(x), static_cast<int32_t>(y) }))) {
+                    consider(*region);
+                }
+            }
+        };
+
+        size_t cellsVisited = 0;
+        for (int64_t ring = 0; ; ++ring) {
+            if (ring > 0) {
+                double ringDistance = ((ring - 1) * regionSize_) + edgeDistance;
+                if (ringDistance > maxDistance || (nearest.size() == k && ringDistance * ringDistance > nearest.front().distanceSquare)) {
+                    break;
+                }
+            }
+
+            if (cellsVisited >= regions_.Size()) {
+                // Sparse maps, cheaper to check every region outside the searched rings than to keep looking up empty cells
+                for (const auto& [ key, region ] : regions_) {
+                    int64_t offsetX = std::abs(static_cast<int64_t>(region.coordinates_.first) - centreX);
+                    int64_t offsetY = std::abs(static_cast<int64_t>(region.coordinates_.second) - centreY);
+                    if (std::max(offsetX, offsetY) >= ring) {
+                        consider(region);
+                    }
+                }
+                break;
+            }
+
+            if (ring == 0) {
+                visit(centreX, centreY);
+                cellsVisited += 1;
+            } else {
+                for (int64_t x = centreX - ring; x <= centreX + ring; ++x) {
+                    visit(x, centreY - ring);
+                    visit(x, centreY + ring);
+                }
+                for (int64_t y = centreY - ring + 1; y < centreY + ring; ++y) {
+                    visit(centreX - ring, y);
+                    visit(centreX + ring, y);
+                }
+                cellsVisited += static_cast<size_t>(8 * ring);
+            }
+        }
+
+        std::sort_heap(std::begin(nearest), std::end(nearest));
+        queryCounters_.AddItemsTested(tested, nearest.size());
+        return nearest;
+    }
+
+    template <typename Migrate>
+    void MoveAndRemoveItems(Region& region, SweepResult& result, Migrate&& migrate) const
+    {
+        region.EraseIf([&](auto& item) -> bool
+        {
+            bool removeItemCompletely = !item->Exists();
+            bool moved = !removeItemCompletely && item->Move();
+            // Copies made during a rebuild may be in the wrong region without having moved this time
+            bool movedToDifferentRegion = !removeItemCompletely && (moved || reconciling_) && GetCoordinate(item->GetLocation()) != region.coordinates_;
+
+            if (removeItemCompletely) {
+                if (rebuild_ || !retiredCopies_.empty()) {
+                    result.removed.push_back(std::to_address(item));
+                }
+            } else if (rebuild_) {
+                size_t phase = RebuildPhase(std::to_address(item), rebuild_->phaseCount);
+                if (phase == rebuild_->phase) {
+                    if constexpr (std::copyable<ItemPointer>) {
+                        result.copied.push_back(item);
+                    }
+                } else if (phase < rebuild_->phase && movedToDifferentRegion) {
+                    result.relocated.emplace_back(std::to_address(item), GetCoordinateKey(GetCoordinate(item->GetLocation())));
+                }
+            }
+            if (movedToDifferentRegion) {
+                migrate(std::move(item));
+            }
+            return removeItemCompletely || movedToDifferentRegion;
+        }, true);
+        result.items += region.items_.size();
+        result.weightedItems += region.items_.size() * region.items_.size();
+    }
+
+    void BeginSweep()
+    {
+        size_t released = 0;
+        retired_.EraseIf([&](const auto&) { return released++ < retiredPerSweep_; });
+        if (retired_.Size() == 0) {
+            // One allocation per phase, the entries have nothing to destroy
+            retiredCopies_.clear();
+        }
+
+        if (rebuild_ && rebuild_->phase == rebuild_->phaseCount) {
+            std::unique_ptr<Rebuild> rebuild = std::move(rebuild_);
+            std::swap(regions_, rebuild->target->regions_);
+            regionSize_ = rebuild->target->regionSize_;
+            retired_ = std::move(rebuild->target->regions_);
+            retiredCopies_ = std::move(rebuild->copies);
+            retiredPerSweep_ = (retired_.Size() / rebuild->phaseCount) + 1;
+            reconciling_ = true;
+        }
+    }
+
+    void EndSweep(std::span<SweepResult> results)
+    {
+        reconciling_ = false;
+
+        size_t items = 0;
+        size_t weightedItems = 0;
+        for (auto& result : results) {
+            items += result.items;
+            weightedItems += result.weightedItems;
+            if (rebuild_) {
+                for (const auto& [ item, liveKey ] : result.relocated) {
+                    if (Copy* copy = FindCopy(rebuild_->copies, item)) {
+                        copy->liveKey = liveKey;
+                    }
+                }
+            }
+            for (const T* item : result.removed) {
+                OnRemoved(item);
+            }
+            if (rebuild_) {
+                for (auto& item : result.copied) {
+                    PlaceCopy(std::move(item));
+                }
+            }
+        }
+        if (rebuild_) {
+            ++rebuild_->phase;
+        } else if (autoRegionSize_ && retired_.Size() == 0 && ++ticksSinceSample_ >= autoRegionSize_->sampleInterval && items > 0) {
+            ticksSinceSample_ = 0;
+            const AutoRegionSize& params = autoRegionSize_.value();
+            double occupancy = static_cast<double>(weightedItems) / static_cast<double>(items);
+            if (occupancy < params.minOccupancy || occupancy > params.maxOccupancy) {
+                // Occupancy is proportional to region area
+                double newRegionSize = regionSize_ * std::sqrt(params.targetOccupancy / occupancy);
+                newRegionSize = std::min(std::max({ newRegionSize, params.minRegionSize, maxEntityRadius_ * 2.0 }), params.maxRegionSize);
+                if (newRegionSize != regionSize_) {
+                    BeginRebuild(newRegionSize, params.rebuildTicks);
+                }
+            }
+        }
+    }
+
+    void BeginRebuild(double newRegionSize, unsigned rebuildTicks)
+    {
+        rebuild_ = std::make_unique<Rebuild>();
+        rebuild_->target = std::make_unique<SpatialMap>(maxEntityRadius_, newRegionSize);
+        rebuild_->phaseCount = std::max(rebuildTicks, 1u);
+        rebuild_->copies.resize(rebuild_->phaseCount);
+        if (bounds_.has_value()) {
+            rebuild_->target->SetBounds(bounds_.value());
+        }
+    }
+
+    template <typename Result>
+    static Result ToResult(const ItemPointer& item)
+    {
+        if constexpr (std::copyable<ItemPointer>) {
+            return item;
+        } else {
+            return std::to_address(item);
+        }
+    }
+
+    static uint64_t AddressKey(const T* item)
+    {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(item));
+    }
+
+    static size_t RebuildPhase(const T* item, size_t phaseCount)
+    {
+        // Mixed, as allocations are aligned and often evenly spaced
+        return static_cast<size_t>(((AddressKey(item) >> 4) * 0x9E3779B97F4A7C15ull) >> 32) % phaseCount;
+    }
+
+    static Copy* FindCopy(CopyTables& copies, const T* item)
+    {
+        return copies.empty() ? nullptr : copies[RebuildPhase(item, copies.size())].Find(AddressKey(item));
+    }
+
+    void CopyToRebuild(const ItemPointer& item)
+    {
+        // Rebuilds are never started for move only pointers, see SetAutoRegionSize
+        if constexpr (std::copyable<ItemPointer>) {
+            if (rebuild_ && RebuildPhase(std::to_address(item), rebuild_->phaseCount) < rebuild_->phase) {
+                PlaceCopy(ItemPointer(item));
+            }
+        }
+    }
+
+    void PlaceCopy(ItemPointer&& item)
+    {
+        SpatialMap& target = *rebuild_->target;
+        const auto& location = item->GetLocation();
+        const T* address = std::to_address(item);
+        rebuild_->copies[RebuildPhase(address, rebuild_->phaseCount)].Emplace(AddressKey(address)) = { target.GetCoordinateKey(target.GetCoordinate(location)), GetCoordinateKey(GetCoordinate(location)) };
+        target.RegionAt(location).PushBack(std::move(item), false);
+    }
+
+    void OnRemoved(const T* item)
+    {
+        if (rebuild_) {
+            if (Copy* copy = FindCopy(rebuild_->copies, item)) {
+                if (Region* region = rebuild_->target->regions_.Find(copy->targetKey)) {
+                    region->Drop(item);
+                }
+                rebuild_->copies[RebuildPhase(item, rebuild_->phaseCount)].Erase(AddressKey(item));
+            }
+        }
+        if (Copy* copy = FindCopy(retiredCopies_, item)) {
+            if (Region* region = retired_.Find(copy->liveKey)) {
+                region->Drop(item);
+            }
+            retiredCopies_[RebuildPhase(item, retiredCopies_.size())].Erase(AddressKey(item));
+        }
+    }
+
+    void Place(ItemPointer&& item)
+    {
+        RegionAt(item->GetLocation()).PushBack(std::move(item));
+    }
 
     void OnBeginIteration()
     {
+        assert(!InEpoch());
         ++currentIterators_;
     }
 
@@ -1088,18 +2248,28 @@ private:
         }
     }
 
+    void SetBounds(const Rect& bounds)
+    {
+        if constexpr (requires (MapType& table) { table.SetBounds(0, 0, 0, 0); }) {
+            auto [ minX, minY ] = GetCoordinate({ bounds.left, bounds.top });
+            auto [ maxX, maxY ] = GetCoordinate({ bounds.right, bounds.bottom });
+            regions_.SetBounds(minX, minY, maxX, maxY);
+            bounds_ = bounds;
+        }
+    }
+
     Region& RegionAt(const Point& location)
     {
         auto coords = GetCoordinate(location);
         auto key = GetCoordinateKey(coords);
-        if (!regions_.contains(key)) {
-            double left = coords.first * regionSize_;
-            double top = coords.second * regionSize_;
-            double right =  (coords.first  + 1) * regionSize_;
-            double bottom = (coords.second + 1) * regionSize_;
-            regions_.insert(std::pair{ key, Region(Rect{ left, top, right, bottom }, coords) });
-        }
-        return regions_.at(key);
+        if (Region* existing = regions_.Find(key)) {
+            return *existing;
+        }
+        double left = coords.first * regionSize_;
+        double top = coords.second * regionSize_;
+        double right =  (coords.first  + 1) * regionSize_;
+        double bottom = (coords.second + 1) * regionSize_;
+        return regions_.Emplace(key, Rect{ left, top, right, bottom }, coords);
     }
 
     std::pair<int32_t, int32_t> GetCoordinate(const Point& location) const
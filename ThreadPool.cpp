@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+
+namespace util {
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+    for (unsigned i = 1; i < threadCount; ++i) {
+        workers_.emplace_back([this](std::stop_token stop) { WorkerLoop(stop); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    for (auto& worker : workers_) {
+        worker.request_stop();
+    }
+    {
+        // Taking the lock guarantees no worker is between checking its stop token and waiting
+        std::scoped_lock lock(mutex_);
+    }
+    jobAvailable_.notify_all();
+    // Join now, as the members below workers_ that the workers use are destroyed before it
+    workers_.clear();
+}
+
+void ThreadPool::Run(const std::function<void(size_t chunk)>& job, size_t chunkCount)
+{
+    uint64_t generation;
+    {
+        std::scoped_lock lock(mutex_);
+        job_ = &job;
+        chunkCount_ = chunkCount;
+        nextChunk_ = 0;
+        pendingChunks_ = chunkCount;
+        error_ = nullptr;
+        generation = ++generation_;
+    }
+    jobAvailable_.notify_all();
+
+    RunChunks(generation);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock lock(mutex_);
+        jobComplete_.wait(lock, [&]() { return pendingChunks_ == 0; });
+        job_ = nullptr;
+        std::swap(error, error_);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::RunChunks(uint64_t generation)
+{
+    std::unique_lock lock(mutex_);
+    // Chunks are claimed under the lock, so a thread that wakes late can never claim a chunk from a later job
+    while (generation_ == generation && nextChunk_ < chunkCount_) {
+        size_t chunk = nextChunk_++;
+        const auto& job = *job_;
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            job(chunk);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        if (error && !error_) {
+            error_ = error;
+        }
+        if (--pendingChunks_ == 0) {
+            jobComplete_.notify_all();
+        }
+    }
+}
+
+void ThreadPool::WorkerLoop(std::stop_token stop)
+{
+    uint64_t lastGeneration = 0;
+    while (true) {
+        uint64_t generation;
+        {
+            std::unique_lock lock(mutex_);
+            jobAvailable_.wait(lock, [&]() { return stop.stop_requested() || generation_ != lastGeneration; });
+            if (stop.stop_requested()) {
+                return;
+            }
+            generation = generation_;
+        }
+        lastGeneration = generation;
+        RunChunks(generation);
+    }
+}
+
+} // namespace util
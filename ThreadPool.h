@@ -0,0 +1,112 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+
+namespace util {
+
+/**
+ * @brief The ThreadPool class keeps a set of worker threads alive so that work
+ * can be split across them repeatedly (e.g. every tick) without the cost of
+ * starting new threads each time.
+ *
+ * The thread calling ParallelFor takes part in the work, so a pool with a
+ * ThreadCount of 1 has no workers and runs everything on the calling thread.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = std::max(std::thread::hardware_concurrency(), 1u));
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool& other) = delete;
+    ThreadPool& operator=(const ThreadPool& other) = delete;
+
+    unsigned ThreadCount() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    /**
+     * Splits [0, count) into at most ThreadCount() contiguous chunks, in order,
+     * and calls task(begin, end, chunkIndex) for each chunk concurrently.
+     * Chunk boundaries only depend on count and ThreadCount(), so chunkIndex can
+     * be used to index per-chunk output which is later combined in order.
+     *
+     * Blocks until every chunk is complete. If a task throws, the first exception
+     * is rethrown once all chunks have finished. Must not be called from within
+     * a task.
+     */
+    template <typename Task>
+        requires std::invocable<Task&, size_t, size_t, size_t>
+    void ParallelFor(size_t count, Task&& task)
+    {
+        size_t chunkCount = std::min<size_t>(count, ThreadCount());
+        if (chunkCount <= 1) {
+            if (count > 0) {
+                task(size_t{ 0 }, count, size_t{ 0 });
+            }
+            return;
+        }
+
+        std::function<void(size_t chunk)> runChunk = [&](size_t chunk)
+        {
+            task(chunk * count / chunkCount, (chunk + 1) * count / chunkCount, chunk);
+        };
+        Run(runChunk, chunkCount);
+    }
+
+    /**
+     * Calls task(index) for each index in [0, count) concurrently. Unlike
+     * ParallelFor, indices are claimed one at a time by whichever thread is
+     * free, so that tasks of uneven cost (e.g. the subtrees of an unbalanced
+     * tree) are still spread evenly between the threads. Each claim takes a
+     * lock, so tasks should be coarse.
+     *
+     * Blocks until every task is complete, exceptions are handled as for
+     * ParallelFor. Must not be called from within a task.
+     */
+    template <typename Task>
+        requires std::invocable<Task&, size_t>
+    void ParallelForEach(size_t count, Task&& task)
+    {
+        if (count <= 1 || ThreadCount() == 1) {
+            for (size_t index = 0; index < count; ++index) {
+                task(index);
+            }
+            return;
+        }
+
+        std::function<void(size_t index)> runTask = [&](size_t index)
+        {
+            task(index);
+        };
+        Run(runTask, count);
+    }
+
+private:
+    std::vector<std::jthread> workers_;
+
+    // All job state is guarded by mutex_
+    std::mutex mutex_;
+    std::condition_variable jobAvailable_;
+    std::condition_variable jobComplete_;
+    const std::function<void(size_t chunk)>* job_ = nullptr;
+    uint64_t generation_ = 0;
+    size_t chunkCount_ = 0;
+    size_t nextChunk_ = 0;
+    size_t pendingChunks_ = 0;
+    std::exception_ptr error_;
+
+    void Run(const std::function<void(size_t chunk)>& job, size_t chunkCount);
+    void RunChunks(uint64_t generation);
+    void WorkerLoop(std::stop_token stop);
+};
+
+} // namespace util
+
+#endif // THREADPOOL_H
@@ -0,0 +1,345 @@
+#include <QuadTree.h>
+#include <LinearQuadTree.h>
+#include <ThreadPool.h>
+
+#include <Shape.h>
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+
+using namespace util;
+
+/*
+ * Benchmarks are hidden by default, run them with e.g.
+ *
+ *     Tests "[benchmark]"
+ */
+
+namespace {
+
+class BenchmarkType {
+public:
+    BenchmarkType(const Point& location, double radius = 2.0)
+        : location_(location)
+        , collide_{ location.x, location.y, radius }
+    {
+    }
+
+    const Point& GetLocation() const
+    {
+        return location_;
+    }
+
+    const Circle& GetCollide() const
+    {
+        return collide_;
+    }
+
+    void Jitter()
+    {
+        location_.x += Random::Number(-1.0, 1.0);
+        location_.y += Random::Number(-1.0, 1.0);
+        collide_.x = location_.x;
+        collide_.y = location_.y;
+    }
+
+private:
+    Point location_;
+    Circle collide_;
+};
+
+constexpr size_t ITEM_COUNT = 10'000;
+const Rect AREA{ 0, 0, 1000, 1000 };
+
+std::vector<std::shared_ptr<BenchmarkType>> RandomItems()
+{
+    Random::Seed(42);
+    std::vector<std::shared_ptr<BenchmarkType>> items;
+    for (size_t i = 0; i < ITEM_COUNT; ++i) {
+        items.push_back(std::make_shared<BenchmarkType>(Random::PointIn(AREA)));
+    }
+    return items;
+}
+
+std::vector<Circle> RandomQueries()
+{
+    std::vector<Circle> queries;
+    for (size_t i = 0; i < 1000; ++i) {
+        Point centre = Random::PointIn(AREA);
+        queries.push_back({ centre.x, centre.y, 20.0 });
+    }
+    return queries;
+}
+
+} // namespace
+
+TEST_CASE("QuadTree insertion", "[.][benchmark]")
+{
+    auto items = RandomItems();
+
+    BENCHMARK("QuadTree Insert")
+    {
+        QuadTree<BenchmarkType> tree(AREA, 8, 2, 1.0);
+        for (const auto& item : items) {
+            tree.Insert(item);
+        }
+        return tree.Size();
+    };
+
+    BENCHMARK("QuadTree BulkInsert")
+    {
+        QuadTree<BenchmarkType> tree(AREA, 8, 2, 1.0);
+        tree.BulkInsert(items);
+        return tree.Size();
+    };
+
+    BENCHMARK("QuadTree Build")
+    {
+        return QuadTree<BenchmarkType>::Build(items, 8, 2, 1.0).Size();
+    };
+
+    BENCHMARK("LinearQuadTree BulkInsert")
+    {
+        LinearQuadTree<BenchmarkType> tree(AREA, 8, 2, 1.0);
+        tree.BulkInsert(items);
+        return tree.Size();
+    };
+}
+
+TEST_CASE("QuadTree storage", "[.][benchmark]")
+{
+    auto queries = RandomQueries();
+
+    // Each tree gets its own (identical) items, as both move them
+    QuadTree<BenchmarkType> tree(AREA, 8, 2, 1.0);
+    LinearQuadTree<BenchmarkType> linear(AREA, 8, 2, 1.0);
+    tree.BulkInsert(RandomItems());
+    linear.BulkInsert(RandomItems());
+
+    BENCHMARK("QuadTree queries (1000)")
+    {
+        size_t found = 0;
+        for (const Circle& query : queries) {
+            tree.ForEachItem(tree.ConstIterator([&](const BenchmarkType&) { ++found; }).SetQuadFilter(query).SetItemFilter(query));
+        }
+        return found;
+    };
+
+    BENCHMARK("LinearQuadTree queries (1000)")
+    {
+        size_t found = 0;
+        for (const Circle& query : queries) {
+            linear.ForEachItem([&](const BenchmarkType&) { ++found; },
+                               [&](const Rect& quad) { return Collides(query, quad); },
+                               [&](const BenchmarkType& item) { return Collides(query, item.GetCollide()); });
+        }
+        return found;
+    };
+
+    BENCHMARK("QuadTree move all")
+    {
+        tree.ForEachItem(tree.Iterator([](const std::shared_ptr<BenchmarkType>& item) { item->Jitter(); }));
+        return tree.Size();
+    };
+
+    BENCHMARK("LinearQuadTree move all")
+    {
+        linear.ForEachItem([](const std::shared_ptr<BenchmarkType>& item) { item->Jitter(); });
+        return linear.Size();
+    };
+}
+
+TEST_CASE("QuadTree iteration", "[.][benchmark]")
+{
+    auto queries = RandomQueries();
+
+    QuadTree<BenchmarkType> tree(AREA, 8, 2, 1.0);
+    tree.BulkInsert(RandomItems());
+
+    BENCHMARK("std::function queries (1000)")
+    {
+        size_t found = 0;
+        for (const Circle& query : queries) {
+            tree.ForEachItem(tree.ConstIterator([&](const BenchmarkType&) { ++found; }).SetQuadFilter(query).SetItemFilter(query));
+        }
+        return found;
+    };
+
+    BENCHMARK("Templated queries (1000)")
+    {
+        size_t found = 0;
+        for (const Circle& query : queries) {
+            std::as_const(tree).ForEachItem([&](const BenchmarkType&) { ++found; },
+                                            [&](const Rect& quad) { return Collides(query, quad); },
+                                            [&](const BenchmarkType& item) { return Collides(query, item.GetCollide()); });
+        }
+        return found;
+    };
+
+    BENCHMARK("std::function all items")
+    {
+        size_t found = 0;
+        tree.ForEachItem(tree.ConstIterator([&](const BenchmarkType&) { ++found; }));
+        return found;
+    };
+
+    BENCHMARK("Templated all items")
+    {
+        size_t found = 0;
+        std::as_const(tree).ForEachItem([&](const BenchmarkType&) { ++found; });
+        return found;
+    };
+}
+
+TEST_CASE("QuadTree parallel sensing", "[.][benchmark]")
+{
+    QuadTree<BenchmarkType> tree(AREA, 8, 2, 1.0);
+    tree.BulkInsert(RandomItems());
+    ThreadPool threads;
+
+    // A read only sensing pass, each item counts its neighbours
+    auto sense = [&](const BenchmarkType& item)
+    {
+        Circle range{ item.GetLocation().x, item.GetLocation().y, 15.0 };
+        size_t neighbours = 0;
+        tree.ForEachItem([&](const BenchmarkType&) { ++neighbours; },
+                         [&](const Rect& quad) { return Collides(range, quad); },
+                         [&](const BenchmarkType& other) { return Collides(range, other.GetCollide()); });
+        return neighbours;
+    };
+
+    BENCHMARK("Serial sensing")
+    {
+        size_t total = 0;
+        std::as_const(tree).ForEachItem([&](const BenchmarkType& item) { total += sense(item); });
+        return total;
+    };
+
+    BENCHMARK("Parallel sensing (" + std::to_string(threads.ThreadCount()) + " threads)")
+    {
+        std::atomic<size_t> total = 0;
+        std::as_const(tree).ForEachItem(threads, [&](const BenchmarkType& item) { total += sense(item); });
+        return total.load();
+    };
+}
+
+TEST_CASE("QuadTree vision rays", "[.][benchmark]")
+{
+    QuadTree<BenchmarkType> tree(AREA, 8, 2, 1.0);
+    auto items = RandomItems();
+    tree.BulkInsert(items);
+    // 16 vision rays for each of 1000 agents
+    std::vector<Line> rays;
+    for (size_t i = 0; i < 1000; ++i) {
+        for (size_t ray = 0; ray < 16; ++ray) {
+            const Point& eye = items[i]->GetLocation();
+            rays.push_back({ eye, ApplyOffset(eye, (std::numbers::pi / 8.0) * ray, 100.0) });
+        }
+    }
+
+    BENCHMARK("Items in bounding rect, nearest hit (16000 rays)")
+    {
+        double total = 0.0;
+        for (const Line& ray : rays) {
+            Rect area = BoundingRect(ray, 2.0);
+            double nearest = 1.0;
+            std::as_const(tree).ForEachItem([&](const BenchmarkType& item)
+            {
+                if (auto fraction = FirstIntersection(ray, item.GetCollide())) {
+                    nearest = std::min(nearest, *fraction);
+                }
+            }, [&](const Rect& quad) { return Collides(area, quad); });
+            total += nearest;
+        }
+        return total;
+    };
+
+    BENCHMARK("RayCast, nearest hit (16000 rays)")
+    {
+        double total = 0.0;
+        for (const Line& ray : rays) {
+            tree.RayCast(ray, [&](const BenchmarkType&, double distance) { total += distance; }, true, 2.0);
+        }
+        return total;
+    };
+}
+
+TEST_CASE("QuadTree few items moving", "[.][benchmark]")
+{
+    // Each tree gets its own (identical) items, as both move them
+    auto iterated = RandomItems();
+    auto relocated = RandomItems();
+    QuadTree<BenchmarkType> iteratedTree(AREA, 8, 2, 1.0);
+    QuadTree<BenchmarkType> relocatedTree(AREA, 8, 2, 1.0);
+    iteratedTree.BulkInsert(iterated);
+    relocatedTree.BulkInsert(relocated);
+
+    // One in twenty items moves each frame
+    constexpr size_t STRIDE = 20;
+
+    BENCHMARK("ForEachItem, moving one in twenty")
+    {
+        for (size_t i = 0; i < iterated.size(); i += STRIDE) {
+            iterated[i]->Jitter();
+        }
+        // Only to rehome the moved items
+        iteratedTree.ForEachItem([](const std::shared_ptr<BenchmarkType>&) {});
+        return iteratedTree.Size();
+    };
+
+    std::vector<std::pair<std::shared_ptr<BenchmarkType>, Point>> moved;
+    BENCHMARK("Relocate, moving one in twenty")
+    {
+        moved.clear();
+        for (size_t i = 0; i < relocated.size(); i += STRIDE) {
+            moved.push_back({ relocated[i], relocated[i]->GetLocation() });
+            relocated[i]->Jitter();
+        }
+        auto previous = std::begin(moved);
+        return relocatedTree.Relocate(moved | std::views::keys, [&](const BenchmarkType&) { return (previous++)->second; });
+    };
+}
+
+TEST_CASE("QuadTree mixed item sizes", "[.][benchmark]")
+{
+    // Mostly small items, with a few very large ones
+    Random::Seed(42);
+    std::vector<std::shared_ptr<BenchmarkType>> items;
+    double largestRadius = 0.0;
+    for (size_t i = 0; i < ITEM_COUNT; ++i) {
+        double radius = i % 100 == 0 ? Random::Number(20.0, 50.0) : Random::Number(0.5, 2.0);
+        largestRadius = std::max(largestRadius, radius);
+        items.push_back(std::make_shared<BenchmarkType>(Random::PointIn(AREA), radius));
+    }
+    auto queries = RandomQueries();
+
+    QuadTree<BenchmarkType> tight(AREA, 8, 2, 1.0);
+    QuadTree<BenchmarkType> loose(AREA, 8, 2, 1.0, 2.0);
+    tight.BulkInsert(items);
+    loose.BulkInsert(items);
+
+    BENCHMARK("Padded quad filter (1000 queries)")
+    {
+        size_t found = 0;
+        for (const Circle& query : queries) {
+            Circle padded{ query.x, query.y, query.radius + largestRadius };
+            tight.ForEachItem([&](const BenchmarkType&) { ++found; },
+                              [&](const Rect& quad) { return Collides(padded, quad); },
+                              [&](const BenchmarkType& item) { return Collides(query, item.GetCollide()); });
+        }
+        return found;
+    };
+
+    BENCHMARK("Loose (1000 queries)")
+    {
+        size_t found = 0;
+        for (const Circle& query : queries) {
+            loose.ForEachItem([&](const BenchmarkType&) { ++found; },
+                              [&](const Rect& quad) { return Collides(query, quad); },
+                              [&](const BenchmarkType& item) { return Collides(query, item.GetCollide()); });
+        }
+        return found;
+    };
+}
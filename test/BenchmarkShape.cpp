@@ -0,0 +1,106 @@
+#include <Shape.h>
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+/*
+ * Benchmarks are hidden by default, run them with e.g.
+ *
+ *     Tests "[benchmark]"
+ */
+
+namespace {
+
+constexpr size_t SHAPE_COUNT = 10'000;
+const Rect AREA{ -1000, -1000, 1000, 1000 };
+
+Point RandomPoint()
+{
+    return Random::PointIn(AREA);
+}
+
+Circle RandomCircle()
+{
+    Point centre = RandomPoint();
+    return { centre.x, centre.y, Random::Number(1.0, 50.0) };
+}
+
+Rect RandomRect()
+{
+    Point topLeft = RandomPoint();
+    return { topLeft.x, topLeft.y, topLeft.x + Random::Number(1.0, 100.0), topLeft.y + Random::Number(1.0, 100.0) };
+}
+
+Line RandomLine()
+{
+    Point a = RandomPoint();
+    return { a, ApplyOffset(a, Random::Bearing(), Random::Number(1.0, 100.0)) };
+}
+
+template <typename Shape, typename Generator>
+std::vector<Shape> RandomShapes(Generator&& generator)
+{
+    std::vector<Shape> shapes;
+    shapes.reserve(SHAPE_COUNT);
+    for (size_t i = 0; i < SHAPE_COUNT; ++i) {
+        shapes.push_back(generator());
+    }
+    return shapes;
+}
+
+/**
+ * Tests a single query against every shape, as a spatial query would.
+ */
+template <typename Query, typename Shape, typename Test>
+size_t CountMatches(const Query& query, const std::vector<Shape>& shapes, Test&& test)
+{
+    size_t matches = 0;
+    for (const Shape& shape : shapes) {
+        matches += test(query, shape) ? 1 : 0;
+    }
+    return matches;
+}
+
+} // namespace
+
+TEST_CASE("Shape tests", "[.][benchmark]")
+{
+    Random::Seed(42);
+    auto points = RandomShapes<Point>(RandomPoint);
+    auto circles = RandomShapes<Circle>(RandomCircle);
+    auto rects = RandomShapes<Rect>(RandomRect);
+    auto lines = RandomShapes<Line>(RandomLine);
+
+    const Circle circle{ 0.0, 0.0, 250.0 };
+    const CircleSq circleSq(circle);
+    const Rect rect{ -250.0, -250.0, 250.0, 250.0 };
+    const Line line{ { -500.0, -300.0 }, { 400.0, 350.0 } };
+
+    auto collides = [](const auto& a, const auto& b) { return Collides(a, b); };
+    auto contains = [](const auto& a, const auto& b) { return Contains(a, b); };
+
+    BENCHMARK("Collides(Circle, Circle)") { return CountMatches(circle, circles, collides); };
+    BENCHMARK("Collides(Circle, Point)") { return CountMatches(circle, points, collides); };
+    BENCHMARK("Collides(Rect, Rect)") { return CountMatches(rect, rects, collides); };
+    BENCHMARK("Collides(Rect, Circle)") { return CountMatches(rect, circles, collides); };
+    BENCHMARK("Collides(Rect, Point)") { return CountMatches(rect, points, collides); };
+    BENCHMARK("Collides(Line, Line)") { return CountMatches(line, lines, collides); };
+    BENCHMARK("Collides(Line, Circle)") { return CountMatches(line, circles, collides); };
+    BENCHMARK("Collides(Line, Rect)") { return CountMatches(line, rects, collides); };
+    BENCHMARK("Collides(Line, Point)") { return CountMatches(line, points, collides); };
+
+    BENCHMARK("Contains(Circle, Point)") { return CountMatches(circle, points, contains); };
+    BENCHMARK("Contains(CircleSq, Point)") { return CountMatches(circleSq, points, contains); };
+    BENCHMARK("Contains(Circle, Line)") { return CountMatches(circle, lines, contains); };
+    BENCHMARK("Contains(CircleSq, Line)") { return CountMatches(circleSq, lines, contains); };
+    BENCHMARK("Contains(Rect, Point)") { return CountMatches(rect, points, contains); };
+    BENCHMARK("Contains(Rect, Line)") { return CountMatches(rect, lines, contains); };
+    BENCHMARK("Contains(Rect, Rect)") { return CountMatches(rect, rects, contains); };
+    BENCHMARK("Contains(Rect, Circle)") { return CountMatches(rect, circles, contains); };
+    BENCHMARK("Contains(Line, Point)") { return CountMatches(line, points, contains); };
+
+    BENCHMARK("GetDistanceSquare") { return CountMatches(Point{ 0.0, 0.0 }, points, [](const Point& a, const Point& b) { return GetDistanceSquare(a, b) < 10'000.0; }); };
+    BENCHMARK("GetArea(Circle)") { return CountMatches(0.0, circles, [](double threshold, const Circle& c) { return GetArea(c) > threshold; }); };
+}
@@ -0,0 +1,460 @@
+#include <SpatialMap.h>
+#include <HierarchicalSpatialMap.h>
+#include <SlotMap.h>
+
+#include <Shape.h>
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+using namespace util;
+
+/*
+ * Benchmarks are hidden by default, run them with e.g.
+ *
+ *     Tests "[benchmark]"
+ */
+
+namespace {
+
+class BenchmarkType {
+public:
+    constexpr static double RADIUS = 2.0;
+
+    BenchmarkType(const Point& location, double bearing, double speed, double radius = RADIUS)
+        : location_(location)
+        , collide_{ location.x, location.y, radius }
+        , bearing_(bearing)
+        , speed_(speed)
+    {
+    }
+
+    static std::shared_ptr<BenchmarkType> Random(double worldSize)
+    {
+        Point startingLoc{ Random::Number(-worldSize, worldSize), Random::Number(-worldSize, worldSize) };
+        return std::make_shared<BenchmarkType>(startingLoc, Random::Bearing(), Random::Number(0.0, 10.0));
+    }
+
+    const Point& GetLocation() const
+    {
+        return location_;
+    }
+
+    const Circle& GetCollide() const
+    {
+        return collide_;
+    }
+
+    bool Exists() const
+    {
+        return true;
+    }
+
+    bool Move()
+    {
+        location_ = ApplyOffset(location_, bearing_, speed_);
+        collide_.x = location_.x;
+        collide_.y = location_.y;
+        return true;
+    }
+
+private:
+    Point location_;
+    Circle collide_;
+    double bearing_;
+    double speed_;
+};
+
+class IndexedBenchmarkType : public BenchmarkType {
+public:
+    explicit IndexedBenchmarkType(const BenchmarkType& other)
+        : BenchmarkType(other)
+    {
+    }
+
+    void SetSpatialMapIndex(size_t index)
+    {
+        index_ = index;
+    }
+
+    size_t GetSpatialMapIndex() const
+    {
+        return index_;
+    }
+
+private:
+    size_t index_ = 0;
+};
+
+std::vector<std::shared_ptr<BenchmarkType>> CreateItems(size_t count, double worldSize)
+{
+    Random::Seed(1234);
+    std::vector<std::shared_ptr<BenchmarkType>> items;
+    items.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        items.push_back(BenchmarkType::Random(worldSize));
+    }
+    return items;
+}
+
+constexpr size_t itemCount = 100'000;
+constexpr double worldSize = 10'000.0;
+constexpr double regionSize = 50.0;
+
+template <template <typename> typename RegionTable, RegionLayout Layout>
+SpatialMap<BenchmarkType, RegionTable, Layout> CreateMap(bool bounded, double size = regionSize)
+{
+    if constexpr (std::is_same_v<RegionTable<int>, GridRegionTable<int>>) {
+        if (bounded) {
+            return SpatialMap<BenchmarkType, RegionTable, Layout>(Rect{ -worldSize, -worldSize, worldSize, worldSize }, BenchmarkType::RADIUS, size);
+        }
+    }
+    return SpatialMap<BenchmarkType, RegionTable, Layout>(BenchmarkType::RADIUS, size);
+}
+
+template <template <typename> typename RegionTable, RegionLayout Layout = RegionLayout::Pointers>
+void BenchmarkRegionTable(const std::string& name, bool bounded = false, double size = regionSize)
+{
+    auto items = CreateItems(itemCount, worldSize);
+
+    BENCHMARK(name + " Insert")
+    {
+        auto map = CreateMap<RegionTable, Layout>(bounded, size);
+        for (const auto& item : items) {
+            map.Insert(item);
+        }
+        return map.Size();
+    };
+
+    BENCHMARK_ADVANCED(name + " MoveAndRemove")(Catch::Benchmark::Chronometer meter)
+    {
+        auto map = CreateMap<RegionTable, Layout>(bounded, size);
+        for (const auto& item : CreateItems(itemCount, worldSize)) {
+            map.Insert(item);
+        }
+        meter.measure([&]
+        {
+            map.MoveAndRemove();
+            return map.RegionCount();
+        });
+    };
+
+    BENCHMARK_ADVANCED(name + " Items")(Catch::Benchmark::Chronometer meter)
+    {
+        auto map = CreateMap<RegionTable, Layout>(bounded, size);
+        for (const auto& item : items) {
+            map.Insert(item);
+        }
+        map.MoveAndRemove();
+        meter.measure([&]
+        {
+            double total = 0.0;
+            for (const auto& item : map.CItems()) {
+                total += item.GetLocation().x;
+            }
+            return total;
+        });
+    };
+
+    BENCHMARK_ADVANCED(name + " ItemsCollidingWith")(Catch::Benchmark::Chronometer meter)
+    {
+        auto map = CreateMap<RegionTable, Layout>(bounded, size);
+        for (const auto& item : items) {
+            map.Insert(item);
+        }
+        meter.measure([&]
+        {
+            size_t count = 0;
+            for (size_t i = 0; i < 1000; ++i) {
+                for ([[ maybe_unused ]] const auto& item : map.CItemsCollidingWith(Circle{ items[i]->GetLocation().x, items[i]->GetLocation().y, 100.0 })) {
+                    ++count;
+                }
+            }
+            return count;
+        });
+    };
+}
+
+} // end anon namespace
+
+TEST_CASE("SpatialMap region storage", "[.][benchmark]")
+{
+    BenchmarkRegionTable<FlatRegionTable>("FlatRegionTable");
+    BenchmarkRegionTable<GridRegionTable>("GridRegionTable (unbounded)");
+    BenchmarkRegionTable<GridRegionTable>("GridRegionTable (bounded)", true);
+    BenchmarkRegionTable<SortedRegionTable>("SortedRegionTable");
+    BenchmarkRegionTable<NodeRegionTable>("NodeRegionTable");
+}
+
+TEST_CASE("SpatialMap region layout", "[.][benchmark]")
+{
+    BenchmarkRegionTable<GridRegionTable, RegionLayout::Pointers>("Pointers", true);
+    BenchmarkRegionTable<GridRegionTable, RegionLayout::Packed>("Packed", true);
+    // Crowded regions, where Packed regions are tested in batches
+    BenchmarkRegionTable<GridRegionTable, RegionLayout::Pointers>("Pointers (crowded)", true, 500.0);
+    BenchmarkRegionTable<GridRegionTable, RegionLayout::Packed>("Packed (crowded)", true, 500.0);
+}
+
+TEST_CASE("SpatialMap parallel MoveAndRemove", "[.][benchmark]")
+{
+    ThreadPool threads;
+    auto map = CreateMap<GridRegionTable, RegionLayout::Pointers>(true);
+    for (const auto& item : CreateItems(itemCount, worldSize)) {
+        map.Insert(item);
+    }
+
+    BENCHMARK("Serial")
+    {
+        map.MoveAndRemove();
+        return map.RegionCount();
+    };
+
+    BENCHMARK("Parallel (" + std::to_string(threads.ThreadCount()) + " threads)")
+    {
+        map.MoveAndRemove(threads);
+        return map.RegionCount();
+    };
+}
+
+TEST_CASE("SpatialMap KNearest", "[.][benchmark]")
+{
+    auto items = CreateItems(itemCount, worldSize);
+    auto map = CreateMap<GridRegionTable, RegionLayout::Pointers>(true);
+    for (const auto& item : items) {
+        map.Insert(item);
+    }
+
+    BENCHMARK("KNearest 8 (1000 queries)")
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < 1000; ++i) {
+            count += std::as_const(map).KNearest(items[i]->GetLocation(), 8).size();
+        }
+        return count;
+    };
+}
+
+TEST_CASE("SpatialMap QueryBatch", "[.][benchmark]")
+{
+    auto items = CreateItems(itemCount, worldSize);
+    auto map = CreateMap<GridRegionTable, RegionLayout::Pointers>(true);
+    for (const auto& item : items) {
+        map.Insert(item);
+    }
+    std::vector<Circle> queries;
+    for (size_t i = 0; i < 10'000; ++i) {
+        queries.push_back({ items[i]->GetLocation().x, items[i]->GetLocation().y, 20.0 });
+    }
+
+    BENCHMARK("ItemsCollidingWith (10000 queries)")
+    {
+        size_t count = 0;
+        for (const auto& query : queries) {
+            for ([[ maybe_unused ]] const auto& item : map.CItemsCollidingWith(query)) {
+                ++count;
+            }
+        }
+        return count;
+    };
+
+    BENCHMARK("QueryBatch (10000 queries)")
+    {
+        size_t count = 0;
+        std::as_const(map).QueryBatch(queries, [&](size_t, const BenchmarkType&) { ++count; });
+        return count;
+    };
+}
+
+TEST_CASE("SpatialMap vision rays", "[.][benchmark]")
+{
+    auto items = CreateItems(itemCount, worldSize);
+    auto map = CreateMap<GridRegionTable, RegionLayout::Pointers>(true);
+    for (const auto& item : items) {
+        map.Insert(item);
+    }
+    // 16 vision rays for each of 1000 agents
+    std::vector<Line> rays;
+    for (size_t i = 0; i < 1000; ++i) {
+        for (size_t ray = 0; ray < 16; ++ray) {
+            const Point& eye = items[i]->GetLocation();
+            rays.push_back({ eye, ApplyOffset(eye, (std::numbers::pi / 8.0) * ray, 500.0) });
+        }
+    }
+
+    BENCHMARK("Items in bounding rect, nearest hit (16000 rays)")
+    {
+        double total = 0.0;
+        for (const Line& ray : rays) {
+            double nearest = 1.0;
+            for (const auto& item : map.CItems(BoundingRect(ray))) {
+                if (auto fraction = FirstIntersection(ray, item.GetCollide())) {
+                    nearest = std::min(nearest, *fraction);
+                }
+            }
+            total += nearest;
+        }
+        return total;
+    };
+
+    BENCHMARK("RayCast, nearest hit (16000 rays)")
+    {
+        double total = 0.0;
+        for (const Line& ray : rays) {
+            map.RayCast(ray, [&](const BenchmarkType&, double distance) { total += distance; }, true);
+        }
+        return total;
+    };
+
+    BENCHMARK("RayCast, all hits (16000 rays)")
+    {
+        size_t count = 0;
+        for (const Line& ray : rays) {
+            map.RayCast(ray, [&](const BenchmarkType&, double) { ++count; });
+        }
+        return count;
+    };
+}
+
+TEST_CASE("SpatialMap colliding pairs", "[.][benchmark]")
+{
+    auto map = CreateMap<GridRegionTable, RegionLayout::Pointers>(true);
+    // A quarter of the usual area so that there are plenty of collisions
+    for (const auto& item : CreateItems(itemCount, worldSize / 2.0)) {
+        map.Insert(item);
+    }
+
+    BENCHMARK("ItemsCollidingWith per item")
+    {
+        size_t count = 0;
+        for (const auto& item : map.CItems()) {
+            for (const auto& other : map.CItemsCollidingWith(item.GetCollide())) {
+                count += &item < &other ? 1 : 0;
+            }
+        }
+        return count;
+    };
+
+    BENCHMARK("ForEachCollidingPair")
+    {
+        size_t count = 0;
+        std::as_const(map).ForEachCollidingPair([&](const BenchmarkType&, const BenchmarkType&) { ++count; });
+        return count;
+    };
+}
+
+TEST_CASE("SpatialMap item pointers", "[.][benchmark]")
+{
+    auto items = CreateItems(itemCount, worldSize);
+    const Rect bounds{ -worldSize, -worldSize, worldSize, worldSize };
+
+    BENCHMARK_ADVANCED("std::shared_ptr MoveAndRemove")(Catch::Benchmark::Chronometer meter)
+    {
+        SpatialMap<BenchmarkType> map(bounds, BenchmarkType::RADIUS, regionSize);
+        for (const auto& item : items) {
+            map.Insert(std::make_shared<BenchmarkType>(*item));
+        }
+        meter.measure([&]
+        {
+            map.MoveAndRemove();
+            return map.RegionCount();
+        });
+    };
+
+    BENCHMARK_ADVANCED("SlotMap MoveAndRemove")(Catch::Benchmark::Chronometer meter)
+    {
+        SlotMap<BenchmarkType> pool;
+        SpatialMap<BenchmarkType, GridRegionTable, RegionLayout::Pointers, BenchmarkType*> map(bounds, BenchmarkType::RADIUS, regionSize);
+        for (const auto& item : items) {
+            map.Insert(pool.Get(pool.Emplace(*item)));
+        }
+        meter.measure([&]
+        {
+            map.MoveAndRemove();
+            return map.RegionCount();
+        });
+    };
+}
+
+TEST_CASE("SpatialMap Erase", "[.][benchmark]")
+{
+    // Crowded regions, so that searching a region for the item dominates
+    constexpr size_t count = 10'000;
+    constexpr double crowdedRegionSize = 2'000.0;
+    auto items = CreateItems(count, worldSize);
+    std::vector<std::shared_ptr<IndexedBenchmarkType>> indexedItems;
+    for (const auto& item : items) {
+        indexedItems.push_back(std::make_shared<IndexedBenchmarkType>(*item));
+    }
+
+    BENCHMARK_ADVANCED("Search")(Catch::Benchmark::Chronometer meter)
+    {
+        SpatialMap<BenchmarkType> map(BenchmarkType::RADIUS, crowdedRegionSize);
+        for (const auto& item : items) {
+            map.Insert(item);
+        }
+        meter.measure([&]
+        {
+            // Reinserted so that every run erases from a full map
+            for (const auto& item : items) {
+                map.Erase(item);
+                map.Insert(item);
+            }
+            return map.Size();
+        });
+    };
+
+    BENCHMARK_ADVANCED("Indexed")(Catch::Benchmark::Chronometer meter)
+    {
+        SpatialMap<IndexedBenchmarkType> map(BenchmarkType::RADIUS, crowdedRegionSize);
+        for (const auto& item : indexedItems) {
+            map.Insert(item);
+        }
+        meter.measure([&]
+        {
+            // Reinserted so that every run erases from a full map
+            for (const auto& item : indexedItems) {
+                map.Erase(item);
+                map.Insert(item);
+            }
+            return map.Size();
+        });
+    };
+}
+
+TEST_CASE("SpatialMap mixed item sizes", "[.][benchmark]")
+{
+    // A few huge obstacles amongst many small agents
+    constexpr double obstacleRadius = 200.0;
+    auto items = CreateItems(itemCount, worldSize);
+    for (size_t i = 0; i < 20; ++i) {
+        Point location{ Random::Number(-worldSize, worldSize), Random::Number(-worldSize, worldSize) };
+        items.push_back(std::make_shared<BenchmarkType>(location, 0.0, 0.0, obstacleRadius));
+    }
+
+    SpatialMap<BenchmarkType> flatMap(obstacleRadius, regionSize);
+    HierarchicalSpatialMap<BenchmarkType> hierarchicalMap(BenchmarkType::RADIUS, regionSize, 4, 5.0);
+    for (const auto& item : items) {
+        flatMap.Insert(item);
+        hierarchicalMap.Insert(item);
+    }
+
+    BENCHMARK("SpatialMap")
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < 1000; ++i) {
+            for ([[maybe_unused]] const auto& other : std::as_const(flatMap).CItemsCollidingWith(items[i]->GetCollide())) {
+                ++count;
+            }
+        }
+        return count;
+    };
+
+    BENCHMARK("HierarchicalSpatialMap")
+    {
+        size_t count = 0;
+        for (size_t i = 0; i < 1000; ++i) {
+            std::as_const(hierarchicalMap).ForEachItemCollidingWith(items[i]->GetCollide(), [&](const BenchmarkType&) { ++count; });
+        }
+        return count;
+    };
+}
@@ -0,0 +1,229 @@
+#include <HierarchicalSpatialMap.h>
+
+#include <Shape.h>
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+#include <tuple>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace util;
+
+namespace {
+
+class SizedType {
+public:
+    SizedType(const Point& location, double radius, double bearing, double speed)
+        : location_(location)
+        , collide_{ location.x, location.y, radius }
+        , bearing_(bearing)
+        , speed_(speed)
+        , exists_(true)
+    {
+    }
+
+    static std::shared_ptr<SizedType> Random()
+    {
+        Point startingLoc{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0) };
+        // Mostly small, with the occasional huge item
+        double radius = Random::Number(0, 100) == 0 ? Random::Number(50.0, 200.0) : Random::Number(1.0, 5.0);
+        double speed = Random::Boolean() ? 0.0 : Random::Number(0.0, 10.0);
+        return std::make_shared<SizedType>(startingLoc, radius, Random::Bearing(), speed);
+    }
+
+    const Point& GetLocation() const
+    {
+        return location_;
+    }
+
+    const Circle& GetCollide() const
+    {
+        return collide_;
+    }
+
+    bool Exists() const
+    {
+        return exists_;
+    }
+
+    bool Move()
+    {
+        if (speed_ != 0) {
+            location_ = ApplyOffset(location_, bearing_, speed_);
+            collide_.x = location_.x;
+            collide_.y = location_.y;
+            return true;
+        }
+        return false;
+    }
+
+    void Terminate()
+    {
+        exists_ = false;
+    }
+
+private:
+    Point location_;
+    Circle collide_;
+    double bearing_;
+    double speed_;
+    bool exists_;
+};
+
+std::vector<Point> Sorted(std::vector<Point> points)
+{
+    std::sort(std::begin(points), std::end(points), [](const Point& a, const Point& b) { return std::tie(a.x, a.y) < std::tie(b.x, b.y); });
+    return points;
+}
+
+} // end anon namespace
+
+TEST_CASE("HierarchicalSpatialMap", "[container]")
+{
+    Random::Seed(34598734);
+
+    // Level radii are 5, 20, 80 & 320
+    HierarchicalSpatialMap<SizedType> hierarchicalMap(5.0, 20.0, 4);
+    SpatialMap<SizedType> flatMap(200.0, 100.0);
+    REQUIRE(hierarchicalMap.LevelCount() == 4);
+    REQUIRE(hierarchicalMap.LevelFor(0.0) == 0);
+    REQUIRE(hierarchicalMap.LevelFor(5.0) == 0);
+    REQUIRE(hierarchicalMap.LevelFor(5.1) == 1);
+    REQUIRE(hierarchicalMap.LevelFor(200.0) == 3);
+    REQUIRE(hierarchicalMap.LevelFor(320.1) == 4);
+
+    // Each map moves its own items
+    std::vector<std::shared_ptr<SizedType>> items;
+    std::vector<std::shared_ptr<SizedType>> flatItems;
+    for (size_t i = 0; i < 1000; ++i) {
+        items.push_back(SizedType::Random());
+        flatItems.push_back(std::make_shared<SizedType>(*items.back()));
+        hierarchicalMap.Insert(items.back());
+        flatMap.Insert(flatItems.back());
+    }
+    REQUIRE(hierarchicalMap.Size() == items.size());
+    REQUIRE(hierarchicalMap.Level(0).Size() > hierarchicalMap.Level(3).Size());
+    REQUIRE(hierarchicalMap.Level(3).Size() > 0);
+
+    for (int tick = 0; tick < 10; ++tick) {
+        size_t toTerminate = Random::Number<size_t>(0, items.size() - 1);
+        items[toTerminate]->Terminate();
+        flatItems[toTerminate]->Terminate();
+        size_t toErase = Random::Number<size_t>(0, items.size() - 1);
+        hierarchicalMap.Erase(items[toErase]);
+        flatMap.Erase(flatItems[toErase]);
+
+        hierarchicalMap.MoveAndRemove();
+        flatMap.MoveAndRemove();
+        REQUIRE(hierarchicalMap.Size() == flatMap.Size());
+
+        std::vector<Circle> queries;
+        for (int i = 0; i < 10; ++i) {
+            queries.push_back({ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), Random::Number(0.0, 300.0) });
+        }
+
+        for (const Circle& query : queries) {
+            std::vector<Point> expected;
+            for (const SizedType& item : flatMap.CItemsCollidingWith(query)) {
+                expected.push_back(item.GetLocation());
+            }
+            std::vector<Point> actual;
+            std::as_const(hierarchicalMap).ForEachItemCollidingWith(query, [&](const SizedType& item)
+            {
+                actual.push_back(item.GetLocation());
+            });
+            REQUIRE(Sorted(actual) == Sorted(expected));
+
+            size_t nonConstCount = 0;
+            hierarchicalMap.ForEachItemCollidingWith(query, [&](std::shared_ptr<SizedType>&) { ++nonConstCount; });
+            REQUIRE(nonConstCount == actual.size());
+        }
+
+        std::vector<std::vector<Point>> batched(queries.size());
+        std::as_const(hierarchicalMap).QueryBatch(queries, [&](size_t query, const SizedType& item)
+        {
+            batched[query].push_back(item.GetLocation());
+        });
+        for (size_t query = 0; query < queries.size(); ++query) {
+            std::vector<Point> expected;
+            for (const SizedType& item : flatMap.CItemsCollidingWith(queries[query])) {
+                expected.push_back(item.GetLocation());
+            }
+            REQUIRE(Sorted(batched[query]) == Sorted(expected));
+        }
+
+        std::vector<std::pair<Point, Point>> expectedPairs;
+        std::as_const(flatMap).ForEachCollidingPair([&](const SizedType& a, const SizedType& b)
+        {
+            expectedPairs.push_back(std::minmax(a.GetLocation(), b.GetLocation(), [](const Point& l, const Point& r) { return std::tie(l.x, l.y) < std::tie(r.x, r.y); }));
+        });
+        std::vector<std::pair<Point, Point>> actualPairs;
+        std::as_const(hierarchicalMap).ForEachCollidingPair([&](const SizedType& a, const SizedType& b)
+        {
+            actualPairs.push_back(std::minmax(a.GetLocation(), b.GetLocation(), [](const Point& l, const Point& r) { return std::tie(l.x, l.y) < std::tie(r.x, r.y); }));
+        });
+        auto pairLess = [](const auto& l, const auto& r)
+        {
+            return std::tie(l.first.x, l.first.y, l.second.x, l.second.y) < std::tie(r.first.x, r.first.y, r.second.x, r.second.y);
+        };
+        std::sort(std::begin(expectedPairs), std::end(expectedPairs), pairLess);
+        std::sort(std::begin(actualPairs), std::end(actualPairs), pairLess);
+        REQUIRE(!expectedPairs.empty());
+        REQUIRE(actualPairs == expectedPairs);
+
+        size_t nonConstPairs = 0;
+        hierarchicalMap.ForEachCollidingPair([&](std::shared_ptr<SizedType>&, std::shared_ptr<SizedType>&) { ++nonConstPairs; });
+        REQUIRE(nonConstPairs == actualPairs.size());
+    }
+
+    hierarchicalMap.RemoveIf([](const SizedType& item) { return item.GetCollide().radius > 5.0; });
+    REQUIRE(hierarchicalMap.Size() == hierarchicalMap.Level(0).Size());
+    hierarchicalMap.Clear();
+    REQUIRE(hierarchicalMap.Size() == 0);
+}
+
+TEST_CASE("HierarchicalSpatialMap oversized items", "[container]")
+{
+    // Level radii are 5 & 20
+    HierarchicalSpatialMap<SizedType> map(5.0, 20.0, 2);
+    auto small = std::make_shared<SizedType>(Point{ 0, 0 }, 1.0, 0.0, 0.0);
+    auto huge = std::make_shared<SizedType>(Point{ 1000, 0 }, 1000.0, 0.0, 0.0);
+    REQUIRE(map.LevelFor(1000.0) == map.LevelCount());
+
+    // Levels are added up to one that fits, radius 1280
+    map.Insert(small);
+    map.Insert(huge);
+    REQUIRE(map.LevelCount() == 5);
+    REQUIRE(map.Level(4).Size() == 1);
+    REQUIRE(map.Size() == 2);
+
+    // Found by queries far from its location, but within its radius
+    size_t found = 0;
+    std::as_const(map).ForEachItemCollidingWith(Point{ 0.5, 0.5 }, [&](const SizedType&) { ++found; });
+    REQUIRE(found == 2);
+
+    size_t pairs = 0;
+    std::as_const(map).ForEachCollidingPair([&](const SizedType&, const SizedType&) { ++pairs; });
+    REQUIRE(pairs == 1);
+
+    map.Erase(huge);
+    REQUIRE(map.Size() == 1);
+    // Erasing an item larger than any level is a no-op
+    map.Erase(std::make_shared<SizedType>(Point{ 0, 0 }, 5000.0, 0.0, 0.0));
+    REQUIRE(map.Size() == 1);
+
+    // Items that no level could hold are rejected
+    auto infinite = std::make_shared<SizedType>(Point{ 0, 0 }, std::numeric_limits<double>::infinity(), 0.0, 0.0);
+    REQUIRE_THROWS_AS(map.Insert(infinite), std::invalid_argument);
+    REQUIRE_THROWS_AS(map.Insert(std::move(infinite)), std::invalid_argument);
+    // A NaN edge would be skipped by std::max unless it happened to come first
+    auto nan = std::make_shared<SizedType>(Point{ 0, std::numeric_limits<double>::quiet_NaN() }, 1.0, 0.0, 0.0);
+    REQUIRE(std::isinf(map.Radius(*nan)));
+    REQUIRE_THROWS_AS(map.Insert(nan), std::invalid_argument);
+    map.Erase(nan);
+    REQUIRE(map.LevelCount() == 5);
+    REQUIRE(map.Size() == 1);
+}
@@ -0,0 +1,252 @@
+#include <LinearQuadTree.h>
+#include <QuadTree.h>
+#include <SlotMap.h>
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+using namespace util;
+
+namespace {
+
+class TestType {
+public:
+    Point location_;
+    Circle collide_;
+
+    TestType(const Point& location)
+        : location_(location)
+        , collide_{ location.x, location.y, 0 }
+    {
+    }
+
+    const Point& GetLocation() const
+    {
+        return location_;
+    }
+
+    const Circle& GetCollide() const
+    {
+        return collide_;
+    }
+
+    void SetLocation(const Point& location)
+    {
+        location_ = location;
+        collide_.x = location.x;
+        collide_.y = location.y;
+    }
+};
+
+inline auto PointComparator = [](const Point& a, const Point& b)
+{
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+};
+
+template <typename Tree>
+std::vector<Point> QuadCorners(const Tree& tree)
+{
+    std::vector<Point> corners;
+    tree.ForEachQuad([&](const Rect& rect)
+    {
+        corners.push_back({ rect.left, rect.top });
+        corners.push_back({ rect.right, rect.bottom });
+    });
+    std::sort(std::begin(corners), std::end(corners), PointComparator);
+    return corners;
+}
+
+template <typename Tree>
+std::vector<Point> ItemLocations(const Tree& tree)
+{
+    std::vector<Point> locations;
+    tree.ForEachItem([&](const TestType& item)
+    {
+        locations.push_back(item.GetLocation());
+    });
+    std::sort(std::begin(locations), std::end(locations), PointComparator);
+    return locations;
+}
+
+}
+
+TEST_CASE("LinearQuadTree", "[container]")
+{
+    Random::Seed(42);
+
+    const Rect area{ 0, 0, 10, 10 };
+
+    SECTION("Empty Tree")
+    {
+        LinearQuadTree<TestType> tree(area, 1, 0, 1.0);
+
+        REQUIRE(tree.Validate());
+        REQUIRE(tree.Size() == 0);
+        REQUIRE(tree.QuadCount() == 1);
+    }
+
+    SECTION("Matches QuadTree")
+    {
+        std::vector<std::pair<size_t, size_t>> targetAndLeewayCombinations{
+            { 1, 0 },
+            { 5, 0 },
+            { 5, 5 },
+            { 25, 5 },
+            { 0, 7 },
+        };
+        for (const auto& [ targetCount, countLeeway ] : targetAndLeewayCombinations) {
+            LinearQuadTree<TestType> linear(area, targetCount, countLeeway, 0.5);
+            QuadTree<TestType> tree(area, targetCount, countLeeway, 0.5);
+
+            for (size_t i = 0; i < 200; ++i) {
+                auto item = std::make_shared<TestType>(Random::PointIn(area));
+                linear.Insert(std::make_shared<TestType>(*item));
+                tree.Insert(item);
+            }
+            REQUIRE(linear.Validate());
+            REQUIRE(linear.Size() == 200);
+            REQUIRE(QuadCorners(linear) == QuadCorners(tree));
+            REQUIRE(ItemLocations(linear) == ItemLocations(tree));
+
+            auto inLeft = [](const TestType& item) { return item.location_.x < 3.0; };
+            linear.RemoveIf(inLeft);
+            tree.RemoveIf(inLeft);
+            REQUIRE(linear.Validate());
+            REQUIRE(QuadCorners(linear) == QuadCorners(tree));
+            REQUIRE(ItemLocations(linear) == ItemLocations(tree));
+        }
+    }
+
+    SECTION("Filtered iteration")
+    {
+        LinearQuadTree<TestType> linear(area, 4, 1, 0.5);
+        QuadTree<TestType> tree(area, 4, 1, 0.5);
+        for (size_t i = 0; i < 500; ++i) {
+            auto item = std::make_shared<TestType>(Random::PointIn(area));
+            linear.Insert(item);
+            tree.Insert(item);
+        }
+
+        const Circle collider{ 3.0, 6.0, 2.0 };
+        std::vector<Point> expected;
+        tree.ForEachItem(tree.ConstIterator([&](const TestType& item)
+        {
+            expected.push_back(item.GetLocation());
+        }).SetQuadFilter(collider).SetItemFilter(collider));
+
+        std::vector<Point> found;
+        linear.ForEachItem([&](const TestType& item)
+        {
+            found.push_back(item.GetLocation());
+        }, [&](const Rect& quad) { return Collides(collider, quad); }, [&](const TestType& item) { return Collides(collider, item.GetCollide()); });
+
+        REQUIRE(!found.empty());
+        REQUIRE(found == expected);
+
+        size_t quadsVisited = 0;
+        linear.ForEachQuad([&](const Rect&) { ++quadsVisited; }, [&](const Rect& quad) { return Collides(collider, quad); });
+        REQUIRE(quadsVisited < linear.QuadCount());
+    }
+
+    SECTION("Items out of bounds")
+    {
+        for (Point outOfBounds : { Point{ -1, -1 }, Point{ 11, 11 }, Point{ -100, 11 }, Point{ 100, 110 } }) {
+            LinearQuadTree<TestType> tree(area, 1, 0, 1.0);
+            for (int i = 0; i < 25; ++i) {
+                tree.Insert(std::make_shared<TestType>(Random::PointIn(area)));
+            }
+            tree.Insert(std::make_shared<TestType>(outOfBounds));
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == 26);
+
+            // Removing the far item should contract the root again
+            tree.RemoveIf([&](const TestType& item) { return item.GetLocation() == outOfBounds; });
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == 25);
+        }
+    }
+
+    SECTION("Moving and removing items")
+    {
+        LinearQuadTree<TestType> tree(area, 5, 2, 0.5);
+        for (size_t i = 0; i < 200; ++i) {
+            tree.Insert(std::make_shared<TestType>(Random::PointIn(area)));
+        }
+
+        for (int tick = 0; tick < 50; ++tick) {
+            tree.ForEachItem([&](const std::shared_ptr<TestType>& item)
+            {
+                item->SetLocation({ item->location_.x + Random::Number(-1.0, 1.0), item->location_.y + Random::Number(-1.0, 1.0) });
+                // Inserting mid iteration is deferred until the iteration ends
+                if (Random::Number(0, 50) == 0) {
+                    tree.Insert(std::make_shared<TestType>(Random::PointIn(area)));
+                }
+            }, AcceptAll{}, AcceptAll{}, [&](const TestType& item)
+            {
+                return !Contains(Rect{ -5, -5, 15, 15 }, item.GetLocation());
+            });
+            REQUIRE(tree.Validate());
+
+            size_t size = 0;
+            tree.ForEachItem([&](const TestType& item)
+            {
+                ++size;
+                REQUIRE(Contains(Rect{ -5, -5, 15, 15 }, item.GetLocation()));
+            });
+            REQUIRE(size == tree.Size());
+        }
+
+        tree.Clear();
+        REQUIRE(tree.Validate());
+        REQUIRE(tree.Size() == 0);
+    }
+
+    SECTION("Quads are reused")
+    {
+        LinearQuadTree<TestType> tree(area, 1, 0, 0.1);
+        std::vector<std::shared_ptr<TestType>> items;
+        for (size_t i = 0; i < 100; ++i) {
+            items.push_back(std::make_shared<TestType>(Random::PointIn(area)));
+        }
+
+        tree.BulkInsert(items);
+        size_t quadCount = tree.QuadCount();
+        REQUIRE(tree.Validate());
+
+        tree.RemoveIf([](const TestType&) { return true; });
+        REQUIRE(tree.Validate());
+        REQUIRE(tree.QuadCount() == 1);
+
+        tree.BulkInsert(items);
+        REQUIRE(tree.Validate());
+        REQUIRE(tree.QuadCount() == quadCount);
+    }
+}
+
+TEST_CASE("LinearQuadTree raw pointers", "[container]")
+{
+    Random::Seed(42);
+
+    const Rect area{ 0, 0, 10, 10 };
+    LinearQuadTree<TestType, TestType*> tree(area, 5, 2, 1.0);
+    SlotMap<TestType> pool;
+
+    for (size_t i = 0; i < 200; ++i) {
+        tree.Insert(pool.Get(pool.Emplace(Random::PointIn(area))));
+    }
+    REQUIRE(tree.Validate());
+    REQUIRE(tree.Size() == 200);
+
+    for (int tick = 0; tick < 20; ++tick) {
+        tree.ForEachItem([&](TestType* item)
+        {
+            item->SetLocation(Random::PointIn(area));
+        }, AcceptAll{}, AcceptAll{}, [](const TestType& item)
+        {
+            return item.location_.x < 0.5;
+        });
+        REQUIRE(tree.Validate());
+    }
+
+    REQUIRE(tree.Size() < pool.Size());
+}
@@ -0,0 +1,97 @@
+#include <PackedShapes.h>
+
+#include <Shape.h>
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+using namespace util;
+
+TEST_CASE("PackedShapes", "[container]")
+{
+    Random::Seed(42);
+
+    SECTION("Circle components")
+    {
+        PackedShapes<Circle> circles;
+        REQUIRE(circles.Size() == 0);
+        REQUIRE(PackedShapes<Circle>::COMPONENT_COUNT == 3);
+
+        std::vector<Circle> expected;
+        for (int i = 0; i < 100; ++i) {
+            expected.push_back(Circle{ Random::Number(-100.0, 100.0), Random::Number(-100.0, 100.0), Random::Number(0.0, 10.0) });
+            circles.PushBack(expected.back());
+        }
+        REQUIRE(circles.Size() == expected.size());
+
+        for (size_t i = 0; i < expected.size(); ++i) {
+            Circle c = circles.Get(i);
+            REQUIRE(c.x == expected[i].x);
+            REQUIRE(c.y == expected[i].y);
+            REQUIRE(c.radius == expected[i].radius);
+            REQUIRE(circles.Component(0)[i] == expected[i].x);
+            REQUIRE(circles.Component(1)[i] == expected[i].y);
+            REQUIRE(circles.Component(2)[i] == expected[i].radius);
+        }
+
+        circles.Set(5, Circle{ 1, 2, 3 });
+        REQUIRE(circles.Get(5).x == 1);
+        REQUIRE(circles.Get(5).y == 2);
+        REQUIRE(circles.Get(5).radius == 3);
+
+        circles.Copy(7, 5);
+        REQUIRE(circles.Get(5).x == expected[7].x);
+        REQUIRE(circles.Get(5).radius == expected[7].radius);
+
+        circles.Resize(10);
+        REQUIRE(circles.Size() == 10);
+        circles.Clear();
+        REQUIRE(circles.Size() == 0);
+    }
+
+    SECTION("Other shapes")
+    {
+        PackedShapes<Rect> rects;
+        rects.PushBack(Rect{ 1, 2, 3, 4 });
+        REQUIRE(rects.Get(0) == Rect{ 1, 2, 3, 4 });
+
+        PackedShapes<Point> points;
+        points.PushBack(Point{ 5, 6 });
+        REQUIRE(points.Get(0) == Point{ 5, 6 });
+
+        PackedShapes<Line> lines;
+        lines.PushBack(Line{ { 1, 2 }, { 3, 4 } });
+        REQUIRE(lines.Get(0).a == Point{ 1, 2 });
+        REQUIRE(lines.Get(0).b == Point{ 3, 4 });
+        REQUIRE(lines.Component(2)[0] == 3);
+    }
+
+    SECTION("Narrow scalars")
+    {
+        PackedShapes<BasicCircle<float>> circles;
+        static_assert(PackedShapes<BasicCircle<float>>::COMPONENT_COUNT == 3);
+        static_assert(std::is_same_v<decltype(circles.Component(0)), std::span<const float>>);
+        circles.Reserve(64);
+        REQUIRE(circles.BytesAllocated() == 64 * sizeof(float) * 3);
+
+        std::vector<BasicCircle<float>> expected;
+        for (int i = 0; i < 64; ++i) {
+            expected.push_back({ Random::Number(-100.0f, 100.0f), Random::Number(-100.0f, 100.0f), Random::Number(0.0f, 10.0f) });
+            circles.PushBack(expected.back());
+        }
+
+        const Circle query{ 0.0, 0.0, 50.0 };
+        std::vector<uint8_t> out(circles.Size());
+        circles.CollidesWith(query, out);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            REQUIRE(circles.Get(i).x == expected[i].x);
+            REQUIRE(circles.Component(2)[i] == expected[i].radius);
+            REQUIRE(static_cast<bool>(out[i]) == Collides(query, expected[i]));
+        }
+
+        PackedShapes<BasicRect<int32_t>> rects;
+        rects.PushBack({ 1, 2, 3, 4 });
+        REQUIRE(rects.Get(0) == BasicRect<int32_t>{ 1, 2, 3, 4 });
+        REQUIRE(rects.Component(3)[0] == 4);
+    }
+}
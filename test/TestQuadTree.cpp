@@ -1,8 +1,13 @@
 #include <QuadTree.h>
+#include <ThreadPool.h>
+#include <SlotMap.h>
 #include <Random.h>
 
 #include <catch2/catch.hpp>
 
+#include <atomic>
+#include <mutex>
+
 using namespace util;
 
 namespace {
@@ -381,6 +386,56 @@ TEST_CASE("QuadTree", "[container]")
         }
     }
 
+    SECTION("Templated iteration")
+    {
+        const Rect area{ 0, 0, 10, 10 };
+        const Circle collider{ 4, 4, 2 };
+        QuadTree<TestType> tree(area, 4, 1, 0.5);
+
+        for (size_t i = 0; i < 200; ++i) {
+            tree.Insert(std::make_shared<TestType>(Random::PointIn(area)));
+        }
+
+        std::vector<Point> expected;
+        tree.ForEachItem(tree.ConstIterator([&](const TestType& item)
+        {
+            expected.push_back(item.GetLocation());
+        }).SetQuadFilter(collider).SetItemFilter(collider));
+
+        std::vector<Point> found;
+        std::as_const(tree).ForEachItem([&](const TestType& item)
+        {
+            found.push_back(item.GetLocation());
+        }, [&](const Rect& quad) { return Collides(collider, quad); }, [&](const TestType& item) { return Collides(collider, item.GetCollide()); });
+
+        REQUIRE(!found.empty());
+        REQUIRE(found == expected);
+
+        // Non-const, moving some items and removing others
+        size_t moved = 0;
+        tree.ForEachItem([&](const std::shared_ptr<TestType>& item)
+        {
+            ++moved;
+            item->location_ = Random::PointIn(area);
+            item->collide_.x = item->location_.x;
+            item->collide_.y = item->location_.y;
+        }, [&](const Rect& quad) { return Collides(collider, quad); }, [&](const TestType& item) { return Collides(collider, item.GetCollide()); }, [](const TestType& item)
+        {
+            return item.location_.x < 1.0;
+        });
+
+        REQUIRE(moved == expected.size());
+        REQUIRE(tree.Validate());
+        size_t remaining = 0;
+        tree.ForEachItem([&](const TestType& item)
+        {
+            ++remaining;
+            REQUIRE(item.location_.x >= 1.0);
+        });
+        REQUIRE(remaining == tree.Size());
+        REQUIRE(remaining < 200);
+    }
+
     SECTION("Moving items")
     {
         const Rect area{ 0, 0, 10, 10 };
@@ -415,6 +470,49 @@ TEST_CASE("QuadTree", "[container]")
         }
     }
 
+    SECTION("Relocating items")
+    {
+        const Rect area{ 0, 0, 10, 10 };
+        QuadTree<TestType> tree(area, 4, 1, 0.1);
+        std::vector<std::shared_ptr<TestType>> items;
+        for (size_t i = 0; i < 200; ++i) {
+            items.push_back(std::make_shared<TestType>(Random::PointIn(area)));
+        }
+        tree.BulkInsert(items);
+
+        for (int tick = 0; tick < 50; ++tick) {
+            // Move a few items, mostly a little, but some out of bounds
+            std::vector<std::shared_ptr<TestType>> moved;
+            std::vector<Point> previousLocations;
+            for (const auto& item : items) {
+                if (Random::Number(0, 10) == 0) {
+                    previousLocations.push_back(item->location_);
+                    moved.push_back(item);
+                    double jump = Random::Number(0, 20) == 0 ? 10.0 : 0.5;
+                    item->location_ = { item->location_.x + Random::Number(-jump, jump), item->location_.y + Random::Number(-jump, jump) };
+                    // Relocated one at a time, each before the next moves
+                    if (tick % 2 == 0) {
+                        REQUIRE(tree.Relocate(*item, previousLocations.back()));
+                    }
+                }
+            }
+
+            if (tick % 2 != 0) {
+                size_t index = 0;
+                REQUIRE(tree.Relocate(moved, [&](const TestType&) { return previousLocations[index++]; }) == moved.size());
+            }
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == items.size());
+        }
+
+        // Items that aren't in the tree, or aren't where they are claimed to have been, aren't found
+        TestType stranger({ 5, 5 });
+        REQUIRE(!tree.Relocate(stranger, stranger.location_));
+        REQUIRE(!tree.Relocate(*items.front(), { items.front()->location_.x + 100.0, items.front()->location_.y }));
+        REQUIRE(tree.Validate());
+        REQUIRE(tree.Size() == items.size());
+    }
+
     SECTION("Full use-case test")
     {
         const Rect startArea{ 0, 0, 10, 10 };
@@ -563,4 +661,501 @@ TEST_CASE("QuadTree", "[container]")
 
         REQUIRE(tree.Size() < itemCount);
     }
+
+    SECTION("BulkInsert")
+    {
+        const Rect area{ 0, 0, 100, 100 };
+        QuadTree<TestType> individual(area, 8, 2, 1.0);
+        QuadTree<TestType> bulk(area, 8, 2, 1.0);
+
+        std::vector<std::shared_ptr<TestType>> items;
+        for (size_t i = 0; i < 1000; ++i) {
+            items.push_back(std::make_shared<TestType>(Random::PointIn(area)));
+            individual.Insert(items.back());
+        }
+        bulk.BulkInsert(items);
+
+        REQUIRE(bulk.Validate());
+        REQUIRE(bulk.Size() == items.size());
+
+        // A single rebalance must split the tree exactly as far as inserting one at a time would
+        auto quadsOf = [](const QuadTree<TestType>& tree)
+        {
+            std::vector<Point> corners;
+            tree.ForEachQuad([&](const Rect& rect)
+            {
+                corners.push_back({ rect.left, rect.top });
+                corners.push_back({ rect.right, rect.bottom });
+            });
+            std::sort(std::begin(corners), std::end(corners), PointComparator);
+            return corners;
+        };
+        REQUIRE(quadsOf(bulk) == quadsOf(individual));
+
+        bulk.RemoveIf([](const TestType& item) { return item.location_.x > 10.0; });
+        REQUIRE(bulk.Validate());
+        REQUIRE(quadsOf(bulk).size() < quadsOf(individual).size());
+    }
+
+    SECTION("Build")
+    {
+        auto quadsOf = [](const QuadTree<TestType>& tree)
+        {
+            std::vector<Rect> quads;
+            tree.ForEachQuad([&](const Rect& rect)
+            {
+                quads.push_back(rect);
+            });
+            return quads;
+        };
+
+        SECTION("Empty")
+        {
+            auto tree = QuadTree<TestType>::Build(std::vector<std::shared_ptr<TestType>>{}, 4, 1, 1.0);
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == 0);
+        }
+
+        SECTION("Same location")
+        {
+            std::vector<std::shared_ptr<TestType>> items;
+            for (int i = 0; i < 20; ++i) {
+                items.push_back(std::make_shared<TestType>(Point{ 3, 3 }));
+            }
+            auto tree = QuadTree<TestType>::Build(items, 4, 1, 1.0);
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == items.size());
+        }
+
+        for (const auto& [ targetCount, countLeeway ] : { std::pair<size_t, size_t>{ 1, 0 }, { 8, 2 }, { 25, 10 } }) {
+            const Rect area{ -50, 20, 150, 70 };
+            std::vector<std::shared_ptr<TestType>> items;
+            std::vector<Point> locations;
+            for (size_t i = 0; i < 2000; ++i) {
+                items.push_back(std::make_shared<TestType>(Random::PointIn(area)));
+                locations.push_back(items.back()->GetLocation());
+            }
+
+            auto tree = QuadTree<TestType>::Build(items, targetCount, countLeeway, 0.01);
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == items.size());
+
+            std::vector<Point> found;
+            tree.ForEachItem([&](const TestType& item)
+            {
+                found.push_back(item.GetLocation());
+            });
+            std::sort(std::begin(found), std::end(found), PointComparator);
+            std::sort(std::begin(locations), std::end(locations), PointComparator);
+            REQUIRE(found == locations);
+
+            // The root is square, and the same quads result from inserting into a tree of that area
+            Rect root = quadsOf(tree).front();
+            REQUIRE(root.right - root.left == Approx(root.bottom - root.top));
+            REQUIRE(root.right - root.left == Approx(200.0).epsilon(0.01));
+            QuadTree<TestType> inserted(root, targetCount, countLeeway, 0.01);
+            inserted.BulkInsert(items);
+            auto builtQuads = quadsOf(tree);
+            auto insertedQuads = quadsOf(inserted);
+            REQUIRE(builtQuads == insertedQuads);
+        }
+    }
+}
+
+TEST_CASE("QuadTree raw pointers", "[container]")
+{
+    Random::Seed(42);
+
+    const Rect area{ 0, 0, 10, 10 };
+    QuadTree<TestType, TestType*> tree(area, 5, 2, 1.0);
+    SlotMap<TestType> pool;
+
+    for (size_t i = 0; i < 200; ++i) {
+        tree.Insert(pool.Get(pool.Emplace(Random::PointIn(area))));
+    }
+    REQUIRE(tree.Validate());
+    REQUIRE(tree.Size() == 200);
+
+    for (int tick = 0; tick < 20; ++tick) {
+        tree.ForEachItem(tree.Iterator([&](TestType* item)
+        {
+            item->location_ = Random::PointIn(area);
+        }).SetRemoveItemPredicate([](const TestType& item) { return item.location_.x < 0.5; }));
+        REQUIRE(tree.Validate());
+    }
+
+    // The tree does not own its items, so those it removed are still in the pool
+    size_t inTree = 0;
+    tree.ForEachItem(tree.ConstIterator([&](const TestType&) { ++inTree; }));
+    REQUIRE(inTree == tree.Size());
+    REQUIRE(inTree < pool.Size());
+}
+
+TEST_CASE("QuadTree parallel iteration", "[container][threads]")
+{
+    Random::Seed(42);
+
+    const Rect area{ 0, 0, 100, 100 };
+    ThreadPool threads(4);
+    QuadTree<TestType> tree(area, 8, 2, 1.0);
+    tree.SetParallelTaskItemCount(GENERATE(size_t{ 1 }, size_t{ 50 }, size_t{ 100'000 }));
+
+    for (size_t i = 0; i < 2000; ++i) {
+        tree.Insert(std::make_shared<TestType>(Random::PointIn(area)));
+    }
+
+    SECTION("const")
+    {
+        const Circle collider{ 30, 60, 25 };
+        std::vector<Point> expected;
+        tree.ForEachItem([&](const TestType& item)
+        {
+            expected.push_back(item.GetLocation());
+        }, [&](const Rect& quad) { return Collides(collider, quad); }, [&](const TestType& item) { return Collides(collider, item.GetCollide()); });
+
+        std::mutex mutex;
+        std::vector<Point> found;
+        std::as_const(tree).ForEachItem(threads, [&](const TestType& item)
+        {
+            std::scoped_lock lock(mutex);
+            found.push_back(item.GetLocation());
+        }, [&](const Rect& quad) { return Collides(collider, quad); }, [&](const TestType& item) { return Collides(collider, item.GetCollide()); });
+
+        std::sort(std::begin(expected), std::end(expected), PointComparator);
+        std::sort(std::begin(found), std::end(found), PointComparator);
+        REQUIRE(!found.empty());
+        REQUIRE(found == expected);
+    }
+
+    SECTION("non-const")
+    {
+        for (int tick = 0; tick < 10; ++tick) {
+            std::atomic<size_t> visited = 0;
+            std::atomic<size_t> inserted = 0;
+            size_t before = tree.Size();
+            tree.ForEachItem(threads, [&](const std::shared_ptr<TestType>& item)
+            {
+                ++visited;
+                item->location_.x += 5.0;
+                item->collide_.x = item->location_.x;
+                if (item->location_.y < 1.0) {
+                    tree.Insert(std::make_shared<TestType>(Point{ item->location_.y, item->location_.x }));
+                    ++inserted;
+                }
+            }, AcceptAll{}, AcceptAll{}, [&](const TestType& item)
+            {
+                return item.location_.x > 100.0;
+            });
+
+            REQUIRE(visited == before);
+            REQUIRE(tree.Validate());
+            size_t outside = 0;
+            tree.ForEachItem([&](const TestType& item)
+            {
+                outside += item.location_.x > 100.0 ? 1 : 0;
+            });
+            REQUIRE(outside == 0);
+            REQUIRE(tree.Size() <= before + inserted);
+        }
+    }
+}
+
+TEST_CASE("Loose QuadTree", "[container]")
+{
+    Random::Seed(42);
+
+    class SizedType {
+    public:
+        Point location_;
+        Circle collide_;
+
+        SizedType(const Point& location, double radius)
+            : location_(location)
+            , collide_{ location.x, location.y, radius }
+        {
+        }
+
+        const Point& GetLocation() const
+        {
+            return location_;
+        }
+
+        const Circle& GetCollide() const
+        {
+            return collide_;
+        }
+    };
+
+    const Rect area{ 0, 0, 100, 100 };
+    std::vector<std::shared_ptr<SizedType>> items;
+    for (size_t i = 0; i < 1000; ++i) {
+        // Mostly small items, with a few very large ones
+        double radius = i % 50 == 0 ? Random::Number(10.0, 30.0) : Random::Number(0.0, 1.0);
+        items.push_back(std::make_shared<SizedType>(Random::PointIn(area), radius));
+    }
+
+    double looseness = GENERATE(1.0, 1.5, 2.0);
+    QuadTree<SizedType> tree(area, 8, 2, 1.0, looseness);
+    for (const auto& item : items) {
+        tree.Insert(item);
+    }
+    REQUIRE(tree.Validate());
+    REQUIRE(tree.Size() == items.size());
+
+    auto bruteForce = [&](const Circle& collider)
+    {
+        std::vector<const SizedType*> colliding;
+        for (const auto& item : items) {
+            if (Collides(collider, item->GetCollide())) {
+                colliding.push_back(item.get());
+            }
+        }
+        std::sort(std::begin(colliding), std::end(colliding));
+        return colliding;
+    };
+
+    auto query = [&](const Circle& collider)
+    {
+        // Unpadded quad filter
+        std::vector<const SizedType*> colliding;
+        tree.ForEachItem(tree.ConstIterator([&](const SizedType& item)
+        {
+            colliding.push_back(&item);
+        }).SetQuadFilter(collider).SetItemFilter(collider));
+        std::sort(std::begin(colliding), std::end(colliding));
+        return colliding;
+    };
+
+    SECTION("Queries need no padding")
+    {
+        for (int i = 0; i < 100; ++i) {
+            Point centre = Random::PointIn(area);
+            Circle collider{ centre.x, centre.y, Random::Number(0.0, 5.0) };
+            REQUIRE(query(collider) == bruteForce(collider));
+        }
+    }
+
+    SECTION("Moving items")
+    {
+        for (int tick = 0; tick < 20; ++tick) {
+            tree.ForEachItem([&](const std::shared_ptr<SizedType>& item)
+            {
+                item->location_ = Random::PointIn(area);
+                item->collide_.x = item->location_.x;
+                item->collide_.y = item->location_.y;
+            });
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == items.size());
+        }
+
+        for (int i = 0; i < 100; ++i) {
+            Point centre = Random::PointIn(area);
+            Circle collider{ centre.x, centre.y, Random::Number(0.0, 5.0) };
+            REQUIRE(query(collider) == bruteForce(collider));
+        }
+
+        tree.RemoveIf([](const SizedType& item) { return item.collide_.radius < 5.0; });
+        REQUIRE(tree.Validate());
+        REQUIRE(tree.Size() == 20);
+    }
+
+    SECTION("Parallel queries")
+    {
+        ThreadPool threads(3);
+        tree.SetParallelTaskItemCount(20);
+        Circle collider{ 52.5, 48.5, 10 };
+        std::mutex mutex;
+        std::vector<const SizedType*> colliding;
+        std::as_const(tree).ForEachItem(threads, [&](const SizedType& item)
+        {
+            std::scoped_lock lock(mutex);
+            colliding.push_back(&item);
+        }, [&](const Rect& quad) { return Collides(collider, quad); }, [&](const SizedType& item) { return Collides(collider, item.GetCollide()); });
+        std::sort(std::begin(colliding), std::end(colliding));
+        REQUIRE(!colliding.empty());
+        REQUIRE(colliding == bruteForce(collider));
+    }
+
+    SECTION("Relocating items")
+    {
+        for (int tick = 0; tick < 20; ++tick) {
+            std::vector<std::pair<std::shared_ptr<SizedType>, Point>> moved;
+            for (const auto& item : items) {
+                if (Random::Boolean()) {
+                    moved.push_back({ item, item->location_ });
+                    item->location_ = Random::PointIn(area);
+                    item->collide_.x = item->location_.x;
+                    item->collide_.y = item->location_.y;
+                }
+            }
+            auto previous = std::begin(moved);
+            REQUIRE(tree.Relocate(moved | std::views::keys, [&](const SizedType&) { return (previous++)->second; }) == moved.size());
+            REQUIRE(tree.Validate());
+            REQUIRE(tree.Size() == items.size());
+        }
+
+        for (int i = 0; i < 100; ++i) {
+            Point centre = Random::PointIn(area);
+            Circle collider{ centre.x, centre.y, Random::Number(0.0, 5.0) };
+            REQUIRE(query(collider) == bruteForce(collider));
+        }
+    }
+
+    SECTION("Ray casts")
+    {
+        // A tight tree needs its quads padded by the largest item radius
+        QuadTree<SizedType> tight(area, 8, 2, 1.0);
+        tight.BulkInsert(items);
+
+        auto requireMatchesBruteForce = [&](const Line& ray)
+        {
+            std::vector<double> expected;
+            for (const auto& item : items) {
+                if (auto fraction = FirstIntersection(ray, item->GetCollide())) {
+                    expected.push_back(*fraction * GetDistance(ray.a, ray.b));
+                }
+            }
+            std::sort(std::begin(expected), std::end(expected));
+
+            std::vector<double> loose;
+            tree.RayCast(ray, [&](const SizedType&, double distance) { loose.push_back(distance); });
+            std::vector<double> padded;
+            tight.RayCast(ray, [&](const SizedType&, double distance) { padded.push_back(distance); }, false, 30.0);
+            // Nearest first
+            REQUIRE(loose.size() == expected.size());
+            REQUIRE(padded.size() == expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                REQUIRE(loose[i] == Approx(expected[i]));
+                REQUIRE(padded[i] == Approx(expected[i]));
+            }
+
+            std::vector<double> first;
+            tree.RayCast(ray, [&](const SizedType&, double distance) { first.push_back(distance); }, true);
+            REQUIRE(first.size() == std::min(expected.size(), size_t{ 1 }));
+            if (!first.empty()) {
+                REQUIRE(first.front() == Approx(expected.front()));
+            }
+        };
+
+        for (int i = 0; i < 100; ++i) {
+            requireMatchesBruteForce({ Random::PointIn(Rect{ -20, -20, 120, 120 }), Random::PointIn(Rect{ -20, -20, 120, 120 }) });
+        }
+        requireMatchesBruteForce({ { 0, 50 }, { 100, 50 } });
+        requireMatchesBruteForce({ { 50, 50 }, { 50, 50 } });
+        requireMatchesBruteForce({ { 200, 200 }, { 300, 300 } });
+    }
+}
+
+TEST_CASE("QuadTree stats", "[container]")
+{
+    Random::Seed(42);
+
+    const Rect area{ 0, 0, 100, 100 };
+    std::optional<double> looseness = GENERATE(std::optional<double>{}, std::optional<double>{ 2.0 });
+    QuadTree<TestType> tree(area, 4, 1, 1.0, looseness);
+
+    ContainerStats empty = tree.GetStats();
+    REQUIRE(empty.items == 0);
+    REQUIRE(empty.regions == 1);
+    REQUIRE(empty.emptyRegions == 1);
+    REQUIRE(empty.depth == 1);
+
+    for (size_t i = 0; i < 500; ++i) {
+        tree.Insert(std::make_shared<TestType>(Random::PointIn(area)));
+    }
+    ContainerStats stats = tree.GetStats();
+    size_t quadCount = 0;
+    size_t leafCount = 0;
+    tree.ForEachQuad([&](const Rect&) { ++quadCount; });
+    REQUIRE(stats.items == tree.Size());
+    REQUIRE(stats.regions == quadCount);
+    REQUIRE(stats.depth > 1);
+    REQUIRE(stats.bytesAllocated > empty.bytesAllocated);
+    for (size_t leaves : stats.occupancy) {
+        leafCount += leaves;
+    }
+    // Every parent has four children
+    REQUIRE(quadCount - leafCount == (leafCount - 1) / 3);
+    REQUIRE(stats.occupancy.front() == stats.emptyRegions);
+    REQUIRE(stats.occupancy.size() <= ContainerStats::OccupancyBucket(tree.GetItemCountTaregt() + tree.GetItemCountLeeway()) + 1);
+
+#ifdef UTILITY_CONTAINER_STATS
+    tree.ResetQueryStats();
+    Circle query{ 30.0, 60.0, 10.0 };
+    size_t found = 0;
+    std::as_const(tree).ForEachItem([&](const TestType&) { ++found; },
+                                    [&](const Rect& quad) { return Collides(query, quad); },
+                                    [&](const TestType& item) { return Collides(query, item.GetCollide()); });
+    QueryStats queries = tree.GetStats().queries;
+    REQUIRE(queries.queries == 1);
+    REQUIRE(queries.regionsVisited > 1);
+    REQUIRE(queries.regionsVisited < quadCount);
+    REQUIRE(queries.itemsMatched == found);
+    REQUIRE(queries.itemsTested > found);
+
+    tree.ResetQueryStats();
+    REQUIRE(tree.GetStats().queries.queries == 0);
+#else
+    std::as_const(tree).ForEachItem([](const TestType&) {});
+    REQUIRE(tree.GetStats().queries.queries == 0);
+#endif
+}
+
+TEST_CASE("QuadTree narrow scalars", "[container]")
+{
+    Random::Seed(42);
+
+    class FixedType {
+    public:
+        // Hundredths of a unit
+        BasicPoint<int32_t> location_;
+        BasicCircle<int32_t> collide_;
+
+        FixedType(const BasicPoint<int32_t>& location)
+            : location_(location)
+            , collide_{ location.x, location.y, 50 }
+        {
+        }
+
+        const BasicPoint<int32_t>& GetLocation() const
+        {
+            return location_;
+        }
+
+        const BasicCircle<int32_t>& GetCollide() const
+        {
+            return collide_;
+        }
+    };
+
+    std::vector<std::shared_ptr<FixedType>> items;
+    for (size_t i = 0; i < 500; ++i) {
+        items.push_back(std::make_shared<FixedType>(BasicPoint<int32_t>{ Random::Number(0, 9'999), Random::Number(0, 9'999) }));
+    }
+    auto tree = QuadTree<FixedType>::Build(items, 8, 2, 1.0);
+    REQUIRE(tree.Validate());
+    REQUIRE(tree.Size() == items.size());
+
+    for (int i = 0; i < 25; ++i) {
+        BasicCircle<int32_t> query{ Random::Number(0, 9'999), Random::Number(0, 9'999), Random::Number(0, 2'000) };
+        size_t expected = std::ranges::count_if(items, [&](const auto& item) { return Collides(query, item->GetCollide()); });
+        size_t found = 0;
+        std::as_const(tree).ForEachItem([&](const FixedType&) { ++found; },
+                                        [&](const Rect& quad) { return Collides(quad, BoundingRect(query, 50)); },
+                                        [&](const FixedType& item) { return Collides(query, item.GetCollide()); });
+        REQUIRE(found == expected);
+    }
+
+    // Rehoming items as they move
+    for (auto& item : items) {
+        item->location_ = { Random::Number(0, 9'999), Random::Number(0, 9'999) };
+        item->collide_ = { item->location_.x, item->location_.y, 50 };
+    }
+    tree.ForEachItem([](const std::shared_ptr<FixedType>&) {});
+    REQUIRE(tree.Validate());
+    REQUIRE(tree.Size() == items.size());
+
+    size_t hits = 0;
+    tree.RayCast({ { 0.0, 5'000.0 }, { 10'000.0, 5'000.0 } }, [&](const FixedType&, double) { ++hits; }, false, 50.0);
+    REQUIRE(hits == static_cast<size_t>(std::ranges::count_if(items, [](const auto& item) { return Collides(Line{ { 0.0, 5'000.0 }, { 10'000.0, 5'000.0 } }, item->GetCollide()); })));
 }
@@ -0,0 +1,234 @@
+#include <RegionTable.h>
+
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <limits>
+#include <algorithm>
+
+using namespace util;
+
+TEMPLATE_TEST_CASE("RegionTable", "[container]", FlatRegionTable<int>, GridRegionTable<int>, SortedRegionTable<int>, NodeRegionTable<int>)
+{
+    Random::Seed(42);
+
+    TestType table;
+    REQUIRE(table.Size() == 0);
+    REQUIRE(table.Find(0) == nullptr);
+    REQUIRE(table.begin() == table.end());
+
+    SECTION("Emplace & Find")
+    {
+        for (uint64_t key = 0; key < 1000; ++key) {
+            REQUIRE(table.Find(key) == nullptr);
+            REQUIRE(table.Emplace(key, static_cast<int>(key)) == static_cast<int>(key));
+            REQUIRE(table.Size() == key + 1);
+        }
+        for (uint64_t key = 0; key < 1000; ++key) {
+            REQUIRE(table.Find(key) != nullptr);
+            REQUIRE(*table.Find(key) == static_cast<int>(key));
+            // Existing values are not replaced
+            REQUIRE(table.Emplace(key, -1) == static_cast<int>(key));
+        }
+        REQUIRE(table.Size() == 1000);
+        REQUIRE(table.Find(1000) == nullptr);
+    }
+
+    SECTION("Erase")
+    {
+        for (uint64_t key = 0; key < 100; ++key) {
+            table.Emplace(key, static_cast<int>(key));
+        }
+        for (uint64_t key = 0; key < 100; key += 2) {
+            REQUIRE(table.Erase(key));
+            REQUIRE_FALSE(table.Erase(key));
+        }
+        REQUIRE(table.Size() == 50);
+        for (uint64_t key = 0; key < 100; ++key) {
+            REQUIRE((table.Find(key) == nullptr) == (key % 2 == 0));
+        }
+    }
+
+    SECTION("EraseIf")
+    {
+        for (uint64_t key = 0; key < 500; ++key) {
+            table.Emplace(key, static_cast<int>(key));
+        }
+        std::map<uint64_t, unsigned> visits;
+        size_t erased = table.EraseIf([&](auto& entry) -> bool
+        {
+            auto& [ key, value ] = entry;
+            ++visits[key];
+            return value % 3 == 0;
+        });
+        REQUIRE(erased == 167);
+        REQUIRE(table.Size() == 500 - 167);
+
+        // Every entry must be visited exactly once, even when erasures shift entries
+        REQUIRE(visits.size() == 500);
+        for (const auto& [ key, count ] : visits) {
+            REQUIRE(count == 1);
+        }
+        for (uint64_t key = 0; key < 500; ++key) {
+            REQUIRE((table.Find(key) == nullptr) == (key % 3 == 0));
+        }
+    }
+
+    SECTION("Random keys against std::map")
+    {
+        std::map<uint64_t, int> expected;
+        for (int i = 0; i < 5000; ++i) {
+            // Small key range to guarantee plenty of collisions and erasures
+            uint64_t key = Random::Number<uint64_t>(0, 300) << 32 | Random::Number<uint64_t>(0, 3);
+            if (Random::Boolean()) {
+                table.Emplace(key, i);
+                expected.try_emplace(key, i);
+            } else {
+                REQUIRE(table.Erase(key) == (expected.erase(key) > 0));
+            }
+            REQUIRE(table.Size() == expected.size());
+        }
+
+        size_t iterated = 0;
+        for (const auto& [ key, value ] : table) {
+            REQUIRE(expected.contains(key));
+            REQUIRE(expected.at(key) == value);
+            ++iterated;
+        }
+        REQUIRE(iterated == expected.size());
+    }
+
+    SECTION("Clear")
+    {
+        for (uint64_t key = 0; key < 100; ++key) {
+            table.Emplace(key, 0);
+        }
+        table.Clear();
+        REQUIRE(table.Size() == 0);
+        REQUIRE(table.begin() == table.end());
+        REQUIRE(table.Find(5) == nullptr);
+    }
+}
+
+TEST_CASE("Morton codes", "[container]")
+{
+    Random::Seed(42);
+
+    REQUIRE(MortonEncode(0, 0) == 0);
+    REQUIRE(MortonEncode(1, 0) == 1);
+    REQUIRE(MortonEncode(0, 1) == 2);
+    REQUIRE(MortonEncode(3, 3) == 15);
+    REQUIRE(MortonEncode(0xFFFFFFFF, 0) == 0x5555555555555555ull);
+    REQUIRE(MortonEncode(0, 0xFFFFFFFF) == 0xAAAAAAAAAAAAAAAAull);
+
+    for (int i = 0; i < 1000; ++i) {
+        uint32_t x = Random::Number<uint32_t>(0, std::numeric_limits<uint32_t>::max());
+        uint32_t y = Random::Number<uint32_t>(0, std::numeric_limits<uint32_t>::max());
+        REQUIRE(MortonDecode(MortonEncode(x, y)) == std::pair{ x, y });
+    }
+
+    // Negative coordinates precede positive coordinates
+    auto key = [](int32_t x, int32_t y) -> uint64_t
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) <<  0)
+             | (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32);
+    };
+    REQUIRE(MortonRegionKey(key(-1, -1)) < MortonRegionKey(key(0, -1)));
+    REQUIRE(MortonRegionKey(key(0, -1)) < MortonRegionKey(key(-1, 0)));
+    REQUIRE(MortonRegionKey(key(-1, 0)) < MortonRegionKey(key(0, 0)));
+}
+
+TEST_CASE("SortedRegionTable order", "[container]")
+{
+    Random::Seed(42);
+
+    auto key = [](int32_t x, int32_t y) -> uint64_t
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) <<  0)
+             | (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32);
+    };
+
+    SortedRegionTable<int> table;
+    for (int i = 0; i < 2000; ++i) {
+        table.Emplace(key(Random::Number(-50, 50), Random::Number(-50, 50)), i);
+    }
+    table.EraseIf([](const auto& entry) { return entry.second % 2 == 0; });
+
+    // Fully sorted after EraseIf
+    std::vector<uint64_t> codes;
+    for (const auto& [ key, value ] : table) {
+        REQUIRE(value % 2 == 1);
+        codes.push_back(MortonRegionKey(key));
+    }
+    REQUIRE(codes.size() == table.Size());
+    REQUIRE(std::is_sorted(std::begin(codes), std::end(codes)));
+
+    // Erased regions can be added again without moving others
+    uint64_t first = table.begin()->first;
+    int* second = &std::next(table.begin())->second;
+    REQUIRE(table.Erase(first));
+    REQUIRE(table.Find(first) == nullptr);
+    REQUIRE(table.Emplace(first, -1) == -1);
+    REQUIRE(&std::next(table.begin())->second == second);
+}
+
+TEST_CASE("GridRegionTable bounds", "[container]")
+{
+    auto key = [](int32_t x, int32_t y) -> uint64_t
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) <<  0)
+             | (static_cast<uint64_t>(static_cast<uint32_t>(y)) << 32);
+    };
+
+    GridRegionTable<int> table;
+    REQUIRE_FALSE(table.Bounded());
+
+    // Entries inserted before bounds are set must survive
+    table.Emplace(key(0, 0), 1);
+    table.Emplace(key(-100, 100), 2);
+    table.SetBounds(-10, -10, 10, 10);
+    REQUIRE(table.Bounded());
+    REQUIRE(table.Size() == 2);
+    REQUIRE(*table.Find(key(0, 0)) == 1);
+    REQUIRE(*table.Find(key(-100, 100)) == 2);
+
+    // Grid entries never move
+    int* inGrid = table.Find(key(0, 0));
+    for (int32_t x = -20; x <= 20; ++x) {
+        for (int32_t y = -20; y <= 20; ++y) {
+            table.Emplace(key(x, y), x * y);
+        }
+    }
+    REQUIRE(table.Find(key(0, 0)) == inGrid);
+    REQUIRE(table.Size() == (41 * 41) + 1);
+
+    for (int32_t x = -20; x <= 20; ++x) {
+        for (int32_t y = -20; y <= 20; ++y) {
+            if (x != 0 || y != 0) {
+                REQUIRE(*table.Find(key(x, y)) == x * y);
+            }
+        }
+    }
+
+    // Extreme coordinates must not alias into the grid
+    REQUIRE(table.Find(key(std::numeric_limits<int32_t>::min(), 0)) == nullptr);
+    REQUIRE(table.Find(key(0, std::numeric_limits<int32_t>::max())) == nullptr);
+
+    size_t iterated = 0;
+    for ([[ maybe_unused ]] const auto& entry : table) {
+        ++iterated;
+    }
+    REQUIRE(iterated == table.Size());
+
+    table.EraseIf([](const auto& entry) { return entry.second % 2 == 0; });
+    for (const auto& [ key, value ] : table) {
+        REQUIRE(value % 2 != 0);
+    }
+
+    table.Clear();
+    REQUIRE(table.Size() == 0);
+    REQUIRE(table.Bounded());
+    REQUIRE(table.begin() == table.end());
+}
@@ -412,4 +412,258 @@ TEST_CASE("Shape Collision", "[shape]")
             }
         }
     }
+
+    SECTION("FirstIntersection")
+    {
+        const Line ray{ { 0.0, 0.0 }, { 10.0, 0.0 } };
+
+        // Circles
+        REQUIRE(FirstIntersection(ray, Circle{ 5.0, 0.0, 1.0 }) == Approx(0.4));
+        REQUIRE(FirstIntersection(ray, Circle{ 5.0, 1.0, 1.0 }) == Approx(0.5)); // Tangent
+        REQUIRE(FirstIntersection(ray, Circle{ 0.0, 0.0, 1.0 }) == 0.0);       // Starts inside
+        REQUIRE(FirstIntersection(ray, Circle{ 11.0, 0.0, 2.0 }) == Approx(0.9));
+        REQUIRE(!FirstIntersection(ray, Circle{ 5.0, 2.0, 1.0 }));
+        REQUIRE(!FirstIntersection(ray, Circle{ -5.0, 0.0, 1.0 }));             // Behind
+        REQUIRE(!FirstIntersection(ray, Circle{ 15.0, 0.0, 1.0 }));             // Beyond the end
+        REQUIRE(FirstIntersection(Line{ { 5.0, 0.0 }, { 5.0, 0.0 } }, Circle{ 5.0, 0.0, 1.0 }) == 0.0);
+        REQUIRE(!FirstIntersection(Line{ { 0.0, 0.0 }, { 0.0, 0.0 } }, Circle{ 5.0, 0.0, 1.0 }));
+
+        // Rects
+        REQUIRE(FirstIntersection(ray, Rect{ 2.0, -1.0, 4.0, 1.0 }) == Approx(0.2));
+        REQUIRE(FirstIntersection(Line{ ray.b, ray.a }, Rect{ 2.0, -1.0, 4.0, 1.0 }) == Approx(0.6));
+        REQUIRE(FirstIntersection(ray, Rect{ -1.0, -1.0, 4.0, 1.0 }) == 0.0);
+        REQUIRE(FirstIntersection(Line{ { 0.0, 0.0 }, { 10.0, 10.0 } }, Rect{ 5.0, 2.0, 8.0, 8.0 }) == Approx(0.5));
+        REQUIRE(FirstIntersection(ray, Rect{ 2.0, 0.0, 4.0, 3.0 }) == Approx(0.2)); // Skims the top edge
+        REQUIRE(!FirstIntersection(ray, Rect{ 2.0, 2.0, 4.0, 3.0 }));
+        REQUIRE(!FirstIntersection(Line{ { 0.0, 0.0 }, { 10.0, 10.0 } }, Rect{ 5.0, 0.0, 8.0, 2.0 }));
+
+        // Points and lines
+        REQUIRE(FirstIntersection(ray, Point{ 2.5, 0.0 }) == Approx(0.25));
+        REQUIRE(!FirstIntersection(ray, Point{ 2.5, 0.5 }));
+        REQUIRE(FirstIntersection(ray, Line{ { 3.0, -1.0 }, { 3.0, 1.0 } }) == Approx(0.3));
+        REQUIRE(!FirstIntersection(ray, Line{ { 3.0, 1.0 }, { 3.0, 2.0 } }));
+        REQUIRE(FirstIntersection(ray, Line{ { 12.0, 0.0 }, { 6.0, 0.0 } }) == Approx(0.6)); // Collinear
+        REQUIRE(!FirstIntersection(ray, Line{ { 0.0, 1.0 }, { 10.0, 1.0 } }));              // Parallel
+
+        // Agrees with Collides for circles
+        Random::Seed(43);
+        for (int i = 0; i < 1000; ++i) {
+            Line line{ { Random::Number(-10.0, 10.0), Random::Number(-10.0, 10.0) }, { Random::Number(-10.0, 10.0), Random::Number(-10.0, 10.0) } };
+            Circle circle{ Random::Number(-10.0, 10.0), Random::Number(-10.0, 10.0), Random::Number(0.1, 5.0) };
+            REQUIRE(FirstIntersection(line, circle).has_value() == Collides(line, circle));
+        }
+    }
+
+    SECTION("constexpr")
+    {
+        static_assert(GetDistanceSquare({ 1.0, 2.0 }, { 4.0, 6.0 }) == 25.0);
+        static_assert(GetArea(Circle{ 0.0, 0.0, 2.0 }) == std::numbers::pi * 4.0);
+        static_assert(Contains(Circle{ 0.0, 0.0, 5.0 }, Point{ 3.0, 4.0 }));
+        static_assert(!Contains(Circle{ 0.0, 0.0, 5.0 }, Point{ 3.0, 4.1 }));
+        static_assert(Contains(CircleSq(Circle{ 0.0, 0.0, 5.0 }), Point{ -3.0, -4.0 }));
+        static_assert(Collides(Circle{ 0.0, 0.0, 2.0 }, Circle{ 5.0, 0.0, 3.0 }));
+        static_assert(!Collides(Circle{ 0.0, 0.0, 2.0 }, Circle{ 5.1, 0.0, 3.0 }));
+        static_assert(Collides(Line{ { -5.0, 1.0 }, { 5.0, 1.0 } }, Circle{ 0.0, 0.0, 1.0 }));
+        static_assert(!Collides(Line{ { 2.0, 0.0 }, { 5.0, 0.0 } }, Circle{ 0.0, 0.0, 1.0 }));
+        static_assert(Collides(Rect{ 0.0, 0.0, 2.0, 2.0 }, Circle{ 2.5, 1.0, 1.0 }));
+        static_assert(!Collides(Rect{ 0.0, 0.0, 2.0, 2.0 }, Circle{ 3.5, 3.5, 2.0 }));
+        static_assert(Collides(Point{ 1.0, 1.0 }, Rect{ 0.0, 0.0, 2.0, 2.0 }));
+    }
+
+    SECTION("CircleSq")
+    {
+        Random::Seed(44);
+        for (int i = 0; i < 1000; ++i) {
+            Circle circle{ Random::Number(-10.0, 10.0), Random::Number(-10.0, 10.0), Random::Number(0.0, 5.0) };
+            Point point = RandomPoint() * 0.001;
+            Line line{ point, RandomPoint() * 0.001 };
+            REQUIRE(Contains(CircleSq(circle), point) == Contains(circle, point));
+            REQUIRE(Contains(CircleSq(circle), line) == Contains(circle, line));
+            REQUIRE(Collides(point, CircleSq(circle)) == Contains(circle, point));
+        }
+    }
+}
+
+TEST_CASE("Shape Batch Collision", "[shape]")
+{
+    Random::Seed(9);
+
+    std::vector<SimdLevel> levels;
+    SimdLevel supported = GetSimdLevel();
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 }) {
+        if (SetSimdLevel(level) == level) {
+            levels.push_back(level);
+        }
+    }
+    SetSimdLevel(supported);
+    REQUIRE(levels.front() == SimdLevel::Scalar);
+
+    // Small integer values produce plenty of exactly touching shapes
+    auto value = []() -> double
+    {
+        return Random::Boolean() ? static_cast<double>(Random::Number(-10, 10)) : Random::Number(-10.0, 10.0);
+    };
+
+    for (size_t count : { 0, 1, 2, 3, 4, 5, 7, 8, 13, 64, 101 }) {
+        std::vector<double> a(count), b(count), c(count), d(count);
+        for (size_t i = 0; i < count; ++i) {
+            a[i] = value();
+            b[i] = value();
+            c[i] = std::abs(value());
+            d[i] = value();
+        }
+        Circle circleQuery{ value(), value(), std::abs(value()) };
+        Rect rectQuery{ -4.0, -3.0, 5.0, 2.0 };
+
+        for (SimdLevel level : levels) {
+            INFO("SimdLevel " << static_cast<int>(level) << ", count " << count);
+            REQUIRE(SetSimdLevel(level) == level);
+
+            std::vector<uint8_t> out(count, 2);
+            CollidesMany(circleQuery, a, b, c, out);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(out[i] == (Collides(circleQuery, Circle{ a[i], b[i], c[i] }) ? 1 : 0));
+            }
+
+            std::fill(out.begin(), out.end(), 2);
+            std::vector<double> rights(count), bottoms(count);
+            for (size_t i = 0; i < count; ++i) {
+                rights[i] = a[i] + c[i];
+                bottoms[i] = b[i] + std::abs(d[i]);
+            }
+            CollidesMany(rectQuery, a, b, rights, bottoms, out);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(out[i] == (Collides(rectQuery, Rect{ a[i], b[i], rights[i], bottoms[i] }) ? 1 : 0));
+            }
+
+            std::fill(out.begin(), out.end(), 2);
+            ContainsMany(circleQuery, a, b, out);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(out[i] == (Contains(circleQuery, Point{ a[i], b[i] }) ? 1 : 0));
+            }
+        }
+    }
+    SetSimdLevel(supported);
+
+    SECTION("Exact boundaries")
+    {
+        // Touching circles, and rects sharing an edge on either side
+        std::vector<double> xs{ 3.0, -3.0, 0.0, 0.0, 2.0 };
+        std::vector<double> ys{ 4.0, -4.0, 5.0, -5.0, 2.0 };
+        std::vector<double> radii{ 2.0, 2.0, 2.0, 2.0, 0.0 };
+        std::vector<uint8_t> out(xs.size());
+        for (SimdLevel level : levels) {
+            SetSimdLevel(level);
+            CollidesMany(Circle{ 0.0, 0.0, 3.0 }, xs, ys, radii, out);
+            REQUIRE(out == std::vector<uint8_t>{ 1, 1, 1, 1, 1 });
+            CollidesMany(Circle{ 0.0, 0.0, 2.9 }, xs, ys, radii, out);
+            REQUIRE(out == std::vector<uint8_t>{ 0, 0, 0, 0, 1 });
+
+            std::vector<double> lefts{ 10.0, 0.0, -5.0, 2.0 };
+            std::vector<double> tops{ 0.0, 10.0, 0.0, 2.0 };
+            std::vector<double> rights{ 15.0, 5.0, 0.0, 3.0 };
+            std::vector<double> bottoms{ 5.0, 15.0, 5.0, 3.0 };
+            std::vector<uint8_t> rectOut(lefts.size());
+            CollidesMany(Rect{ 0.0, 0.0, 10.0, 10.0 }, lefts, tops, rights, bottoms, rectOut);
+            REQUIRE(rectOut == std::vector<uint8_t>{ 0, 0, 1, 1 });
+        }
+        SetSimdLevel(supported);
+    }
+
+    SECTION("Near touching")
+    {
+        // Where a fused multiply-add would round differently to a separate multiply and add
+        Circle query{ 0.3, -0.7, 1.9 };
+        std::vector<double> xs, ys, radii;
+        for (size_t i = 0; i < 10'000; ++i) {
+            double radius = Random::Number(0.1, 5.0);
+            Point touching = ApplyOffset({ query.x, query.y }, Random::Bearing(), query.radius + radius);
+            xs.push_back(touching.x);
+            ys.push_back(touching.y);
+            radii.push_back(radius);
+        }
+        std::vector<uint8_t> out(xs.size());
+        for (SimdLevel level : levels) {
+            INFO("SimdLevel " << static_cast<int>(level));
+            SetSimdLevel(level);
+            CollidesMany(query, xs, ys, radii, out);
+            for (size_t i = 0; i < xs.size(); ++i) {
+                REQUIRE(out[i] == (Collides(query, Circle{ xs[i], ys[i], radii[i] }) ? 1 : 0));
+            }
+        }
+        SetSimdLevel(supported);
+    }
+}
+
+TEST_CASE("Shape scalar types", "[shape]")
+{
+    Random::Seed(45);
+
+    static_assert(sizeof(BasicCircle<float>) * 2 == sizeof(Circle));
+    static_assert(sizeof(BasicRect<int32_t>) * 2 == sizeof(Rect));
+    // Only widening conversions are implicit
+    static_assert(std::is_convertible_v<BasicPoint<float>, Point>);
+    static_assert(std::is_convertible_v<BasicCircle<int32_t>, Circle>);
+    static_assert(!std::is_convertible_v<Point, BasicPoint<float>>);
+    static_assert(!std::is_convertible_v<BasicPoint<int32_t>, BasicPoint<float>>);
+    static_assert(std::is_same_v<decltype(GetDistanceSquare(BasicPoint<int32_t>{}, BasicPoint<int32_t>{})), int64_t>);
+    static_assert(std::is_same_v<decltype(GetDistanceSquare(BasicPoint<float>{}, BasicPoint<float>{})), float>);
+    static_assert(std::is_same_v<decltype(GetDistanceSquare(BasicPoint<float>{}, Point{})), double>);
+    static_assert(Collides(BasicCircle<int32_t>{ 0, 0, 2 }, BasicCircle<int32_t>{ 5, 0, 3 }));
+    static_assert(Collides(BasicRect<float>{ 0, 0, 2, 2 }, BasicCircle<int32_t>{ 3, 1, 1 }) == Collides(Rect{ 0, 0, 2, 2 }, Circle{ 3, 1, 1 }));
+
+    // Integer valued shapes small enough that float arithmetic is exact must agree at every precision
+    auto number = [](int min, int max) { return static_cast<double>(Random::Number(min, max)); };
+    for (int i = 0; i < 10000; ++i) {
+        Point point{ number(-500, 500), number(-500, 500) };
+        Circle circle{ number(-500, 500), number(-500, 500), number(0, 100) };
+        Circle other{ number(-500, 500), number(-500, 500), number(0, 100) };
+        Point corner{ number(-500, 500), number(-500, 500) };
+        Rect rect{ corner.x, corner.y, corner.x + number(0, 200), corner.y + number(0, 200) };
+        Line line{ point, { number(-500, 500), number(-500, 500) } };
+
+        auto requireAgreement = [&]<typename Scalar>(Scalar)
+        {
+            BasicPoint<Scalar> narrowPoint = static_cast<BasicPoint<Scalar>>(point);
+            BasicCircle<Scalar> narrowCircle = static_cast<BasicCircle<Scalar>>(circle);
+            BasicCircle<Scalar> narrowOther = static_cast<BasicCircle<Scalar>>(other);
+            BasicRect<Scalar> narrowRect = static_cast<BasicRect<Scalar>>(rect);
+            BasicLine<Scalar> narrowLine = static_cast<BasicLine<Scalar>>(line);
+
+            REQUIRE(GetDistanceSquare(narrowPoint, BasicPoint<Scalar>{ narrowCircle.x, narrowCircle.y }) == GetDistanceSquare(point, { circle.x, circle.y }));
+            REQUIRE(Contains(narrowCircle, narrowPoint) == Contains(circle, point));
+            REQUIRE(Contains(BasicCircleSq<Scalar>(narrowCircle), narrowPoint) == Contains(circle, point));
+            REQUIRE(Contains(narrowRect, narrowPoint) == Contains(rect, point));
+            REQUIRE(Contains(narrowRect, narrowCircle) == Contains(rect, circle));
+            REQUIRE(Collides(narrowCircle, narrowOther) == Collides(circle, other));
+            REQUIRE(Collides(narrowRect, narrowCircle) == Collides(rect, circle));
+            REQUIRE(Collides(narrowCircle, narrowRect) == Collides(rect, circle));
+            REQUIRE(Collides(narrowRect, BoundingRect(narrowOther)) == Collides(rect, BoundingRect(other)));
+            // Mixed with double precision queries
+            REQUIRE(Collides(circle, narrowOther) == Collides(circle, other));
+            REQUIRE(Collides(narrowRect, circle) == Collides(rect, circle));
+            if constexpr (std::integral<Scalar>) {
+                // Integer lines are calculated in double precision
+                REQUIRE(Collides(narrowLine, narrowCircle) == Collides(line, circle));
+                REQUIRE(Contains(narrowLine, narrowPoint) == Contains(line, point));
+            }
+        };
+        requireAgreement(float{});
+        requireAgreement(int32_t{});
+    }
+
+    SECTION("Fixed point")
+    {
+        // e.g. millimetres across a 10km world, where float would only resolve to about a millimetre
+        const int32_t mm = 1;
+        const int32_t km = 1'000'000 * mm;
+        BasicCircle<int32_t> a{ 10 * km, 10 * km, 1 * mm };
+        BasicCircle<int32_t> b{ 10 * km + 2 * mm, 10 * km, 1 * mm };
+        BasicCircle<int32_t> c{ 10 * km + 3 * mm, 10 * km, 1 * mm };
+        REQUIRE(Collides(a, b));
+        REQUIRE(!Collides(a, c));
+        REQUIRE(GetDistanceSquare(BasicPoint<int32_t>{ -10 * km, -10 * km }, BasicPoint<int32_t>{ 10 * km, 10 * km }) == int64_t{ 8 } * 100 * km * km);
+        REQUIRE(GetArea(BasicRect<int32_t>{ 0, 0, 20 * km, 20 * km }) == int64_t{ 400 } * km * km);
+        REQUIRE(GetDistance(BasicPoint<int32_t>{ 0, 0 }, BasicPoint<int32_t>{ 3 * km, 4 * km }) == 5.0 * km);
+    }
 }
@@ -0,0 +1,126 @@
+#include <SlotMap.h>
+
+#include <Random.h>
+
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <string>
+
+using namespace util;
+
+TEST_CASE("SlotMap", "[container]")
+{
+    Random::Seed(42);
+
+    SlotMap<std::string> slots;
+    REQUIRE(slots.Size() == 0);
+    REQUIRE_FALSE(slots.Contains(SlotMap<std::string>::Handle{}));
+
+    SECTION("Emplace & Get")
+    {
+        auto a = slots.Emplace("a");
+        auto b = slots.Emplace(3, 'b');
+        REQUIRE(slots.Size() == 2);
+        REQUIRE(*slots.Get(a) == "a");
+        REQUIRE(*slots.Get(b) == "bbb");
+        REQUIRE_FALSE(a == b);
+    }
+
+    SECTION("Stale handles")
+    {
+        auto a = slots.Emplace("a");
+        REQUIRE(slots.Erase(a));
+        REQUIRE_FALSE(slots.Erase(a));
+        REQUIRE(slots.Get(a) == nullptr);
+
+        // The slot is reused, but the old handle must not see the new item
+        auto b = slots.Emplace("b");
+        REQUIRE(b.index == a.index);
+        REQUIRE(slots.Get(a) == nullptr);
+        REQUIRE(*slots.Get(b) == "b");
+    }
+
+    SECTION("Generations never wrap")
+    {
+        // A narrow generation, so the slot runs out of generations quickly
+        SlotMap<std::string, uint8_t> narrow;
+        std::vector<SlotMap<std::string, uint8_t>::Handle> stale;
+        for (int i = 0; i < 255; ++i) {
+            auto handle = narrow.Emplace(std::to_string(i));
+            REQUIRE(handle.index == 0);
+            REQUIRE(narrow.Erase(handle));
+            stale.push_back(handle);
+        }
+
+        // The first slot is now retired, so a fresh slot is used instead of generation 0 again
+        auto fresh = narrow.Emplace("fresh");
+        REQUIRE(fresh.index == 1);
+        for (const auto& handle : stale) {
+            REQUIRE_FALSE(narrow.Contains(handle));
+        }
+        REQUIRE(*narrow.Get(fresh) == "fresh");
+    }
+
+    SECTION("Items never move")
+    {
+        std::vector<std::pair<SlotMap<std::string>::Handle, const std::string*>> items;
+        for (int i = 0; i < 2000; ++i) {
+            auto handle = slots.Emplace(std::to_string(i));
+            items.emplace_back(handle, slots.Get(handle));
+        }
+        for (const auto& [ handle, address ] : items) {
+            REQUIRE(slots.Get(handle) == address);
+        }
+    }
+
+    SECTION("Random against std::map")
+    {
+        std::map<int, SlotMap<std::string>::Handle> expected;
+        std::vector<SlotMap<std::string>::Handle> erased;
+        for (int i = 0; i < 5000; ++i) {
+            if (expected.empty() || Random::Boolean()) {
+                expected[i] = slots.Emplace(std::to_string(i));
+            } else {
+                auto iter = expected.begin();
+                std::advance(iter, Random::Number<size_t>(0, expected.size() - 1));
+                REQUIRE(slots.Erase(iter->second));
+                erased.push_back(iter->second);
+                expected.erase(iter);
+            }
+            REQUIRE(slots.Size() == expected.size());
+        }
+        for (const auto& [ value, handle ] : expected) {
+            REQUIRE(*slots.Get(handle) == std::to_string(value));
+        }
+        for (const auto& handle : erased) {
+            REQUIRE_FALSE(slots.Contains(handle));
+        }
+
+        size_t visited = 0;
+        slots.ForEach([&](const auto& handle, const std::string& item)
+        {
+            REQUIRE(*slots.Get(handle) == item);
+            ++visited;
+        });
+        REQUIRE(visited == expected.size());
+    }
+
+    SECTION("EraseIf & Clear")
+    {
+        std::vector<SlotMap<std::string>::Handle> handles;
+        for (int i = 0; i < 100; ++i) {
+            handles.push_back(slots.Emplace(std::to_string(i)));
+        }
+        REQUIRE(slots.EraseIf([](const std::string& item) { return std::stoi(item) % 2 == 0; }) == 50);
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE(slots.Contains(handles[i]) == (i % 2 != 0));
+        }
+
+        slots.Clear();
+        REQUIRE(slots.Size() == 0);
+        for (const auto& handle : handles) {
+            REQUIRE_FALSE(slots.Contains(handle));
+        }
+    }
+}
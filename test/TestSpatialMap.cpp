@@ -1,10 +1,13 @@
 #include <SpatialMap.h>
+#include <SlotMap.h>
 
 #include <Shape.h>
 #include <Random.h>
 
 #include <catch2/catch.hpp>
 
+#include <map>
+
 using namespace util;
 
 namespace {
@@ -49,6 +52,8 @@ public:
     {
         if (speed_ != 0) {
             location_ = ApplyOffset(location_, bearing_, speed_);
+            collide_.x = location_.x;
+            collide_.y = location_.y;
             return true;
         }
         return false;
@@ -67,6 +72,28 @@ private:
     bool exists_;
 };
 
+class IndexedTestType : public TestType {
+public:
+    using TestType::TestType;
+
+    explicit IndexedTestType(const TestType& other)
+        : TestType(other)
+    {
+    }
+
+    void SetSpatialMapIndex(size_t index)
+    {
+        index_ = index;
+    }
+
+    size_t GetSpatialMapIndex() const
+    {
+        return index_;
+    }
+
+private:
+    size_t index_ = 0;
+};
 
 } // end anon namespace
 
@@ -645,3 +672,1072 @@ TEST_CASE("SpatialMap const iterators", "[container]")
         REQUIRE(counted == 0);
     }
 }
+
+TEST_CASE("SpatialMap NodeRegionTable", "[container]")
+{
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType> flatMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType, NodeRegionTable> nodeMap(TestType::RADIUS, regionSize);
+
+    for (size_t i = 0; i < 500; ++i) {
+        auto item = TestType::Random();
+        flatMap.Insert(item);
+        nodeMap.Insert(std::make_shared<TestType>(*item));
+    }
+
+    for (int tick = 0; tick < 10; ++tick) {
+        Circle cull{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), 100.0 };
+        auto predicate = [&](const TestType& item) { return Contains(cull, item.GetLocation()); };
+        flatMap.RemoveIf(predicate);
+        nodeMap.RemoveIf(predicate);
+
+        flatMap.MoveAndRemove();
+        nodeMap.MoveAndRemove();
+
+        REQUIRE(flatMap.Size() == nodeMap.Size());
+        REQUIRE(flatMap.RegionCount() == nodeMap.RegionCount());
+
+        Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), 250.0 };
+        size_t flatCount = 0;
+        for ([[ maybe_unused ]] const auto& item : flatMap.CItemsCollidingWith(collider)) {
+            ++flatCount;
+        }
+        size_t nodeCount = 0;
+        for ([[ maybe_unused ]] const auto& item : nodeMap.CItemsCollidingWith(collider)) {
+            ++nodeCount;
+        }
+        REQUIRE(flatCount == nodeCount);
+    }
+}
+
+TEST_CASE("Bounded SpatialMap", "[container]")
+{
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    // Only covers part of the area TestType::Random() uses, so the overflow is tested too
+    const Rect bounds{ -500, -500, 500, 500 };
+    SpatialMap<TestType> unboundedMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType> boundedMap(bounds, TestType::RADIUS, regionSize);
+
+    for (size_t i = 0; i < 500; ++i) {
+        auto item = TestType::Random();
+        unboundedMap.Insert(item);
+        boundedMap.Insert(std::make_shared<TestType>(*item));
+    }
+    REQUIRE(unboundedMap.RegionCount() == boundedMap.RegionCount());
+
+    auto requireSameQueryResults = [&]()
+    {
+        for (int i = 0; i < 25; ++i) {
+            Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), Random::Number(0.0, 500.0) };
+            size_t unboundedCount = 0;
+            for ([[ maybe_unused ]] const auto& item : unboundedMap.CItemsCollidingWith(collider)) {
+                ++unboundedCount;
+            }
+            size_t boundedCount = 0;
+            for ([[ maybe_unused ]] const auto& item : boundedMap.CItemsCollidingWith(collider)) {
+                ++boundedCount;
+            }
+            REQUIRE(unboundedCount == boundedCount);
+        }
+    };
+
+    requireSameQueryResults();
+
+    for (int tick = 0; tick < 25; ++tick) {
+        unboundedMap.MoveAndRemove();
+        boundedMap.MoveAndRemove();
+        REQUIRE(unboundedMap.Size() == boundedMap.Size());
+        REQUIRE(unboundedMap.RegionCount() == boundedMap.RegionCount());
+    }
+
+    requireSameQueryResults();
+
+    boundedMap.SetRegionSize(regionSize * 2.0);
+    unboundedMap.SetRegionSize(regionSize * 2.0);
+    REQUIRE(unboundedMap.Size() == boundedMap.Size());
+    REQUIRE(unboundedMap.RegionCount() == boundedMap.RegionCount());
+
+    requireSameQueryResults();
+}
+
+namespace {
+
+template <template <typename> typename RegionTable>
+void RequireRegionSizeChangeKeepsItems()
+{
+    Random::Seed(872346548);
+
+    SpatialMap<TestType, RegionTable> map(TestType::RADIUS, 100.0);
+    for (size_t i = 0; i < 200; ++i) {
+        map.Insert(TestType::Random());
+    }
+
+    Circle collider{ 0.0, 0.0, 500.0 };
+    auto countColliding = [&]()
+    {
+        size_t count = 0;
+        for ([[ maybe_unused ]] const auto& item : map.CItemsCollidingWith(collider)) {
+            ++count;
+        }
+        return count;
+    };
+    size_t colliding = countColliding();
+
+    map.SetRegionSize(250.0);
+    REQUIRE(map.Size() == 200);
+    REQUIRE(countColliding() == colliding);
+}
+
+} // end anon namespace
+
+TEST_CASE("SpatialMap SetRegionSize", "[container]")
+{
+    // Only some tables support bounds, SetRegionSize must compile for each of them
+    RequireRegionSizeChangeKeepsItems<FlatRegionTable>();
+    RequireRegionSizeChangeKeepsItems<GridRegionTable>();
+    RequireRegionSizeChangeKeepsItems<SortedRegionTable>();
+    RequireRegionSizeChangeKeepsItems<NodeRegionTable>();
+}
+
+TEST_CASE("Packed SpatialMap", "[container]")
+{
+    Random::Seed(872346548);
+
+    // Large regions are crowded enough to be tested in batches
+    const double regionSize = GENERATE(100.0, 1000.0);
+    SpatialMap<TestType> pointerMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType, GridRegionTable, RegionLayout::Packed> packedMap(TestType::RADIUS, regionSize);
+
+    std::vector<std::shared_ptr<TestType>> pointerItems;
+    std::vector<std::shared_ptr<TestType>> packedItems;
+    for (size_t i = 0; i < 500; ++i) {
+        auto item = TestType::Random();
+        pointerMap.Insert(item);
+        pointerItems.push_back(item);
+        packedItems.push_back(std::make_shared<TestType>(*item));
+        packedMap.Insert(packedItems.back());
+    }
+
+    auto requireSameQueryResults = [&]()
+    {
+        for (int i = 0; i < 25; ++i) {
+            Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), Random::Number(0.0, 500.0) };
+            std::vector<Point> pointerLocations;
+            for (const auto& item : pointerMap.CItemsCollidingWith(collider)) {
+                pointerLocations.push_back(item.GetLocation());
+            }
+            std::vector<Point> packedLocations;
+            for (const auto& item : packedMap.ItemsCollidingWith(collider)) {
+                // The cache must agree with the item
+                REQUIRE(Collides(collider, item->GetCollide()));
+                packedLocations.push_back(item->GetLocation());
+            }
+            REQUIRE(pointerLocations == packedLocations);
+        }
+    };
+
+    requireSameQueryResults();
+
+    for (int tick = 0; tick < 25; ++tick) {
+        // Erasing must keep the packed collides in step with the items
+        packedMap.Erase(packedItems[tick]);
+        pointerMap.Erase(pointerItems[tick]);
+
+        pointerMap.MoveAndRemove();
+        packedMap.MoveAndRemove();
+        REQUIRE(pointerMap.Size() == packedMap.Size());
+        requireSameQueryResults();
+    }
+}
+
+TEST_CASE("SpatialMap narrow scalars", "[container]")
+{
+    Random::Seed(872346548);
+
+    class FloatType {
+    public:
+        FloatType(const BasicPoint<float>& location, float radius = 5.0f)
+            : location_(location)
+            , collide_{ location.x, location.y, radius }
+        {
+        }
+
+        const BasicPoint<float>& GetLocation() const
+        {
+            return location_;
+        }
+
+        const BasicCircle<float>& GetCollide() const
+        {
+            return collide_;
+        }
+
+        bool Exists() const
+        {
+            return true;
+        }
+
+        bool Move()
+        {
+            location_.x += 10.0f;
+            collide_.x = location_.x;
+            return true;
+        }
+
+    private:
+        BasicPoint<float> location_;
+        BasicCircle<float> collide_;
+    };
+
+    SpatialMap<FloatType, GridRegionTable, RegionLayout::Packed> map(5.0, 100.0);
+    std::vector<std::shared_ptr<FloatType>> items;
+    for (size_t i = 0; i < 1000; ++i) {
+        items.push_back(std::make_shared<FloatType>(BasicPoint<float>{ Random::Number(-1000.0f, 1000.0f), Random::Number(-1000.0f, 1000.0f) }));
+        map.Insert(items.back());
+    }
+
+    auto requireQueryFindsAll = [&](const auto& collider)
+    {
+        size_t expected = std::ranges::count_if(items, [&](const auto& item) { return Collides(collider, item->GetCollide()); });
+        size_t found = 0;
+        for (const auto& item : map.CItemsCollidingWith(collider)) {
+            REQUIRE(Collides(collider, item.GetCollide()));
+            ++found;
+        }
+        REQUIRE(found == expected);
+    };
+
+    for (int tick = 0; tick < 5; ++tick) {
+        for (int i = 0; i < 25; ++i) {
+            requireQueryFindsAll(Circle{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), Random::Number(0.0, 200.0) });
+            requireQueryFindsAll(BasicCircle<float>{ Random::Number(-1000.0f, 1000.0f), Random::Number(-1000.0f, 1000.0f), Random::Number(0.0f, 200.0f) });
+            requireQueryFindsAll(BasicCircle<int>{ Random::Number(-1000, 1000), Random::Number(-1000, 1000), Random::Number(0, 200) });
+            requireQueryFindsAll(BasicRect<int>{ Random::Number(-1000, 0), Random::Number(-1000, 0), Random::Number(0, 1000), Random::Number(0, 1000) });
+        }
+
+        Point origin{ 0.0, 0.0 };
+        auto nearest = std::ranges::min(items, {}, [&](const auto& item) { return GetDistanceSquare(origin, item->GetLocation()); });
+        REQUIRE(map.Nearest(origin) == nearest);
+
+        size_t hits = 0;
+        map.RayCast({ { -1000.0, 0.0 }, { 1000.0, 0.0 } }, [&](const FloatType&, double) { ++hits; });
+        REQUIRE(hits == static_cast<size_t>(std::ranges::count_if(items, [](const auto& item) { return FirstIntersection(Line{ { -1000.0, 0.0 }, { 1000.0, 0.0 } }, item->GetCollide()).has_value(); })));
+
+        map.MoveAndRemove();
+        REQUIRE(map.Size() == items.size());
+    }
+
+    SECTION("Fractional margin")
+    {
+        // A margin truncated to int would stop short of the region holding the item
+        SpatialMap<FloatType> fractional(2.9, 10.5);
+        auto item = std::make_shared<FloatType>(BasicPoint<float>{ 10.6f, 5.0f }, 2.9f);
+        fractional.Insert(item);
+        BasicCircle<int> collider{ 7, 5, 1 };
+        REQUIRE(Collides(collider, item->GetCollide()));
+        size_t found = 0;
+        for ([[ maybe_unused ]] const auto& collided : fractional.CItemsCollidingWith(collider)) {
+            ++found;
+        }
+        REQUIRE(found == 1);
+    }
+}
+
+TEST_CASE("Parallel SpatialMap MoveAndRemove", "[container]")
+{
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType> serialMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType> singleThreadMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType> multiThreadMap(TestType::RADIUS, regionSize);
+    ThreadPool singleThread(1);
+    ThreadPool multiThread(4);
+
+    std::vector<std::shared_ptr<TestType>> items[3];
+    for (size_t i = 0; i < 2000; ++i) {
+        auto item = TestType::Random();
+        items[0].push_back(item);
+        items[1].push_back(std::make_shared<TestType>(*item));
+        items[2].push_back(std::make_shared<TestType>(*item));
+        serialMap.Insert(items[0].back());
+        singleThreadMap.Insert(items[1].back());
+        multiThreadMap.Insert(items[2].back());
+    }
+
+    auto locations = [](const auto& map) -> std::vector<Point>
+    {
+        std::vector<Point> locations;
+        for (const auto& item : map.CItems()) {
+            locations.push_back(item.GetLocation());
+        }
+        return locations;
+    };
+
+    for (int tick = 0; tick < 20; ++tick) {
+        size_t toTerminate = Random::Number<size_t>(0, items[0].size() - 1);
+        for (auto& copies : items) {
+            copies[toTerminate]->Terminate();
+        }
+
+        serialMap.MoveAndRemove();
+        singleThreadMap.MoveAndRemove(singleThread);
+        multiThreadMap.MoveAndRemove(multiThread);
+
+        REQUIRE(serialMap.Size() == multiThreadMap.Size());
+        REQUIRE(serialMap.RegionCount() == multiThreadMap.RegionCount());
+
+        // The parallel result is independent of the thread count
+        auto multiThreadLocations = locations(multiThreadMap);
+        REQUIRE(locations(singleThreadMap) == multiThreadLocations);
+
+        // And contains the same items as the serial result
+        auto serialLocations = locations(serialMap);
+        auto byPosition = [](const Point& a, const Point& b) { return std::tie(a.x, a.y) < std::tie(b.x, b.y); };
+        std::sort(serialLocations.begin(), serialLocations.end(), byPosition);
+        std::sort(multiThreadLocations.begin(), multiThreadLocations.end(), byPosition);
+        REQUIRE(serialLocations == multiThreadLocations);
+    }
+}
+
+TEST_CASE("SpatialMap epoch", "[container]")
+{
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType> map(TestType::RADIUS, regionSize);
+    ThreadPool threads(4);
+
+    std::vector<std::shared_ptr<TestType>> initialItems;
+    for (size_t i = 0; i < 1000; ++i) {
+        initialItems.push_back(TestType::Random());
+        map.Insert(initialItems.back());
+    }
+    std::vector<std::shared_ptr<TestType>> stagedItems;
+    for (size_t i = 0; i < 1000; ++i) {
+        stagedItems.push_back(TestType::Random());
+    }
+    std::vector<Circle> queries;
+    for (size_t i = 0; i < 200; ++i) {
+        queries.push_back({ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), Random::Number(0.0, 250.0) });
+    }
+
+    auto countCollisions = [](const std::vector<std::shared_ptr<TestType>>& items, const Circle& query)
+    {
+        return static_cast<size_t>(std::count_if(items.begin(), items.end(), [&](const auto& item) { return Collides(query, item->GetCollide()); }));
+    };
+
+    REQUIRE_FALSE(map.InEpoch());
+    map.BeginEpoch();
+    REQUIRE(map.InEpoch());
+
+    // Every thread queries and inserts at the same time, staged items must not be visible until the epoch ends
+    std::vector<size_t> counts(queries.size());
+    threads.ParallelFor(queries.size(), [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t item = i; item < stagedItems.size(); item += queries.size()) {
+                map.Insert(stagedItems[item]);
+            }
+            for ([[ maybe_unused ]] const auto& item : map.CItemsCollidingWith(queries[i])) {
+                ++counts[i];
+            }
+        }
+    });
+    REQUIRE(map.Size() == initialItems.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        REQUIRE(counts[i] == countCollisions(initialItems, queries[i]));
+    }
+
+    map.EndEpoch();
+    REQUIRE_FALSE(map.InEpoch());
+    REQUIRE(map.Size() == initialItems.size() + stagedItems.size());
+    for (const auto& query : queries) {
+        size_t count = 0;
+        for ([[ maybe_unused ]] const auto& item : map.CItemsCollidingWith(query)) {
+            ++count;
+        }
+        REQUIRE(count == countCollisions(initialItems, query) + countCollisions(stagedItems, query));
+    }
+
+    // A second epoch must not reuse buffers from the first
+    map.BeginEpoch();
+    map.Insert(TestType::Random());
+    map.EndEpoch();
+    REQUIRE(map.Size() == initialItems.size() + stagedItems.size() + 1);
+}
+
+TEST_CASE("SpatialMap nearest", "[container]")
+{
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType> map(TestType::RADIUS, regionSize);
+
+    REQUIRE(map.Nearest({ 0, 0 }) == nullptr);
+    REQUIRE(map.KNearest({ 0, 0 }, 8).empty());
+
+    auto distance = [](const Point& a, const Point& b) { return std::sqrt(std::pow(a.x - b.x, 2) + std::pow(a.y - b.y, 2)); };
+
+    std::vector<std::shared_ptr<TestType>> items;
+    auto requireMatchesBruteForce = [&](const Point& point, size_t k, double maxDistance)
+    {
+        std::vector<double> expected;
+        for (const auto& item : items) {
+            double d = distance(point, item->GetLocation());
+            if (d <= maxDistance) {
+                expected.push_back(d);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        expected.resize(std::min(expected.size(), k));
+
+        std::vector<double> actual;
+        for (const auto& item : std::as_const(map).KNearest(point, k, maxDistance)) {
+            actual.push_back(distance(point, item->GetLocation()));
+        }
+        REQUIRE(actual.size() == expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            REQUIRE(actual[i] == Approx(expected[i]));
+        }
+
+        if (k == 0) {
+            return;
+        }
+        auto nearest = map.Nearest(point, maxDistance);
+        REQUIRE((nearest == nullptr) == expected.empty());
+        if (nearest) {
+            REQUIRE(distance(point, nearest->GetLocation()) == Approx(expected.front()));
+        }
+    };
+
+    SECTION("Sparse")
+    {
+        // Few items far apart, so most rings are empty
+        for (const Point& location : { Point{ 5000, 5000 }, Point{ -7000, 12 }, Point{ 3, -9000 } }) {
+            items.push_back(std::make_shared<TestType>(location, 0.0, 0.0));
+            map.Insert(items.back());
+        }
+        requireMatchesBruteForce({ 0, 0 }, 1, std::numeric_limits<double>::infinity());
+        requireMatchesBruteForce({ 0, 0 }, 8, std::numeric_limits<double>::infinity());
+        requireMatchesBruteForce({ 4000, 4000 }, 2, std::numeric_limits<double>::infinity());
+        requireMatchesBruteForce({ 0, 0 }, 8, 1000.0);
+    }
+
+    SECTION("Dense")
+    {
+        for (size_t i = 0; i < 2000; ++i) {
+            items.push_back(TestType::Random());
+            map.Insert(items.back());
+        }
+        for (int i = 0; i < 100; ++i) {
+            Point point{ Random::Number(-1200.0, 1200.0), Random::Number(-1200.0, 1200.0) };
+            size_t k = Random::Number<size_t>(1, 20);
+            double maxDistance = Random::Boolean() ? std::numeric_limits<double>::infinity() : Random::Number(0.0, 300.0);
+            requireMatchesBruteForce(point, k, maxDistance);
+        }
+        // On region boundaries, including negative ones
+        requireMatchesBruteForce({ 0, 0 }, 8, std::numeric_limits<double>::infinity());
+        requireMatchesBruteForce({ -100, -100 }, 8, std::numeric_limits<double>::infinity());
+        requireMatchesBruteForce({ 300, -500 }, 8, std::numeric_limits<double>::infinity());
+        requireMatchesBruteForce({ 0, 0 }, 0, std::numeric_limits<double>::infinity());
+        requireMatchesBruteForce({ 0, 0 }, 5000, std::numeric_limits<double>::infinity());
+    }
+}
+
+TEST_CASE("SpatialMap RayCast", "[container]")
+{
+    Random::Seed(872346548);
+
+    // Small regions mean items overhang several regions away from the ray
+    const double regionSize = GENERATE(3.0, 100.0);
+    SpatialMap<TestType> map(TestType::RADIUS, regionSize);
+
+    std::vector<std::shared_ptr<TestType>> items;
+    for (size_t i = 0; i < 2000; ++i) {
+        items.push_back(TestType::Random());
+        map.Insert(items.back());
+    }
+
+    auto requireMatchesBruteForce = [&](const Line& ray)
+    {
+        std::vector<double> expected;
+        for (const auto& item : items) {
+            if (auto fraction = FirstIntersection(ray, item->GetCollide())) {
+                expected.push_back(*fraction * GetDistance(ray.a, ray.b));
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+
+        std::vector<double> actual;
+        map.RayCast(ray, [&](const TestType&, double distance) { actual.push_back(distance); });
+        // Nearest first
+        REQUIRE(actual.size() == expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            REQUIRE(actual[i] == Approx(expected[i]));
+        }
+
+        std::vector<double> first;
+        map.RayCast(ray, [&](const TestType&, double distance) { first.push_back(distance); }, true);
+        REQUIRE(first.size() == std::min(expected.size(), size_t{ 1 }));
+        if (!first.empty()) {
+            REQUIRE(first.front() == Approx(expected.front()));
+        }
+    };
+
+    for (int i = 0; i < 100; ++i) {
+        requireMatchesBruteForce({ { Random::Number(-1200.0, 1200.0), Random::Number(-1200.0, 1200.0) }, { Random::Number(-1200.0, 1200.0), Random::Number(-1200.0, 1200.0) } });
+    }
+    // Axis aligned, along region boundaries, and of zero length
+    requireMatchesBruteForce({ { -1000, 0 }, { 1000, 0 } });
+    requireMatchesBruteForce({ { 300, 1000 }, { 300, -1000 } });
+    requireMatchesBruteForce({ { -300, -300 }, { 300, 300 } });
+    requireMatchesBruteForce({ items.front()->GetLocation(), items.front()->GetLocation() });
+    requireMatchesBruteForce({ { 5000, 5000 }, { 6000, 6000 } });
+}
+
+TEST_CASE("SpatialMap stats", "[container]")
+{
+    Random::Seed(42);
+
+    SpatialMap<TestType> map(TestType::RADIUS, 100.0);
+    ContainerStats empty = map.GetStats();
+    REQUIRE(empty.items == 0);
+    REQUIRE(empty.regions == 0);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        map.Insert(TestType::Random());
+    }
+    ContainerStats stats = map.GetStats();
+    REQUIRE(stats.items == map.Size());
+    REQUIRE(stats.regions == map.RegionCount());
+    REQUIRE(stats.depth == 1);
+    REQUIRE(stats.bytesAllocated > empty.bytesAllocated);
+    size_t occupied = 0;
+    for (size_t regions : stats.occupancy) {
+        occupied += regions;
+    }
+    REQUIRE(occupied == stats.regions);
+    REQUIRE(stats.occupancy.size() > 1);
+    REQUIRE(stats.occupancy.front() == stats.emptyRegions);
+
+    // RemoveIf drops the regions it empties
+    map.RemoveIf([](const TestType& item) { return item.GetLocation().x < 0.0; });
+    ContainerStats removed = map.GetStats();
+    REQUIRE(removed.items == map.Size());
+    REQUIRE(removed.regions == map.RegionCount());
+    REQUIRE(removed.emptyRegions == 0);
+
+#ifdef UTILITY_CONTAINER_STATS
+    map.ResetQueryStats();
+    Circle area{ 0.0, 0.0, 300.0 };
+    size_t found = 0;
+    for ([[ maybe_unused ]] const auto& item : map.ItemsCollidingWith(area)) {
+        ++found;
+    }
+    QueryStats queries = map.GetStats().queries;
+    REQUIRE(queries.queries == 1);
+    REQUIRE(queries.regionsVisited > 0);
+    REQUIRE(queries.itemsMatched == found);
+    REQUIRE(queries.itemsTested >= found);
+
+    map.ResetQueryStats();
+    REQUIRE(map.GetStats().queries.queries == 0);
+#else
+    // Compiled out, so nothing is counted
+    for ([[ maybe_unused ]] const auto& item : map.ItemsCollidingWith(Circle{ 0.0, 0.0, 300.0 })) {
+    }
+    REQUIRE(map.GetStats().queries.queries == 0);
+    REQUIRE(sizeof(QueryCounters) == 1);
+#endif
+}
+
+TEMPLATE_TEST_CASE("SpatialMap QueryBatch", "[container]", Circle, Rect)
+{
+    // TestType is the query shape here, not the item type used by the other tests
+    using Query = TestType;
+    using Item = ::TestType;
+
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    SpatialMap<Item> pointerMap(Item::RADIUS, regionSize);
+    SpatialMap<Item, GridRegionTable, RegionLayout::Packed> packedMap(Item::RADIUS, regionSize);
+    for (size_t i = 0; i < 2000; ++i) {
+        auto item = Item::Random();
+        pointerMap.Insert(item);
+        packedMap.Insert(item);
+    }
+
+    std::vector<Query> queries;
+    for (size_t i = 0; i < 300; ++i) {
+        double x = Random::Number(-1100.0, 1100.0);
+        double y = Random::Number(-1100.0, 1100.0);
+        double size = Random::Number(0.0, 150.0);
+        if constexpr (std::is_same_v<Query, Circle>) {
+            queries.push_back(Circle{ x, y, size });
+        } else {
+            queries.push_back(Rect{ x, y, x + size, y + Random::Number(0.0, 150.0) });
+        }
+    }
+
+    std::vector<std::pair<size_t, const void*>> expected;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        for (const auto& item : pointerMap.CItemsCollidingWith(queries[i])) {
+            expected.emplace_back(i, &item);
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(!expected.empty());
+
+    auto requireSame = [&](std::vector<std::pair<size_t, const void*>> actual)
+    {
+        std::sort(actual.begin(), actual.end());
+        REQUIRE(actual == expected);
+    };
+
+    std::vector<std::pair<size_t, const void*>> actual;
+    std::as_const(pointerMap).QueryBatch(queries, [&](size_t queryIndex, const auto& item) { actual.emplace_back(queryIndex, &item); });
+    requireSame(std::move(actual));
+
+    actual.clear();
+    pointerMap.QueryBatch(std::span<const Query>(queries), [&](size_t queryIndex, std::shared_ptr<Item>& item) { actual.emplace_back(queryIndex, item.get()); });
+    requireSame(std::move(actual));
+
+    actual.clear();
+    std::as_const(packedMap).QueryBatch(queries, [&](size_t queryIndex, const auto& item) { actual.emplace_back(queryIndex, &item); });
+    requireSame(std::move(actual));
+}
+
+TEST_CASE("SpatialMap ForEachCollidingPair", "[container]")
+{
+    Random::Seed(872346548);
+
+    // Regions smaller than the items, so pairs can span several regions
+    const double regionSize = GENERATE(100.0, 3.0);
+    SpatialMap<TestType> pointerMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType, GridRegionTable, RegionLayout::Packed> packedMap(TestType::RADIUS, regionSize);
+    ThreadPool threads(3);
+
+    std::vector<std::shared_ptr<TestType>> items;
+    for (size_t i = 0; i < 1500; ++i) {
+        // Crowded into a small area so there are plenty of collisions
+        Point location{ Random::Number(-200.0, 200.0), Random::Number(-200.0, 200.0) };
+        items.push_back(std::make_shared<TestType>(location, 0.0, 0.0));
+        pointerMap.Insert(items.back());
+        packedMap.Insert(items.back());
+    }
+
+    using Pair = std::pair<const void*, const void*>;
+    auto ordered = [](const void* a, const void* b) -> Pair { return a < b ? Pair{ a, b } : Pair{ b, a }; };
+
+    std::vector<Pair> expected;
+    for (size_t a = 0; a < items.size(); ++a) {
+        for (size_t b = a + 1; b < items.size(); ++b) {
+            if (Collides(items[a]->GetCollide(), items[b]->GetCollide())) {
+                expected.push_back(ordered(items[a].get(), items[b].get()));
+            }
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(!expected.empty());
+
+    auto requireSame = [&](std::vector<Pair> actual)
+    {
+        std::sort(actual.begin(), actual.end());
+        REQUIRE(actual == expected);
+    };
+
+    std::vector<Pair> actual;
+    pointerMap.ForEachCollidingPair([&](std::shared_ptr<TestType>& a, std::shared_ptr<TestType>& b) { actual.push_back(ordered(a.get(), b.get())); });
+    requireSame(std::move(actual));
+
+    actual.clear();
+    std::as_const(packedMap).ForEachCollidingPair([&](const TestType& a, const TestType& b) { actual.push_back(ordered(&a, &b)); });
+    requireSame(std::move(actual));
+
+    std::vector<std::vector<Pair>> perChunk(threads.ThreadCount());
+    pointerMap.ForEachCollidingPair(threads, [&](const TestType& a, const TestType& b, size_t chunk) { perChunk[chunk].push_back(ordered(&a, &b)); });
+    actual.clear();
+    for (const auto& pairs : perChunk) {
+        actual.insert(actual.end(), pairs.begin(), pairs.end());
+    }
+    requireSame(std::move(actual));
+}
+
+TEST_CASE("SpatialMap raw pointers", "[container]")
+{
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType> sharedMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType, GridRegionTable, RegionLayout::Pointers, TestType*> rawMap(TestType::RADIUS, regionSize);
+    SlotMap<TestType> pool;
+
+    std::vector<std::shared_ptr<TestType>> sharedItems;
+    std::vector<SlotMap<TestType>::Handle> handles;
+    for (size_t i = 0; i < 500; ++i) {
+        sharedItems.push_back(TestType::Random());
+        handles.push_back(pool.Emplace(*sharedItems.back()));
+        sharedMap.Insert(sharedItems.back());
+        rawMap.Insert(pool.Get(handles.back()));
+    }
+
+    for (int tick = 0; tick < 10; ++tick) {
+        size_t toTerminate = Random::Number<size_t>(0, sharedItems.size() - 1);
+        sharedItems[toTerminate]->Terminate();
+        if (TestType* item = pool.Get(handles[toTerminate])) {
+            item->Terminate();
+        }
+
+        sharedMap.MoveAndRemove();
+        rawMap.MoveAndRemove();
+        // The map does not own its items, so they must be erased from the pool once removed
+        pool.EraseIf([](const TestType& item) { return !item.Exists(); });
+
+        REQUIRE(sharedMap.Size() == rawMap.Size());
+        REQUIRE(rawMap.Size() == pool.Size());
+
+        Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), 250.0 };
+        std::vector<Point> sharedLocations;
+        for (const auto& item : sharedMap.CItemsCollidingWith(collider)) {
+            sharedLocations.push_back(item.GetLocation());
+        }
+        std::vector<Point> rawLocations;
+        for (TestType* item : rawMap.ItemsCollidingWith(collider)) {
+            rawLocations.push_back(item->GetLocation());
+        }
+        REQUIRE(sharedLocations == rawLocations);
+    }
+
+    const TestType* nearest = std::as_const(rawMap).Nearest({ 0, 0 });
+    REQUIRE(nearest != nullptr);
+    REQUIRE(nearest->GetLocation() == sharedMap.Nearest({ 0, 0 })->GetLocation());
+
+    auto live = std::find_if(handles.begin(), handles.end(), [&](const auto& handle) { return pool.Contains(handle); });
+    REQUIRE(live != handles.end());
+    rawMap.Erase(pool.Get(*live));
+    pool.Erase(*live);
+    REQUIRE(rawMap.Size() == pool.Size());
+}
+
+TEST_CASE("SpatialMap move only pointers", "[container]")
+{
+    Random::Seed(5517209);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType> sharedMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType, GridRegionTable, RegionLayout::Pointers, std::unique_ptr<TestType>> uniqueMap(TestType::RADIUS, regionSize);
+    ThreadPool threads(4);
+
+    std::vector<std::shared_ptr<TestType>> sharedItems;
+    // The map owns its items, these are only valid until it removes them
+    std::vector<TestType*> uniqueItems;
+    for (size_t i = 0; i < 500; ++i) {
+        sharedItems.push_back(TestType::Random());
+        auto item = std::make_unique<TestType>(*sharedItems.back());
+        uniqueItems.push_back(item.get());
+        sharedMap.Insert(sharedItems.back());
+        uniqueMap.Insert(std::move(item));
+    }
+
+    for (int tick = 0; tick < 10; ++tick) {
+        size_t toTerminate = Random::Number<size_t>(0, sharedItems.size() - 1);
+        if (sharedItems[toTerminate]->Exists()) {
+            sharedItems[toTerminate]->Terminate();
+            uniqueItems[toTerminate]->Terminate();
+        }
+
+        sharedMap.MoveAndRemove();
+        if (tick % 2 == 0) {
+            uniqueMap.MoveAndRemove();
+        } else {
+            uniqueMap.MoveAndRemove(threads);
+        }
+        REQUIRE(sharedMap.Size() == uniqueMap.Size());
+
+        Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), 250.0 };
+        std::vector<Point> sharedLocations;
+        for (const auto& item : sharedMap.CItemsCollidingWith(collider)) {
+            sharedLocations.push_back(item.GetLocation());
+        }
+        std::vector<Point> uniqueLocations;
+        for (const auto& item : uniqueMap.CItemsCollidingWith(collider)) {
+            uniqueLocations.push_back(item.GetLocation());
+        }
+        REQUIRE(sharedLocations == uniqueLocations);
+
+        // Move only pointers cannot be copied out, so plain pointers are returned
+        Point origin{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0) };
+        TestType* nearest = uniqueMap.Nearest(origin);
+        const TestType* constNearest = std::as_const(uniqueMap).Nearest(origin);
+        REQUIRE(nearest != nullptr);
+        REQUIRE(nearest == constNearest);
+        REQUIRE(nearest->GetLocation() == sharedMap.Nearest(origin)->GetLocation());
+
+        std::vector<TestType*> kNearest = uniqueMap.KNearest(origin, 5);
+        std::vector<const TestType*> constKNearest = std::as_const(uniqueMap).KNearest(origin, 5);
+        auto sharedKNearest = sharedMap.KNearest(origin, 5);
+        REQUIRE(kNearest.size() == sharedKNearest.size());
+        REQUIRE(constKNearest.size() == sharedKNearest.size());
+        for (size_t i = 0; i < kNearest.size(); ++i) {
+            REQUIRE(kNearest[i] == constKNearest[i]);
+            REQUIRE(kNearest[i]->GetLocation() == sharedKNearest[i]->GetLocation());
+        }
+    }
+
+    uniqueMap.SetRegionSize(regionSize * 2);
+    REQUIRE(uniqueMap.Size() == sharedMap.Size());
+    uniqueMap.Clear();
+    REQUIRE(uniqueMap.Size() == 0);
+}
+
+TEMPLATE_TEST_CASE_SIG("SpatialMap indexed Erase", "[container]", ((RegionLayout Layout), Layout), RegionLayout::Pointers, RegionLayout::Packed)
+{
+    Random::Seed(1237846);
+
+    static_assert(SpatialMapIndexed<IndexedTestType>);
+    static_assert(!SpatialMapIndexed<TestType>);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType, GridRegionTable, Layout> map(TestType::RADIUS, regionSize);
+    SpatialMap<IndexedTestType, GridRegionTable, Layout> indexedMap(TestType::RADIUS, regionSize);
+
+    std::vector<std::shared_ptr<TestType>> items;
+    std::vector<std::shared_ptr<IndexedTestType>> indexedItems;
+    for (size_t i = 0; i < 1000; ++i) {
+        items.push_back(TestType::Random());
+        indexedItems.push_back(std::make_shared<IndexedTestType>(*items.back()));
+        map.Insert(items.back());
+        indexedMap.Insert(indexedItems.back());
+    }
+    REQUIRE(map.RegionCount() == indexedMap.RegionCount());
+
+    while (!items.empty()) {
+        size_t toErase = Random::Number<size_t>(0, items.size() - 1);
+        map.Erase(items[toErase]);
+        indexedMap.Erase(indexedItems[toErase]);
+        std::swap(items[toErase], items.back());
+        std::swap(indexedItems[toErase], indexedItems.back());
+        items.pop_back();
+        indexedItems.pop_back();
+
+        REQUIRE(map.Size() == items.size());
+        REQUIRE(indexedMap.Size() == items.size());
+        // Empty regions are reclaimed
+        REQUIRE(map.RegionCount() == indexedMap.RegionCount());
+
+        if (items.size() % 100 == 0) {
+            Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), 300.0 };
+            std::vector<Point> locations;
+            for (const auto& item : map.CItemsCollidingWith(collider)) {
+                locations.push_back(item.GetLocation());
+            }
+            std::vector<Point> indexedLocations;
+            for (const auto& item : indexedMap.CItemsCollidingWith(collider)) {
+                indexedLocations.push_back(item.GetLocation());
+            }
+            REQUIRE(locations == indexedLocations);
+        }
+    }
+    REQUIRE(map.RegionCount() == 0);
+    REQUIRE(indexedMap.RegionCount() == 0);
+}
+
+TEST_CASE("SpatialMap auto region size", "[container]")
+{
+    Random::Seed(9823475);
+
+    SpatialMap<TestType, GridRegionTable, RegionLayout::Pointers, TestType*> fixedMap(TestType::RADIUS, 100.0);
+    SpatialMap<TestType, GridRegionTable, RegionLayout::Pointers, TestType*> autoMap(Rect{ -1000, -1000, 1000, 1000 }, TestType::RADIUS, 1000.0);
+    SlotMap<TestType> fixedPool;
+    SlotMap<TestType> autoPool;
+    autoMap.SetAutoRegionSize(AutoRegionSize{ .sampleInterval = 1, .rebuildTicks = 4 });
+
+    std::vector<std::pair<SlotMap<TestType>::Handle, SlotMap<TestType>::Handle>> handles;
+    auto insert = [&]()
+    {
+        auto item = TestType::Random();
+        handles.emplace_back(fixedPool.Emplace(*item), autoPool.Emplace(*item));
+        fixedMap.Insert(fixedPool.Get(handles.back().first));
+        autoMap.Insert(autoPool.Get(handles.back().second));
+    };
+    for (size_t i = 0; i < 2000; ++i) {
+        insert();
+    }
+
+    auto sortedLocations = [](const auto& map, const Circle& collider)
+    {
+        std::vector<Point> locations;
+        for (const auto& item : map.CItemsCollidingWith(collider)) {
+            locations.push_back(item.GetLocation());
+        }
+        std::sort(std::begin(locations), std::end(locations), [](const Point& a, const Point& b) { return std::tie(a.x, a.y) < std::tie(b.x, b.y); });
+        return locations;
+    };
+
+    std::vector<double> regionSizes{ autoMap.RegionSize() };
+    bool rebuilt = false;
+    for (int tick = 0; tick < 100; ++tick) {
+        // Thin the items out over time, so the region size must grow again
+        size_t toTerminate = tick < 50 ? 5 : 100;
+        for (size_t i = 0; i < toTerminate && !handles.empty(); ++i) {
+            size_t index = Random::Number<size_t>(0, handles.size() - 1);
+            fixedPool.Get(handles[index].first)->Terminate();
+            autoPool.Get(handles[index].second)->Terminate();
+            std::swap(handles[index], handles.back());
+            handles.pop_back();
+        }
+        if (tick % 3 == 0) {
+            insert();
+        }
+        if (tick % 7 == 0 && !handles.empty()) {
+            fixedMap.Erase(fixedPool.Get(handles.back().first));
+            autoMap.Erase(autoPool.Get(handles.back().second));
+            fixedPool.Erase(handles.back().first);
+            autoPool.Erase(handles.back().second);
+            handles.pop_back();
+        }
+
+        fixedMap.MoveAndRemove();
+        autoMap.MoveAndRemove();
+        // Items are not owned by the maps, so copies held by a rebuild must never be dereferenced once removed
+        fixedPool.EraseIf([](const TestType& item) { return !item.Exists(); });
+        autoPool.EraseIf([](const TestType& item) { return !item.Exists(); });
+
+        rebuilt = rebuilt || autoMap.Rebuilding();
+        if (regionSizes.back() != autoMap.RegionSize()) {
+            regionSizes.push_back(autoMap.RegionSize());
+        }
+
+        REQUIRE(fixedMap.Size() == handles.size());
+        REQUIRE(autoMap.Size() == handles.size());
+        Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), Random::Number(0.0, 500.0) };
+        REQUIRE(sortedLocations(fixedMap, collider) == sortedLocations(autoMap, collider));
+    }
+
+    REQUIRE(rebuilt);
+    REQUIRE(regionSizes.size() >= 3);
+    // Crowded regions shrink first, then grow as items are removed
+    REQUIRE(regionSizes[1] < regionSizes[0]);
+    REQUIRE(regionSizes.back() > regionSizes[1]);
+
+    SECTION("Disabling abandons the rebuild")
+    {
+        autoMap.SetAutoRegionSize(std::nullopt);
+        REQUIRE(!autoMap.Rebuilding());
+        double regionSize = autoMap.RegionSize();
+        autoMap.MoveAndRemove();
+        REQUIRE(autoMap.RegionSize() == regionSize);
+    }
+}
+
+TEST_CASE("SpatialMap auto region size indexed", "[container]")
+{
+    Random::Seed(2093847);
+
+    SpatialMap<IndexedTestType> map(TestType::RADIUS, 1000.0);
+    map.SetAutoRegionSize(AutoRegionSize{ .sampleInterval = 1, .rebuildTicks = 8 });
+
+    std::vector<std::shared_ptr<IndexedTestType>> items;
+    auto insert = [&]()
+    {
+        items.push_back(std::make_shared<IndexedTestType>(*TestType::Random()));
+        map.Insert(items.back());
+    };
+    for (size_t i = 0; i < 2000; ++i) {
+        insert();
+    }
+
+    size_t rebuildingTicks = 0;
+    for (int tick = 0; tick < 40; ++tick) {
+        // Neither the new regions nor the retired ones may keep an erased item alive
+        size_t index = Random::Number<size_t>(0, items.size() - 1);
+        map.Erase(items[index]);
+        REQUIRE(items[index].use_count() == 1);
+        std::swap(items[index], items.back());
+        items.pop_back();
+
+        index = Random::Number<size_t>(0, items.size() - 1);
+        std::weak_ptr<IndexedTestType> terminated = items[index];
+        items[index]->Terminate();
+        std::swap(items[index], items.back());
+        items.pop_back();
+
+        insert();
+        map.MoveAndRemove();
+        REQUIRE(terminated.expired());
+        REQUIRE(map.Size() == items.size());
+        rebuildingTicks += map.Rebuilding() ? 1 : 0;
+
+        // Items keep the indices of the regions queries use, so each region's items are indexed 0 to n - 1
+        std::map<std::pair<int32_t, int32_t>, std::vector<size_t>> indices;
+        for (const auto& item : items) {
+            const Point& location = item->GetLocation();
+            std::pair<int32_t, int32_t> coordinates{ static_cast<int32_t>((location.x / map.RegionSize()) - std::signbit(location.x)),
+                                                     static_cast<int32_t>((location.y / map.RegionSize()) - std::signbit(location.y)) };
+            indices[coordinates].push_back(item->GetSpatialMapIndex());
+        }
+        for (auto& [ coordinates, regionIndices ] : indices) {
+            std::sort(std::begin(regionIndices), std::end(regionIndices));
+            for (size_t i = 0; i < regionIndices.size(); ++i) {
+                REQUIRE(regionIndices[i] == i);
+            }
+        }
+    }
+    // Long enough to finish a rebuild, and release the retired regions
+    REQUIRE(rebuildingTicks >= 8);
+    REQUIRE(map.RegionSize() < 1000.0);
+}
+
+TEST_CASE("SpatialMap SortedRegionTable", "[container]")
+{
+    Random::Seed(872346548);
+
+    constexpr double regionSize = 100;
+    SpatialMap<TestType> gridMap(TestType::RADIUS, regionSize);
+    SpatialMap<TestType, SortedRegionTable> sortedMap(TestType::RADIUS, regionSize);
+
+    for (size_t i = 0; i < 500; ++i) {
+        auto item = TestType::Random();
+        gridMap.Insert(item);
+        sortedMap.Insert(std::make_shared<TestType>(*item));
+    }
+
+    for (int tick = 0; tick < 10; ++tick) {
+        Circle cull{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), 100.0 };
+        auto predicate = [&](const TestType& item) { return Contains(cull, item.GetLocation()); };
+        gridMap.RemoveIf(predicate);
+        sortedMap.RemoveIf(predicate);
+
+        gridMap.MoveAndRemove();
+        sortedMap.MoveAndRemove();
+
+        REQUIRE(gridMap.Size() == sortedMap.Size());
+        REQUIRE(gridMap.RegionCount() == sortedMap.RegionCount());
+
+        Circle collider{ Random::Number(-1000.0, 1000.0), Random::Number(-1000.0, 1000.0), 250.0 };
+        size_t gridCount = 0;
+        for ([[ maybe_unused ]] const auto& item : gridMap.CItemsCollidingWith(collider)) {
+            ++gridCount;
+        }
+        size_t sortedCount = 0;
+        for ([[ maybe_unused ]] const auto& item : sortedMap.CItemsCollidingWith(collider)) {
+            ++sortedCount;
+        }
+        REQUIRE(gridCount == sortedCount);
+    }
+
+    // Regions are visited along a Z-order curve once new regions have been merged
+    sortedMap.RemoveIf([](const TestType&) { return false; });
+    std::vector<uint64_t> codes;
+    for (const Rect& region : sortedMap.CRegions()) {
+        auto coordinate = [&](double value) { return static_cast<uint32_t>(static_cast<int32_t>(std::floor(value / regionSize))) ^ 0x80000000u; };
+        codes.push_back(MortonEncode(coordinate(region.left), coordinate(region.top)));
+    }
+    REQUIRE(std::is_sorted(std::begin(codes), std::end(codes)));
+}
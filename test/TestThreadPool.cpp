@@ -0,0 +1,99 @@
+#include <ThreadPool.h>
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <numeric>
+#include <stdexcept>
+
+using namespace util;
+
+TEST_CASE("ThreadPool", "[threads]")
+{
+    unsigned threadCount = GENERATE(1u, 2u, 7u);
+    ThreadPool threads(threadCount);
+    REQUIRE(threads.ThreadCount() == threadCount);
+
+    SECTION("Every index is visited exactly once")
+    {
+        for (size_t count : { 0, 1, 2, 5, 7, 100, 10'000 }) {
+            std::vector<std::atomic<unsigned>> visits(count);
+            std::vector<size_t> chunkSizes(threadCount, 0);
+            threads.ParallelFor(count, [&](size_t begin, size_t end, size_t chunk)
+            {
+                chunkSizes.at(chunk) = end - begin;
+                for (size_t i = begin; i < end; ++i) {
+                    ++visits[i];
+                }
+            });
+            for (const auto& visited : visits) {
+                REQUIRE(visited == 1);
+            }
+            REQUIRE(std::accumulate(chunkSizes.begin(), chunkSizes.end(), size_t{ 0 }) == count);
+        }
+    }
+
+    SECTION("ParallelForEach visits every index exactly once")
+    {
+        for (size_t count : { 0, 1, 2, 5, 7, 100, 10'000 }) {
+            std::vector<std::atomic<unsigned>> visits(count);
+            threads.ParallelForEach(count, [&](size_t index)
+            {
+                ++visits.at(index);
+            });
+            for (const auto& visited : visits) {
+                REQUIRE(visited == 1);
+            }
+        }
+
+        REQUIRE_THROWS_AS(threads.ParallelForEach(100, [](size_t index)
+        {
+            if (index == 50) {
+                throw std::runtime_error("Task 50");
+            }
+        }), std::runtime_error);
+    }
+
+    SECTION("Chunks are contiguous and in order")
+    {
+        constexpr size_t count = 1000;
+        std::vector<std::pair<size_t, size_t>> chunks(threadCount, { 0, 0 });
+        threads.ParallelFor(count, [&](size_t begin, size_t end, size_t chunk)
+        {
+            chunks.at(chunk) = { begin, end };
+        });
+        size_t expectedBegin = 0;
+        for (const auto& [ begin, end ] : chunks) {
+            REQUIRE(begin == expectedBegin);
+            expectedBegin = end;
+        }
+        REQUIRE(expectedBegin == count);
+    }
+
+    SECTION("Reuse")
+    {
+        std::atomic<size_t> total = 0;
+        for (int repeat = 0; repeat < 500; ++repeat) {
+            threads.ParallelFor(64, [&](size_t begin, size_t end, size_t)
+            {
+                total += end - begin;
+            });
+        }
+        REQUIRE(total == 500 * 64);
+    }
+
+    SECTION("Exceptions")
+    {
+        REQUIRE_THROWS_AS(threads.ParallelFor(100, [](size_t begin, size_t, size_t)
+        {
+            if (begin == 0) {
+                throw std::runtime_error("First chunk");
+            }
+        }), std::runtime_error);
+
+        // Still usable afterwards
+        std::atomic<size_t> total = 0;
+        threads.ParallelFor(100, [&](size_t begin, size_t end, size_t) { total += end - begin; });
+        REQUIRE(total == 100);
+    }
+}